@@ -0,0 +1,282 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fd44.h"
+#include "search.h"
+#include "thread.h"
+#include "imagegen.h"
+
+#define DEFAULT_ITERATIONS 5
+#define DEFAULT_SIZE_MB    16
+
+/* Names of bios.h signatures in SIG_* order */
+static const char* SIGNATURE_NAMES[SIG_COUNT] = {
+    "BOOTEFI", "GbE", "EFI volume", "DummyMSOA", "MSOA", "SLIC pubkey",
+    "SLIC marker", "FD44 module", "ASUSBKP", "ASUSBKP pubkey", "ASUSBKP marker"
+};
+
+/* Benchmark stages */
+enum {
+    STAGE_LOAD = 0,
+    STAGE_SEARCH,
+    STAGE_SCAN = STAGE_SEARCH + SIG_COUNT,
+    STAGE_OPEN_INPUT,
+    STAGE_EXTRACT,
+    STAGE_OPEN_OUTPUT,
+    STAGE_PATCH,
+    STAGE_VERIFY,
+    STAGE_WRITE,
+    STAGE_COUNT
+};
+
+/* Names of stages other than signature searches, in stage order */
+static const char* STAGE_NAMES[STAGE_COUNT - SIG_COUNT] = {
+    "load output", "scan all signatures", "open input", "extract", "open output", "patch", "verify all", "write back"
+};
+
+/* Copying scenarios */
+#define SCENARIO_COUNT 3
+static const char* SCENARIO_NAMES[SCENARIO_COUNT] = {
+    "SLIC modules, two GbE banks",
+    "ASUSBKP, flash descriptor, capsule",
+    "single GbE bank, MSOA, many FD44 modules"
+};
+
+/* Sets generator options of input and output files of scenario */
+static void setup_scenario(uint32_t scenario, uint32_t size, IMAGEGEN_OPTIONS* input, IMAGEGEN_OPTIONS* output)
+{
+    static const uint8_t MAC[GBE_MAC_LENGTH] = {0x10, 0xBF, 0x48, 0x01, 0x02, 0x03};
+
+    imagegen_defaults(input);
+    imagegen_defaults(output);
+    input->size = output->size = size;
+    input->seed = 2;
+    output->seed = 3;
+    memcpy(input->gbeMac, MAC, sizeof(MAC));
+    input->fd44Empty = 0;
+
+    switch (scenario)
+    {
+    case 0:
+        input->fd44Modules = output->fd44Modules = 2;
+        input->slic = 1;
+        break;
+    case 1:
+        input->asusbkp = 1;
+        input->descriptor = output->descriptor = 1;
+        output->capsule = 1;
+        break;
+    default:
+        input->gbeBanks = output->gbeBanks = 1;
+        input->msoa = output->msoa = IMAGEGEN_MSOA;
+        input->slic = 1;
+        input->fd44Modules = output->fd44Modules = 16;
+        break;
+    }
+}
+
+/* Builds image and writes it to file.
+ * Returns 1 on success and 0 on failure */
+static int write_image(const IMAGEGEN_OPTIONS* options, const char* path)
+{
+    uint8_t* image;
+    uint32_t size;
+    FILE* file;
+    int result;
+
+    image = imagegen_build(options, &size);
+    if (!image)
+        return 0;
+    file = fopen(path, "wb");
+    result = file && fwrite(image, 1, size, file) == size;
+    if (file && fclose(file))
+        result = 0;
+    free(image);
+    return result;
+}
+
+/* Runs all stages of scenario once and adds their durations to times.
+ * Returns 1 on success and 0 if any stage fails */
+static int run_stages(const FD44* fd44, const char* input, const char* output, const char* saveas, uint32_t flags, uint64_t* times)
+{
+    FD44_OPTIONS options = { 1, 1, 1, 1, 0, FD44_VERIFY_TOUCHED };
+    FD44_IMAGE inputImage;
+    FD44_IMAGE outputImage;
+    FD44_DONOR donor;
+    SCAN_RESULT hits;
+    IMAGE image;
+    uint64_t time;
+    uint32_t sig;
+    uint32_t i;
+    volatile uint8_t sum = 0;
+    int result;
+
+    /* Loading output file and touching every page, so mapped files are actually read */
+    time = timer_now();
+    if (image_open(&image, output, flags) != IMAGE_OK)
+        return 0;
+    for (i = 0; i < image.size; i += 0x1000)
+        sum += image.data[i];
+    times[STAGE_LOAD] += timer_now() - time;
+
+    /* Searching every signature separately as find_pattern callers did, then all of them in one pass */
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        uint8_t* found = image.data;
+        time = timer_now();
+        while ((found = find_pattern(found, image.data + image.size, SIGNATURES[sig].pattern, SIGNATURES[sig].length)) != NULL)
+            found++;
+        times[STAGE_SEARCH + sig] += timer_now() - time;
+    }
+    memset(&hits, 0, sizeof(hits));
+    time = timer_now();
+    result = scanner_scan(&fd44->scanner, image.data, image.data + image.size, &hits);
+    times[STAGE_SCAN] += timer_now() - time;
+    scan_result_free(&hits);
+    image_close(&image);
+    if (!result)
+        return 0;
+
+    /* Extracting input file data */
+    time = timer_now();
+    if (fd44_open(fd44, &inputImage, input, flags, NULL) != FD44_OK)
+        return 0;
+    times[STAGE_OPEN_INPUT] += timer_now() - time;
+    time = timer_now();
+    result = fd44_extract(&inputImage, &options, &donor, NULL);
+    times[STAGE_EXTRACT] += timer_now() - time;
+    fd44_close(&inputImage);
+    if (result != FD44_OK)
+    {
+        fd44_donor_free(&donor);
+        return 0;
+    }
+
+    /* Patching output file and saving it as another file, so it stays the same for the next iteration */
+    time = timer_now();
+    result = fd44_open(fd44, &outputImage, output, flags | IMAGE_WRITABLE | IMAGE_SAVE_AS, NULL);
+    times[STAGE_OPEN_OUTPUT] += timer_now() - time;
+    if (result == FD44_OK)
+    {
+        time = timer_now();
+        result = fd44_apply(&outputImage, &options, &donor, NULL);
+        times[STAGE_PATCH] += timer_now() - time;
+        if (result == FD44_OK)
+        {
+            time = timer_now();
+            result = fd44_verify(&outputImage, FD44_VERIFY_ALL, NULL);
+            times[STAGE_VERIFY] += timer_now() - time;
+        }
+        if (result == FD44_OK)
+        {
+            time = timer_now();
+            result = fd44_save(&outputImage, saveas, NULL, NULL);
+            times[STAGE_WRITE] += timer_now() - time;
+        }
+        fd44_close(&outputImage);
+    }
+    fd44_donor_free(&donor);
+    return result == FD44_OK;
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    FD44 fd44;
+    IMAGEGEN_OPTIONS inputOptions;
+    IMAGEGEN_OPTIONS outputOptions;
+    char input[4096];
+    char output[4096];
+    char saveas[4096];
+    const char* directory = ".";
+    uint32_t iterations = DEFAULT_ITERATIONS;
+    uint32_t size = DEFAULT_SIZE_MB;
+    uint32_t flags = 0;
+    uint32_t scenario;
+    int result = 0;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (argv[arg][0] == '-' && atoi(argv[arg] + 1) > 0)
+            iterations = (uint32_t)atoi(argv[arg] + 1);
+        else if (!strncmp(argv[arg], "--size=", 7) && atoi(argv[arg] + 7) > 0)
+            size = (uint32_t)atoi(argv[arg] + 7);
+        else if (!strncmp(argv[arg], "--dir=", 6) && argv[arg][6])
+            directory = argv[arg] + 6;
+        else if (!strcmp(argv[arg], "--no-mmap"))
+            flags |= IMAGE_NO_MMAP;
+        else
+            break;
+    }
+    if (arg != argc || size > 2047 || strlen(directory) > sizeof(input) - 32)
+    {
+        printf("Usage: fd44_bench <-ITERATIONS> <--size=MB> <--dir=DIR> <--no-mmap>\n\n"
+               "Generates input and output files of every copying scenario in DIR and times every stage of copying:\n"
+               "loading, separate search of each signature, single pass scan, extraction, patching, verification and writing.\n"
+               "Exit code is not 0 if any stage fails, so it can be used to catch regressions.\n");
+        return 2;
+    }
+
+    if (!fd44_init(&fd44))
+    {
+        printf("Signature scanner can't be initialized.\n");
+        return 1;
+    }
+    sprintf(input, "%s/fd44_bench_input.bin", directory);
+    sprintf(output, "%s/fd44_bench_output.bin", directory);
+    sprintf(saveas, "%s/fd44_bench_saveas.bin", directory);
+
+    for (scenario = 0; scenario < SCENARIO_COUNT; scenario++)
+    {
+        uint64_t times[STAGE_COUNT];
+        uint32_t stage;
+        uint32_t i;
+
+        setup_scenario(scenario, size << 20, &inputOptions, &outputOptions);
+        if (!write_image(&inputOptions, input) || !write_image(&outputOptions, output))
+        {
+            perror("Can't write benchmark files.\n");
+            result = 1;
+            break;
+        }
+
+        memset(times, 0, sizeof(times));
+        for (i = 0; i < iterations; i++)
+        {
+            if (!run_stages(&fd44, input, output, saveas, flags, times))
+                break;
+        }
+
+        printf("%s (%u MB, %u iterations)\n", SCENARIO_NAMES[scenario], size, iterations);
+        if (i != iterations)
+        {
+            printf("  FAILED\n");
+            result = 1;
+            continue;
+        }
+        for (stage = 0; stage < STAGE_COUNT; stage++)
+        {
+            double elapsed = (double)times[stage] / iterations / 1000.0;
+            char name[64];
+
+            if (stage >= STAGE_SEARCH && stage < STAGE_SCAN)
+                sprintf(name, "search %s", SIGNATURE_NAMES[stage - STAGE_SEARCH]);
+            else
+                strcpy(name, STAGE_NAMES[stage < STAGE_SEARCH ? stage : stage - SIG_COUNT]);
+            printf("  %-24s %9.3f ms", name, elapsed);
+            if (stage <= STAGE_OPEN_OUTPUT && stage != STAGE_EXTRACT && elapsed > 0)
+                printf(" %9.1f MB/s", (double)(size << 20) / elapsed / 1e3);
+            printf("\n");
+        }
+    }
+
+    remove(input);
+    remove(output);
+    remove(saveas);
+    fd44_free(&fd44);
+    return result;
+}
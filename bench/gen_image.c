@@ -0,0 +1,127 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imagegen.h"
+
+/* Parses MAC written as 6 hexadecimal bytes separated by colons.
+ * Returns 1 on success and 0 on failure */
+static int parse_mac(const char* text, uint8_t* mac)
+{
+    unsigned int bytes[GBE_MAC_LENGTH];
+    uint32_t i;
+
+    if (sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]) != GBE_MAC_LENGTH)
+        return 0;
+    for (i = 0; i < GBE_MAC_LENGTH; i++)
+        mac[i] = (uint8_t)bytes[i];
+    return 1;
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    IMAGEGEN_OPTIONS options;
+    uint8_t* image;
+    uint32_t size;
+    FILE* file;
+    int arg;
+
+    imagegen_defaults(&options);
+    for (arg = 1; arg < argc && !strncmp(argv[arg], "--", 2); arg++)
+    {
+        if (!strncmp(argv[arg], "--size=", 7) && atoi(argv[arg] + 7) > 0)
+            options.size = (uint32_t)atoi(argv[arg] + 7) << 20;
+        else if (!strncmp(argv[arg], "--name=", 7))
+            options.motherboardName = argv[arg] + 7;
+        else if (!strncmp(argv[arg], "--name-tail=", 12))
+            options.nameTail = (int16_t)(strtoul(argv[arg] + 12, NULL, 0) & 0xFF);
+        else if (!strncmp(argv[arg], "--gbe=", 6))
+            options.gbeBanks = (uint32_t)atoi(argv[arg] + 6);
+        else if (!strncmp(argv[arg], "--mac=", 6) && parse_mac(argv[arg] + 6, options.gbeMac))
+            ;
+        else if (!strcmp(argv[arg], "--descriptor"))
+            options.descriptor = 1;
+        else if (!strncmp(argv[arg], "--fd44=", 7))
+            options.fd44Modules = (uint32_t)atoi(argv[arg] + 7);
+        else if (!strcmp(argv[arg], "--fd44-data"))
+            options.fd44Empty = 0;
+        else if (!strcmp(argv[arg], "--no-bsa"))
+            options.fd44Bsa = 0;
+        else if (!strcmp(argv[arg], "--msoa=none"))
+            options.msoa = IMAGEGEN_MSOA_NONE;
+        else if (!strcmp(argv[arg], "--msoa=dummy"))
+            options.msoa = IMAGEGEN_MSOA_DUMMY;
+        else if (!strcmp(argv[arg], "--msoa=msoa"))
+            options.msoa = IMAGEGEN_MSOA;
+        else if (!strcmp(argv[arg], "--slic"))
+            options.slic = 1;
+        else if (!strcmp(argv[arg], "--asusbkp"))
+            options.asusbkp = 1;
+        else if (!strcmp(argv[arg], "--capsule"))
+            options.capsule = 1;
+        else if (!strncmp(argv[arg], "--volume-length=", 16))
+            options.volumeLength = (uint32_t)strtoul(argv[arg] + 16, NULL, 0);
+        else if (!strncmp(argv[arg], "--seed=", 7))
+            options.seed = (uint32_t)strtoul(argv[arg] + 7, NULL, 0);
+        else
+        {
+            printf("Unknown option %s.\n", argv[arg]);
+            return 2;
+        }
+    }
+
+    if (arg + 1 != argc)
+    {
+        printf("Usage: gen_image <--OPTIONS> FILE\n\n"
+               "Writes synthetic BIOS image to FILE, by default it is a stock output file:\n"
+               "8 MB, two GbE banks with stub MAC, one empty BSA_ FD44 module and DummyMSOA without SLIC.\n\n"
+               "Options: --size=MB - size of BIOS data in megabytes, at least 1.\n"
+               "         --name=NAME - motherboard name in BOOTEFI block, default is P8Z77-V.\n"
+               "         --name-tail=N - byte following motherboard name field, erased by default.\n"
+               "         --gbe=N - number of GbE banks, 0 to 2.\n"
+               "         --mac=XX:XX:XX:XX:XX:XX - MAC stored in GbE banks instead of stub.\n"
+               "         --descriptor - add Intel flash descriptor with GbE region.\n"
+               "         --fd44=N - number of FD44 modules.\n"
+               "         --fd44-data - fill FD44 modules with data.\n"
+               "         --no-bsa - make FD44 modules other than BSA_ modules.\n"
+               "         --msoa=none|dummy|msoa - module of the second EFI volume, default is dummy.\n"
+               "         --slic - add SLIC pubkey and marker modules.\n"
+               "         --asusbkp - add ASUSBKP block with SLIC pubkey and marker.\n"
+               "         --capsule - prepend Aptio capsule header.\n"
+               "         --volume-length=N - length stored in the second EFI volume header, for corrupt images.\n"
+               "         --seed=N - seed of random contents.\n");
+        return 2;
+    }
+
+    image = imagegen_build(&options, &size);
+    if (!image)
+    {
+        printf("Image can't be generated with given options.\n");
+        return 2;
+    }
+    file = fopen(argv[arg], "wb");
+    if (!file)
+    {
+        perror("Can't open image file.\n");
+        free(image);
+        return 1;
+    }
+    if (fwrite(image, 1, size, file) != size)
+    {
+        perror("Can't write image file.\n");
+        fclose(file);
+        free(image);
+        return 1;
+    }
+    if (fclose(file))
+    {
+        perror("Can't write image file.\n");
+        free(image);
+        return 1;
+    }
+
+    free(image);
+    return 0;
+}
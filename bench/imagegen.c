@@ -0,0 +1,297 @@
+#include <stdlib.h>
+#include <string.h>
+#include "imagegen.h"
+
+/* Layout of generated BIOS data */
+#define GEN_GBE_OFFSET          0x1000                                    /* offset of the first GbE bank, banks follow each other */
+#define GEN_GBE_BANK_LENGTH     0x1000                                    /* length of GbE bank */
+#define GEN_GBE_DATA_LENGTH     0x80                                      /* length of GbE bank data before erased space */
+#define GEN_BIOS_OFFSET         0x10000                                   /* offset of BIOS region and the first EFI volume */
+#define GEN_VOLUME1_LENGTH      0x40000                                   /* length of EFI volume with FD44 modules */
+#define GEN_VOLUME2_LENGTH      0x20000                                   /* length of EFI volume with MSOA module */
+#define GEN_ASUSBKP_TAIL        0x30000                                   /* offset of ASUSBKP block from the end of data */
+#define GEN_BOOTEFI_TAIL        0x10000                                   /* offset of BOOTEFI block from the end of data */
+#define GEN_FD44_DATA_LENGTH    0x1000                                    /* length of FD44 module data */
+#define GEN_FILLER_FILES        5                                         /* number of random files before FD44 modules */
+#define GEN_FRBA                0x40                                      /* offset of flash region base addresses */
+#define GEN_VOLUME_HEADER_LENGTH 0x48                                     /* volume header with one block map entry and terminator */
+
+/* FFS file and section types */
+#define GEN_FILETYPE_FREEFORM   0x02
+#define GEN_FILETYPE_DRIVER     0x07
+#define GEN_SECTION_RAW         0x19
+#define GEN_FILE_STATE          0xF8                                      /* header and data valid, erase polarity 1 */
+#define GEN_FILE_CHECKSUM       0xAA                                      /* file checksum of files without checksum attribute */
+#define GEN_VOLUME_ATTRIBUTES   0x0004FEFF                                /* attributes of AMI volumes, erase polarity 1 */
+
+/* Returns next value of xorshift generator */
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/* Fills data with random bytes */
+static void fill_random(uint8_t* data, uint32_t length, uint32_t* state)
+{
+    uint32_t i;
+    for (i = 0; i < length; i++)
+        data[i] = (uint8_t)(next_random(state) >> 24);
+}
+
+/* Stores 24-bit little-endian value */
+static void put_size(uint8_t* size, uint32_t value)
+{
+    size[0] = (uint8_t)value;
+    size[1] = (uint8_t)(value >> 8);
+    size[2] = (uint8_t)(value >> 16);
+}
+
+/* Writes FFS file with one raw section holding tag and body, any of them can be NULL to be filled randomly.
+ * Returns file size */
+static uint32_t put_file(uint8_t* file, const uint8_t* guid, uint8_t type, const uint8_t* tag, uint32_t tagLength,
+                         const uint8_t* body, uint32_t bodyLength, uint32_t* random)
+{
+    EFI_FFS_FILE_HEADER* header = (EFI_FFS_FILE_HEADER*)file;
+    uint8_t* section = file + sizeof(EFI_FFS_FILE_HEADER);
+    uint32_t size = (uint32_t)sizeof(EFI_FFS_FILE_HEADER) + 4 + tagLength + bodyLength;
+    uint8_t sum = 0;
+    uint32_t i;
+
+    memcpy(header->Name, guid, sizeof(header->Name));
+    header->HeaderChecksum = 0;
+    header->FileChecksum = 0;
+    header->Type = type;
+    header->Attributes = 0;
+    put_size(header->Size, size);
+    header->State = 0;
+
+    /* Header checksum covers the header without file checksum and state */
+    for (i = 0; i < sizeof(EFI_FFS_FILE_HEADER); i++)
+        sum += file[i];
+    header->HeaderChecksum = (uint8_t)(0x100 - sum);
+    header->FileChecksum = GEN_FILE_CHECKSUM;
+    header->State = GEN_FILE_STATE;
+
+    put_size(section, 4 + tagLength + bodyLength);
+    section[3] = GEN_SECTION_RAW;
+    if (tag)
+        memcpy(section + 4, tag, tagLength);
+    if (body)
+        memcpy(section + 4 + tagLength, body, bodyLength);
+    else
+        fill_random(section + 4 + tagLength, bodyLength, random);
+    return size;
+}
+
+/* Writes SLIC module made of its header, the first fixed part and random key data.
+ * Returns module size */
+static uint32_t put_slic_module(uint8_t* module, const uint8_t* header, const uint8_t* part1, uint32_t length, uint32_t* random)
+{
+    uint8_t sum = 0;
+    uint32_t i;
+
+    memcpy(module, header, 16);
+    memcpy(module + 16, part1, 12);
+    fill_random(module + 28, length - 28, random);
+    module[MODULE_DATA_CHECKSUM_OFFSET] = 0;
+    for (i = MODULE_DATA_CHECKSUM_START; i < length; i++)
+        sum += module[i];
+    module[MODULE_DATA_CHECKSUM_OFFSET] = (uint8_t)(0x100 - sum);
+    return length;
+}
+
+/* Writes EFI volume header, volume space must be erased already. FvLength field holds stored instead of length */
+static void put_volume(uint8_t* volume, uint32_t length, uint32_t stored)
+{
+    EFI_FIRMWARE_VOLUME_HEADER* header = (EFI_FIRMWARE_VOLUME_HEADER*)volume;
+    uint16_t sum = 0;
+    uint32_t i;
+
+    memset(volume, 0, GEN_VOLUME_HEADER_LENGTH);
+    memcpy(header->FileSystemGuid, EFI_FFS_V2_GUID, sizeof(header->FileSystemGuid));
+    header->FvLength = stored;
+    memcpy(&header->Signature, EFI_FVH_SIGNATURE, sizeof(EFI_FVH_SIGNATURE));
+    header->Attributes = GEN_VOLUME_ATTRIBUTES;
+    header->HeaderLength = GEN_VOLUME_HEADER_LENGTH;
+    header->Revision = 2;
+
+    /* One block map entry of 4K blocks followed by zero terminator */
+    volume[sizeof(EFI_FIRMWARE_VOLUME_HEADER) + 0] = (uint8_t)(length >> 12);
+    volume[sizeof(EFI_FIRMWARE_VOLUME_HEADER) + 1] = (uint8_t)(length >> 20);
+    volume[sizeof(EFI_FIRMWARE_VOLUME_HEADER) + 5] = 0x10;
+
+    /* Header checksum makes 16-bit sum of the header zero */
+    for (i = 0; i < GEN_VOLUME_HEADER_LENGTH; i += 2)
+        sum = (uint16_t)(sum + (volume[i] | (volume[i + 1] << 8)));
+    header->Checksum = (uint16_t)(0x10000 - sum);
+}
+
+/* Returns offset aligned to FFS file alignment */
+static uint32_t align_file(uint32_t offset)
+{
+    return (offset + EFI_FFS_ALIGNMENT - 1) & ~(uint32_t)(EFI_FFS_ALIGNMENT - 1);
+}
+
+/* Writes Intel flash descriptor with BIOS region covering data from GEN_BIOS_OFFSET and GbE region covering all banks */
+static void put_descriptor(uint8_t* data, uint32_t size, uint32_t gbeBanks)
+{
+    uint32_t regions[4];
+    uint32_t i;
+
+    memcpy(data + FLASH_DESCRIPTOR_SIGNATURE_OFFSET, FLASH_DESCRIPTOR_SIGNATURE, sizeof(FLASH_DESCRIPTOR_SIGNATURE));
+
+    /* FLMAP0 holds component base, number of components, region base and number of regions */
+    data[FLASH_DESCRIPTOR_FLMAP0_OFFSET + 0] = 0x03;
+    data[FLASH_DESCRIPTOR_FLMAP0_OFFSET + 1] = 0x00;
+    data[FLASH_DESCRIPTOR_FLMAP0_OFFSET + 2] = GEN_FRBA >> 4;
+    data[FLASH_DESCRIPTOR_FLMAP0_OFFSET + 3] = 0x03;
+
+    /* Region limits are inclusive and stored in 4K units, unused regions have base above limit */
+    regions[FLASH_REGION_DESCRIPTOR] = 0;
+    regions[FLASH_REGION_BIOS] = (GEN_BIOS_OFFSET >> 12) | (((size - 1) >> 12) << 16);
+    regions[FLASH_REGION_ME] = FLASH_REGION_MASK;
+    regions[FLASH_REGION_GBE] = gbeBanks ? (GEN_GBE_OFFSET >> 12) | (((GEN_GBE_OFFSET + gbeBanks * GEN_GBE_BANK_LENGTH - 1) >> 12) << 16)
+                                         : FLASH_REGION_MASK;
+    for (i = 0; i < 4; i++)
+    {
+        data[GEN_FRBA + i * 4 + 0] = (uint8_t)regions[i];
+        data[GEN_FRBA + i * 4 + 1] = (uint8_t)(regions[i] >> 8);
+        data[GEN_FRBA + i * 4 + 2] = (uint8_t)(regions[i] >> 16);
+        data[GEN_FRBA + i * 4 + 3] = (uint8_t)(regions[i] >> 24);
+    }
+}
+
+/* Sets options of stock output file: two stub GbE banks, one empty BSA_ FD44 module and DummyMSOA without SLIC */
+void imagegen_defaults(IMAGEGEN_OPTIONS* options)
+{
+    memset(options, 0, sizeof(IMAGEGEN_OPTIONS));
+    options->size = 0x800000;
+    options->motherboardName = "P8Z77-V";
+    options->nameTail = -1;
+    options->gbeBanks = GBE_BANK_COUNT;
+    memcpy(options->gbeMac, GBE_MAC_STUB, sizeof(GBE_MAC_STUB));
+    options->fd44Modules = 1;
+    options->fd44Empty = 1;
+    options->fd44Bsa = 1;
+    options->msoa = IMAGEGEN_MSOA_DUMMY;
+    options->seed = 1;
+}
+
+/* Builds BIOS image, space not used by generated structures is filled with random bytes like compressed code.
+ * Returns allocated image and stores its size to *size on success, or NULL on invalid options or memory error */
+uint8_t* imagegen_build(const IMAGEGEN_OPTIONS* options, uint32_t* size)
+{
+    static const uint8_t OTHER_TAG[] = {'B', 'S', 'B', '_'};
+    uint8_t* image;
+    uint8_t* data;
+    uint8_t* volume;
+    uint8_t guid[16];
+    uint8_t tag[8];
+    uint8_t* module;
+    uint32_t header;
+    uint32_t random;
+    uint32_t offset;
+    uint32_t i;
+
+    if (!options || !size || options->size < IMAGEGEN_MIN_SIZE || options->size & 0xFFF || options->size > 0x7FFFF000
+        || options->gbeBanks > GBE_BANK_COUNT || options->msoa > IMAGEGEN_MSOA
+        || options->fd44Modules * (sizeof(EFI_FFS_FILE_HEADER) + 12 + GEN_FD44_DATA_LENGTH + EFI_FFS_ALIGNMENT) > GEN_VOLUME1_LENGTH / 2)
+        return NULL;
+
+    header = options->capsule ? IMAGEGEN_CAPSULE_SIZE : 0;
+    random = options->seed * 2654435761u | 1;
+    image = (uint8_t*)malloc(header + options->size);
+    if (!image)
+        return NULL;
+    data = image + header;
+    memset(data, 0xFF, options->size);
+
+    /* Aptio capsule header */
+    if (options->capsule)
+    {
+        APTIO_CAPSULE_HEADER* capsule = (APTIO_CAPSULE_HEADER*)image;
+        memset(image, 0, IMAGEGEN_CAPSULE_SIZE);
+        memcpy(capsule->CapsuleGuid, APTIO_CAPSULE_GUID, sizeof(APTIO_CAPSULE_GUID));
+        capsule->HeaderSize = IMAGEGEN_CAPSULE_SIZE;
+        capsule->CapsuleImageSize = IMAGEGEN_CAPSULE_SIZE + options->size;
+        capsule->RomImageOffset = IMAGEGEN_CAPSULE_SIZE;
+    }
+
+    /* Flash descriptor and GbE banks */
+    if (options->descriptor)
+        put_descriptor(data, options->size, options->gbeBanks);
+    for (i = 0; i < options->gbeBanks; i++)
+    {
+        uint8_t* bank = data + GEN_GBE_OFFSET + i * GEN_GBE_BANK_LENGTH;
+        memset(bank, 0, -GBE_MAC_OFFSET);
+        memcpy(bank, options->gbeMac, GBE_MAC_LENGTH);
+        memcpy(bank - GBE_MAC_OFFSET, GBE_HEADER, sizeof(GBE_HEADER));
+        fill_random(bank - GBE_MAC_OFFSET + sizeof(GBE_HEADER), GEN_GBE_DATA_LENGTH + GBE_MAC_OFFSET - sizeof(GBE_HEADER), &random);
+    }
+
+    /* The first EFI volume with random driver files followed by FD44 modules */
+    volume = data + GEN_BIOS_OFFSET;
+    put_volume(volume, GEN_VOLUME1_LENGTH, GEN_VOLUME1_LENGTH);
+    offset = GEN_VOLUME_HEADER_LENGTH;
+    for (i = 0; i < GEN_FILLER_FILES; i++)
+    {
+        fill_random(guid, sizeof(guid), &random);
+        offset = align_file(offset + put_file(volume + offset, guid, GEN_FILETYPE_DRIVER, NULL, 0, NULL, 100 + next_random(&random) % 3000, &random));
+    }
+    memcpy(tag, options->fd44Bsa ? FD44_MODULE_HEADER_BSA : OTHER_TAG, 4);
+    memset(tag + 4, 0, 4);
+    for (i = 0; i < options->fd44Modules; i++)
+    {
+        module = volume + offset;
+        offset = align_file(offset + put_file(module, FD44_MODULE_HEADER, GEN_FILETYPE_FREEFORM, tag, sizeof(tag), NULL, GEN_FD44_DATA_LENGTH, &random));
+        if (options->fd44Empty)
+            memset(module + FD44_MODULE_HEADER_LENGTH, 0xFF, GEN_FD44_DATA_LENGTH);
+    }
+
+    /* The second EFI volume with MSOA module and SLIC modules after it */
+    volume += GEN_VOLUME1_LENGTH;
+    put_volume(volume, GEN_VOLUME2_LENGTH, options->volumeLength ? options->volumeLength : GEN_VOLUME2_LENGTH);
+    offset = GEN_VOLUME_HEADER_LENGTH;
+    fill_random(guid, sizeof(guid), &random);
+    offset = align_file(offset + put_file(volume + offset, guid, GEN_FILETYPE_DRIVER, NULL, 0, NULL, 2000, &random));
+    if (options->msoa != IMAGEGEN_MSOA_NONE)
+        offset = align_file(offset + put_file(volume + offset, options->msoa == IMAGEGEN_MSOA ? MSOA_MODULE_HEADER : DUMMY_MSOA_MODULE_HEADER,
+                                              GEN_FILETYPE_FREEFORM, NULL, 0, NULL, 64, &random));
+    if (options->slic)
+    {
+        offset = align_file(offset + put_slic_module(volume + offset, SLIC_PUBKEY_HEADER, SLIC_PUBKEY_PART1, SLIC_PUBKEY_LENGTH, &random));
+        put_slic_module(volume + offset, SLIC_MARKER_HEADER, SLIC_MARKER_PART1, SLIC_MARKER_LENGTH, &random);
+    }
+
+    /* Random filler standing for compressed code between volumes and ASUSBKP block */
+    offset = GEN_BIOS_OFFSET + GEN_VOLUME1_LENGTH + GEN_VOLUME2_LENGTH;
+    fill_random(data + offset, options->size - GEN_ASUSBKP_TAIL - offset, &random);
+
+    /* ASUSBKP block with SLIC pubkey and marker */
+    if (options->asusbkp)
+    {
+        uint8_t* asusbkp = data + options->size - GEN_ASUSBKP_TAIL;
+        memcpy(asusbkp, ASUSBKP_HEADER, sizeof(ASUSBKP_HEADER));
+        memcpy(asusbkp + 0x100, ASUSBKP_PUBKEY_HEADER, sizeof(ASUSBKP_PUBKEY_HEADER));
+        fill_random(asusbkp + 0x100 + sizeof(ASUSBKP_PUBKEY_HEADER), SLIC_PUBKEY_LENGTH - 28, &random);
+        memcpy(asusbkp + 0x300, ASUSBKP_MARKER_HEADER, sizeof(ASUSBKP_MARKER_HEADER));
+        fill_random(asusbkp + 0x300 + sizeof(ASUSBKP_MARKER_HEADER), SLIC_MARKER_LENGTH - 28, &random);
+    }
+
+    /* BOOTEFI block with motherboard name */
+    offset = options->size - GEN_BOOTEFI_TAIL;
+    memcpy(data + offset, BOOTEFI_HEADER, sizeof(BOOTEFI_HEADER));
+    memset(data + offset + BOOTEFI_MOTHERBOARD_NAME_OFFSET, 0, BOOTEFI_MOTHERBOARD_NAME_LENGTH);
+    if (options->motherboardName)
+        strncpy((char*)data + offset + BOOTEFI_MOTHERBOARD_NAME_OFFSET, options->motherboardName, BOOTEFI_MOTHERBOARD_NAME_LENGTH);
+    if (options->nameTail >= 0)
+        data[offset + BOOTEFI_MOTHERBOARD_NAME_OFFSET + BOOTEFI_MOTHERBOARD_NAME_LENGTH] = (uint8_t)options->nameTail;
+
+    *size = header + options->size;
+    return image;
+}
@@ -0,0 +1,44 @@
+#ifndef IMAGEGEN_H
+#define IMAGEGEN_H
+
+#include <stdint.h>
+#include "bios.h"
+
+/* Minimal size of generated BIOS data, all structures are placed in its first and last 0x80000 bytes */
+#define IMAGEGEN_MIN_SIZE           0x100000
+
+/* Size of generated Aptio capsule header */
+#define IMAGEGEN_CAPSULE_SIZE       0x800
+
+/* Module holding SLIC table in the second EFI volume */
+#define IMAGEGEN_MSOA_NONE          0
+#define IMAGEGEN_MSOA_DUMMY         1
+#define IMAGEGEN_MSOA               2
+
+/* Contents of synthetic BIOS image */
+typedef struct _IMAGEGEN_OPTIONS {
+    uint32_t    size;                                                     /* size of BIOS data without capsule header, multiple of 0x1000 */
+    const char* motherboardName;                                          /* motherboard name stored in BOOTEFI block */
+    int16_t     nameTail;                                                 /* byte following motherboard name field in BOOTEFI block, -1 leaves it erased */
+    uint32_t    gbeBanks;                                                 /* number of GbE banks, 0 to GBE_BANK_COUNT */
+    uint8_t     gbeMac[GBE_MAC_LENGTH];                                   /* MAC stored in GbE banks, GBE_MAC_STUB for stub banks */
+    int8_t      descriptor;                                               /* flag that Intel flash descriptor with GbE region is generated */
+    uint32_t    fd44Modules;                                              /* number of FD44 modules in the first EFI volume */
+    int8_t      fd44Empty;                                                /* flag that FD44 modules hold no data */
+    int8_t      fd44Bsa;                                                  /* flag that FD44 modules are BSA_ modules */
+    uint32_t    msoa;                                                     /* IMAGEGEN_MSOA_* module of the second EFI volume */
+    int8_t      slic;                                                     /* flag that SLIC pubkey and marker modules follow MSOA module */
+    int8_t      asusbkp;                                                  /* flag that ASUSBKP block with SLIC pubkey and marker is generated */
+    int8_t      capsule;                                                  /* flag that Aptio capsule header is prepended */
+    uint32_t    volumeLength;                                             /* length stored in the second EFI volume header, 0 for its real length */
+    uint32_t    seed;                                                     /* seed of random module contents and filler */
+} IMAGEGEN_OPTIONS;
+
+/* Sets options of stock output file: two stub GbE banks, one empty BSA_ FD44 module and DummyMSOA without SLIC */
+void imagegen_defaults(IMAGEGEN_OPTIONS* options);
+
+/* Builds BIOS image, space not used by generated structures is filled with random bytes like compressed code.
+ * Returns allocated image and stores its size to *size on success, or NULL on invalid options or memory error */
+uint8_t* imagegen_build(const IMAGEGEN_OPTIONS* options, uint32_t* size);
+
+#endif /* IMAGEGEN_H */
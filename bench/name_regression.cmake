@@ -0,0 +1,25 @@
+# Runs fd44cpr on generated images with 60-character motherboard name followed by different bytes, names must match.
+# Usage: cmake -DGEN_IMAGE=PATH -DFD44CPR=PATH -DWORK_DIR=DIR -P name_regression.cmake
+
+SET(NAME "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA")
+
+# Donor has erased byte after the name, output file has zero byte there
+EXECUTE_PROCESS(COMMAND ${GEN_IMAGE} --size=2 --fd44-data --name=${NAME} ${WORK_DIR}/name_donor.bin RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Donor image can't be generated.")
+ENDIF()
+EXECUTE_PROCESS(COMMAND ${GEN_IMAGE} --size=2 --name=${NAME} --name-tail=0 ${WORK_DIR}/name_target.bin RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Output image can't be generated.")
+ENDIF()
+
+# Input file loaded whole and as a list with the output file itself, whose name is compared with donor name
+EXECUTE_PROCESS(COMMAND ${FD44CPR} ${WORK_DIR}/name_donor.bin ${WORK_DIR}/name_target.bin OUTPUT_QUIET RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Patching image of the same motherboard failed: ${result}")
+ENDIF()
+EXECUTE_PROCESS(COMMAND ${FD44CPR} ${WORK_DIR}/name_donor.bin+${WORK_DIR}/name_target.bin ${WORK_DIR}/name_target.bin
+                OUTPUT_QUIET RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Patching image of the same motherboard from input file list failed: ${result}")
+ENDIF()
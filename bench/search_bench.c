@@ -0,0 +1,178 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "bios.h"
+#include "search.h"
+#include "matchers.h"
+
+#define DEFAULT_ITERATIONS 10
+
+/* Returns current wall clock time in seconds */
+static double now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Reads whole file to newly allocated buffer.
+ * Returns buffer on success or NULL on error */
+static uint8_t* read_file(const char* path, uint32_t* size)
+{
+    FILE* file;
+    uint8_t* buffer;
+
+    file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    buffer = (uint8_t*)malloc(*size ? *size : 1);
+    if (buffer && fread(buffer, 1, *size, file) != *size)
+    {
+        free(buffer);
+        buffer = NULL;
+    }
+    fclose(file);
+    return buffer;
+}
+
+/* Finds all occurrences of every bios.h signature using given kernel.
+ * Returns number of found occurrences and stores sum of their offsets to *digest */
+static uint32_t find_all(FIND_PATTERN_FUNC func, uint8_t* buffer, uint32_t size, uint64_t* digest)
+{
+    uint32_t sig;
+    uint32_t count = 0;
+
+    *digest = 0;
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        uint8_t* found = buffer;
+        while ((found = func(found, buffer + size, SIGNATURES[sig].pattern, SIGNATURES[sig].length)) != NULL)
+        {
+            *digest += (uint64_t)(found - buffer) * (sig + 1);
+            count++;
+            found++;
+        }
+    }
+    return count;
+}
+
+/* Finds all occurrences of every bios.h signature using matchers generated for them.
+ * Returns number of found occurrences and stores sum of their offsets to *digest */
+static uint32_t find_all_generated(uint8_t* buffer, uint32_t size, uint64_t* digest)
+{
+    uint32_t sig;
+    uint32_t count = 0;
+
+    *digest = 0;
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        uint8_t* found = buffer;
+        while ((found = MATCHERS[sig].find(found, buffer + size)) != NULL)
+        {
+            *digest += (uint64_t)(found - buffer) * (sig + 1);
+            count++;
+            found++;
+        }
+    }
+    return count;
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    int arg = 1;
+    int iterations = DEFAULT_ITERATIONS;
+    int result = 0;
+
+    if (argc > 1 && argv[1][0] == '-')
+    {
+        iterations = atoi(argv[1] + 1);
+        arg++;
+    }
+    if (arg >= argc || iterations <= 0)
+    {
+        printf("Usage: search_bench <-ITERATIONS> IMAGE...\n\n"
+               "Searches all bios.h signatures in every IMAGE with each search kernel\n"
+               "supported by current CPU and with generated matchers, and checks that all of them return the same results.\n");
+        return 2;
+    }
+
+    for (; arg < argc; arg++)
+    {
+        uint8_t* buffer;
+        uint32_t size;
+        uint32_t kernel;
+        uint32_t reference_count = 0;
+        uint64_t reference_digest = 0;
+
+        buffer = read_file(argv[arg], &size);
+        if (!buffer)
+        {
+            printf("Can't read %s.\n", argv[arg]);
+            result = 1;
+            continue;
+        }
+
+        printf("%s (%u bytes)\n", argv[arg], size);
+        for (kernel = 0; kernel < SEARCH_KERNEL_COUNT; kernel++)
+        {
+            FIND_PATTERN_FUNC func = search_kernel(kernel);
+            uint32_t count = 0;
+            uint64_t digest = 0;
+            double start, elapsed;
+            int i;
+
+            if (!func)
+            {
+                printf("  %-8s not supported\n", search_kernel_name(kernel));
+                continue;
+            }
+
+            start = now();
+            for (i = 0; i < iterations; i++)
+                count = find_all(func, buffer, size, &digest);
+            elapsed = (now() - start) / iterations;
+
+            if (kernel == SEARCH_KERNEL_SCALAR)
+            {
+                reference_count = count;
+                reference_digest = digest;
+            }
+
+            printf("  %-8s %9.3f ms %9.1f MB/s  %u hits%s\n", search_kernel_name(kernel), elapsed * 1000.0,
+                   (double)size * SIG_COUNT / elapsed / 1e6, count,
+                   (count == reference_count && digest == reference_digest) ? "" : "  MISMATCH");
+            if (count != reference_count || digest != reference_digest)
+                result = 1;
+        }
+
+        /* Generated matchers don't build skip tables at run time */
+        {
+            uint32_t count = 0;
+            uint64_t digest = 0;
+            double start, elapsed;
+            int i;
+
+            start = now();
+            for (i = 0; i < iterations; i++)
+                count = find_all_generated(buffer, size, &digest);
+            elapsed = (now() - start) / iterations;
+
+            printf("  %-8s %9.3f ms %9.1f MB/s  %u hits%s\n", "matchers", elapsed * 1000.0,
+                   (double)size * SIG_COUNT / elapsed / 1e6, count,
+                   (count == reference_count && digest == reference_digest) ? "" : "  MISMATCH");
+            if (count != reference_count || digest != reference_digest)
+                result = 1;
+        }
+        free(buffer);
+    }
+
+    return result;
+}
@@ -0,0 +1,24 @@
+# Runs fd44cpr in stream mode on generated images that crashed it before, every run must exit with a result code.
+# Usage: cmake -DGEN_IMAGE=PATH -DFD44CPR=PATH -DWORK_DIR=DIR -P stream_regression.cmake
+
+# Donor with FD44 data and output file whose second volume header claims almost 4 GB
+EXECUTE_PROCESS(COMMAND ${GEN_IMAGE} --size=2 --fd44-data ${WORK_DIR}/regression_donor.bin RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Donor image can't be generated.")
+ENDIF()
+EXECUTE_PROCESS(COMMAND ${GEN_IMAGE} --size=2 --volume-length=0xFFFFF800 ${WORK_DIR}/regression_volume.bin RESULT_VARIABLE result)
+IF(NOT result EQUAL 0)
+    MESSAGE(FATAL_ERROR "Corrupt image can't be generated.")
+ENDIF()
+
+# Corrupt image read from standard input as output file and as input file
+EXECUTE_PROCESS(COMMAND ${FD44CPR} -n ${WORK_DIR}/regression_donor.bin -
+                INPUT_FILE ${WORK_DIR}/regression_volume.bin OUTPUT_FILE ${WORK_DIR}/regression_out.bin RESULT_VARIABLE result)
+IF(NOT result MATCHES "^[0-9]+$" OR result GREATER 10)
+    MESSAGE(FATAL_ERROR "Patching corrupt image from standard input failed: ${result}")
+ENDIF()
+EXECUTE_PROCESS(COMMAND ${FD44CPR} --extract -n - ${WORK_DIR}/regression_bundle.bin
+                INPUT_FILE ${WORK_DIR}/regression_volume.bin OUTPUT_QUIET RESULT_VARIABLE result)
+IF(NOT result MATCHES "^[0-9]+$" OR result GREATER 10)
+    MESSAGE(FATAL_ERROR "Extracting corrupt image from standard input failed: ${result}")
+ENDIF()
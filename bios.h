@@ -13,52 +13,137 @@ typedef struct _APTIO_CAPSULE_HEADER {
                                                the capsule volume */
 } APTIO_CAPSULE_HEADER;
 
-const uint8_t APTIO_CAPSULE_GUID[] = { 0x8B, 0xA6, 0x3C, 0x4A, 0x23, 0x77, 0xFB, 0x48, 0x80, 0x3D, 0x57,
+static const uint8_t APTIO_CAPSULE_GUID[] = { 0x8B, 0xA6, 0x3C, 0x4A, 0x23, 0x77, 0xFB, 0x48, 0x80, 0x3D, 0x57,
                                              0x8C, 0xC1, 0xFE, 0xC4, 0x4D};
 
 /* BOOTEFI */
-const uint8_t BOOTEFI_HEADER[] = {'$','B','O','O','T','E','F','I','$'};
+static const uint8_t BOOTEFI_HEADER[] = {'$','B','O','O','T','E','F','I','$'};
 #define BOOTEFI_MOTHERBOARD_NAME_OFFSET 14
 #define BOOTEFI_MOTHERBOARD_NAME_LENGTH 60
 
 /* GbE */
-const uint8_t GBE_HEADER[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xC3, 0x10};
+static const uint8_t GBE_HEADER[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xC3, 0x10};
 #define GBE_MAC_OFFSET (-16)
 #define GBE_MAC_LENGTH 6
 static const uint8_t GBE_MAC_STUB[] = {0x88, 0x88, 0x88, 0x88, 0x87, 0x88};
+#define GBE_BANK_COUNT 2
+
+/* Intel flash descriptor */
+#define FLASH_DESCRIPTOR_LENGTH 0x1000
+#define FLASH_DESCRIPTOR_SIGNATURE_OFFSET 0x10
+static const uint8_t FLASH_DESCRIPTOR_SIGNATURE[] = {0x5A, 0xA5, 0xF0, 0x0F};
+#define FLASH_DESCRIPTOR_FLMAP0_OFFSET 0x14
+#define FLASH_REGION_MASK 0x7FFF
+#define FLASH_REGION_DESCRIPTOR 0
+#define FLASH_REGION_BIOS 1
+#define FLASH_REGION_ME 2
+#define FLASH_REGION_GBE 3
 
 /* SLIC */
-const uint8_t EFI_VOLUME_HEADER[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+static const uint8_t EFI_VOLUME_HEADER[] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
                                            0x00, 0x00, 0x00, 0x00, 0x00, 0x78, 0xE5, 0x8C, 0x8C, 0x3D, 0x8A, 
                                            0x1C, 0x4F, 0x99, 0x35, 0x89, 0x61, 0x85, 0xC3, 0x2D, 0xD3 };
-const uint8_t DUMMY_MSOA_MODULE_HEADER[] = {0x70, 0x8C, 0x49, 0xDE, 0xDA, 0x1E, 0x6B, 0x46, 0xAB, 0xCF, 0xDD, 0x3A,
+static const uint8_t DUMMY_MSOA_MODULE_HEADER[] = {0x70, 0x8C, 0x49, 0xDE, 0xDA, 0x1E, 0x6B, 0x46, 0xAB, 0xCF, 0xDD, 0x3A,
 	                                        0xBC, 0x3D, 0x24, 0xB4};
-const uint8_t MSOA_MODULE_HEADER[] = {0xB9, 0x2A, 0x90, 0xA1, 0x94, 0x53, 0xF2, 0x45, 0x85, 0x7A, 0x12, 
+static const uint8_t MSOA_MODULE_HEADER[] = {0xB9, 0x2A, 0x90, 0xA1, 0x94, 0x53, 0xF2, 0x45, 0x85, 0x7A, 0x12, 
                                             0x82, 0x42, 0x13, 0xEE, 0xFB};
-const uint8_t SLIC_PUBKEY_HEADER[] = {0xFB, 0xEB, 0xFF, 0xCD, 0xDC, 0x17, 0xBC, 0x46, 0x9B, 0x75, 0x59, 
+static const uint8_t SLIC_PUBKEY_HEADER[] = {0xFB, 0xEB, 0xFF, 0xCD, 0xDC, 0x17, 0xBC, 0x46, 0x9B, 0x75, 0x59, 
                                             0xB8, 0x61, 0x92, 0x09, 0x13};
-const uint8_t SLIC_PUBKEY_PART1[] = {0x78, 0x02, 0x02, 0x40, 0x6E, 0x01, 0x00, 0xF8, 0x56, 0x01, 0x00, 
+static const uint8_t SLIC_PUBKEY_PART1[] = {0x78, 0x02, 0x02, 0x40, 0x6E, 0x01, 0x00, 0xF8, 0x56, 0x01, 0x00, 
                                            0x19};
 #define SLIC_PUBKEY_LENGTH 366
-const uint8_t SLIC_MARKER_HEADER[] = {0x58, 0x44, 0x63, 0x15, 0xA4, 0xE8, 0x6D, 0x43, 0xAC, 0x2F, 0x57, 
+static const uint8_t SLIC_MARKER_HEADER[] = {0x58, 0x44, 0x63, 0x15, 0xA4, 0xE8, 0x6D, 0x43, 0xAC, 0x2F, 0x57, 
                                             0xE3, 0x3E, 0x53, 0x4C, 0xCF};
-const uint8_t SLIC_MARKER_PART1[] = {0x75, 0x4E, 0x02, 0x40, 0x38, 0x00, 0x00, 0xF8, 0x20, 0x00, 0x00, 
+static const uint8_t SLIC_MARKER_PART1[] = {0x75, 0x4E, 0x02, 0x40, 0x38, 0x00, 0x00, 0xF8, 0x20, 0x00, 0x00, 
                                            0x19};
 #define SLIC_MARKER_LENGTH 56
 #define MODULE_DATA_CHECKSUM_OFFSET 17
 #define MODULE_DATA_CHECKSUM_START  24
 
 /* FD44 */
-const uint8_t FD44_MODULE_HEADER[] = {0x0B, 0x82, 0x44, 0xFD, 0xAB, 0xF1, 0xC0, 0x41, 0xAE, 0x4E, 0x0C, 
+static const uint8_t FD44_MODULE_HEADER[] = {0x0B, 0x82, 0x44, 0xFD, 0xAB, 0xF1, 0xC0, 0x41, 0xAE, 0x4E, 0x0C, 
                                             0x55, 0x55, 0x6E, 0xB9, 0xBD};
 #define FD44_MODULE_HEADER_BSA_OFFSET 28
-const uint8_t FD44_MODULE_HEADER_BSA[] = {'B', 'S', 'A', '_'};
+static const uint8_t FD44_MODULE_HEADER_BSA[] = {'B', 'S', 'A', '_'};
 #define FD44_MODULE_HEADER_LENGTH 36
 #define FD44_MODULE_SIZE_OFFSET 20
 
 /* ASUSBKP */
-const uint8_t ASUSBKP_HEADER[] = {'A','S','U','S','B','K','P','$'};
-const uint8_t ASUSBKP_PUBKEY_HEADER[] = {'S','2','L','P','R', 0x01, 0x00, 0x00};
-const uint8_t ASUSBKP_MARKER_HEADER[] = {'K','E','Y','S', 0x1C, 0x00, 0x00, 0x00};
+static const uint8_t ASUSBKP_HEADER[] = {'A','S','U','S','B','K','P','$'};
+static const uint8_t ASUSBKP_PUBKEY_HEADER[] = {'S','2','L','P','R', 0x01, 0x00, 0x00};
+static const uint8_t ASUSBKP_MARKER_HEADER[] = {'K','E','Y','S', 0x1C, 0x00, 0x00, 0x00};
+
+/* EFI firmware volume */
+typedef struct _EFI_FIRMWARE_VOLUME_HEADER {
+    uint8_t   ZeroVector[16];
+    uint8_t   FileSystemGuid[16];
+    uint64_t  FvLength;
+    uint32_t  Signature;
+    uint32_t  Attributes;
+    uint16_t  HeaderLength;
+    uint16_t  Checksum;
+    uint16_t  ExtHeaderOffset;
+    uint8_t   Reserved;
+    uint8_t   Revision;
+} EFI_FIRMWARE_VOLUME_HEADER;
+#define EFI_FVH_SIGNATURE_OFFSET 40
+static const uint8_t EFI_FVH_SIGNATURE[] = {'_','F','V','H'};
+#define EFI_FVB_ERASE_POLARITY 0x00000800
+#define EFI_FIRMWARE_VOLUME_EXT_HEADER_SIZE_OFFSET 16
+static const uint8_t EFI_FFS_V2_GUID[] = {0x78, 0xE5, 0x8C, 0x8C, 0x3D, 0x8A, 0x1C, 0x4F, 0x99, 0x35, 0x89, 0x61, 0x85, 0xC3, 0x2D, 0xD3};
+static const uint8_t EFI_FFS_V3_GUID[] = {0x7A, 0xC0, 0x73, 0x54, 0xCB, 0x3D, 0xCA, 0x4D, 0xBD, 0x6F, 0x1E, 0x96, 0x89, 0xE7, 0x34, 0x9A};
+
+/* EFI FFS file */
+typedef struct _EFI_FFS_FILE_HEADER {
+    uint8_t   Name[16];
+    uint8_t   HeaderChecksum;
+    uint8_t   FileChecksum;
+    uint8_t   Type;
+    uint8_t   Attributes;
+    uint8_t   Size[3];
+    uint8_t   State;
+} EFI_FFS_FILE_HEADER;
+#define EFI_FFS_FILE_HEADER2_LENGTH 32	/* FFSv3 large file header, followed by 64-bit ExtendedSize */
+#define EFI_FFS_ATTRIB_LARGE_FILE 0x01
+#define EFI_FFS_ATTRIB_CHECKSUM 0x40
+#define EFI_FFS_FIXED_CHECKSUM 0xAA	/* file checksum of files without EFI_FFS_ATTRIB_CHECKSUM */
+#define EFI_FFS_FIXED_CHECKSUM_V1 0x5A	/* the same for files made by older Framework tools */
+#define EFI_FFS_ALIGNMENT 8
+#define EFI_FV_FILETYPE_PAD 0xF0
+
+/* Signature table used by the multi-pattern scanner */
+typedef struct _SIGNATURE {
+    const uint8_t* pattern;
+    uint32_t       length;
+} SIGNATURE;
+
+enum {
+    SIG_BOOTEFI = 0,
+    SIG_GBE,
+    SIG_EFI_VOLUME,
+    SIG_DUMMY_MSOA_MODULE,
+    SIG_MSOA_MODULE,
+    SIG_SLIC_PUBKEY,
+    SIG_SLIC_MARKER,
+    SIG_FD44_MODULE,
+    SIG_ASUSBKP,
+    SIG_ASUSBKP_PUBKEY,
+    SIG_ASUSBKP_MARKER,
+    SIG_COUNT
+};
+
+static const SIGNATURE SIGNATURES[SIG_COUNT] = {
+    { BOOTEFI_HEADER,           sizeof(BOOTEFI_HEADER) },
+    { GBE_HEADER,               sizeof(GBE_HEADER) },
+    { EFI_VOLUME_HEADER,        sizeof(EFI_VOLUME_HEADER) },
+    { DUMMY_MSOA_MODULE_HEADER, sizeof(DUMMY_MSOA_MODULE_HEADER) },
+    { MSOA_MODULE_HEADER,       sizeof(MSOA_MODULE_HEADER) },
+    { SLIC_PUBKEY_HEADER,       sizeof(SLIC_PUBKEY_HEADER) },
+    { SLIC_MARKER_HEADER,       sizeof(SLIC_MARKER_HEADER) },
+    { FD44_MODULE_HEADER,       sizeof(FD44_MODULE_HEADER) },
+    { ASUSBKP_HEADER,           sizeof(ASUSBKP_HEADER) },
+    { ASUSBKP_PUBKEY_HEADER,    sizeof(ASUSBKP_PUBKEY_HEADER) },
+    { ASUSBKP_MARKER_HEADER,    sizeof(ASUSBKP_MARKER_HEADER) }
+};
 
 #endif /* BIOS_H */
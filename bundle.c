@@ -0,0 +1,166 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fd44.h"
+#include "bundle.h"
+#include "hash.h"
+
+/* Checks if file is a donor bundle.
+ * Returns 1 if it is and 0 if it isn't or can't be read */
+int fd44_is_bundle(const char* path)
+{
+    FILE* file;
+    uint8_t signature[sizeof(FD44_BUNDLE_SIGNATURE)];
+    int result;
+
+    file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    result = fread(signature, sizeof(char), sizeof(signature), file) == sizeof(signature)
+             && !memcmp(signature, FD44_BUNDLE_SIGNATURE, sizeof(FD44_BUNDLE_SIGNATURE));
+    fclose(file);
+    return result;
+}
+
+/* Writes donor data to bundle file, which can be loaded by fd44_bundle_load instead of extracting it from input file again.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_bundle_save(const FD44_DONOR* donor, const char* path, FD44_LOG* log)
+{
+    FD44_BUNDLE_HEADER header;
+    FILE* file;
+
+    if (!donor || !path)
+        return FD44_ERR_ARGS;
+
+    /* Filling header */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Signature, FD44_BUNDLE_SIGNATURE, sizeof(header.Signature));
+    header.Version = FD44_BUNDLE_VERSION;
+    memcpy(header.MotherboardName, donor->motherboardName, sizeof(header.MotherboardName));
+    if (donor->hasGbe)
+    {
+        header.Flags |= FD44_BUNDLE_HAS_GBE;
+        memcpy(header.GbeMac, donor->gbeMac, sizeof(header.GbeMac));
+    }
+    if (donor->hasSLIC)
+    {
+        header.Flags |= FD44_BUNDLE_HAS_SLIC;
+        memcpy(header.SlicPubkey, donor->slicPubkey, sizeof(header.SlicPubkey));
+        memcpy(header.SlicMarker, donor->slicMarker, sizeof(header.SlicMarker));
+    }
+    if (donor->isModuleEmpty)
+        header.Flags |= FD44_BUNDLE_HAS_MODULE | FD44_BUNDLE_MODULE_EMPTY;
+    else if (donor->fd44Module)
+    {
+        header.Flags |= FD44_BUNDLE_HAS_MODULE;
+        header.ModuleSize = donor->fd44ModuleSize;
+        header.ModuleCrc32 = hash_crc32(0, donor->fd44Module, donor->fd44ModuleSize);
+    }
+    header.HeaderCrc32 = hash_crc32(0, &header, (uint32_t)(sizeof(header) - sizeof(header.HeaderCrc32)));
+
+    /* Writing header and module data */
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        fd44_log_perror(log, "Can't open bundle file.\n");
+        return FD44_ERR_OUTPUT_FILE;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1
+        || (header.ModuleSize && fwrite(donor->fd44Module, sizeof(char), header.ModuleSize, file) != header.ModuleSize))
+    {
+        fd44_log_perror(log, "Can't write bundle file.\n");
+        fclose(file);
+        return FD44_ERR_OUTPUT_FILE;
+    }
+    if (fclose(file))
+    {
+        fd44_log_perror(log, "Can't write bundle file.\n");
+        return FD44_ERR_OUTPUT_FILE;
+    }
+
+    return FD44_OK;
+}
+
+/* Loads donor data from bundle file and verifies its checksums.
+ * Returns FD44_OK on success or FD44_ERR_* code on error. Donor must be freed by fd44_donor_free in both cases */
+int fd44_bundle_load(FD44_DONOR* donor, const char* path, FD44_LOG* log)
+{
+    FD44_BUNDLE_HEADER header;
+    FILE* file;
+    long size;
+
+    if (!donor || !path)
+        return FD44_ERR_ARGS;
+    memset(donor, 0, sizeof(FD44_DONOR));
+
+    /* Reading and checking header */
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        fd44_log_perror(log, "Can't open input file.\n");
+        return FD44_ERR_INPUT_FILE;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < (long)sizeof(header) || fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.Signature, FD44_BUNDLE_SIGNATURE, sizeof(header.Signature)))
+    {
+        fd44_log_printf(log, "Bundle file is truncated.\n");
+        fclose(file);
+        return FD44_ERR_INPUT_FILE;
+    }
+    if (header.Version != FD44_BUNDLE_VERSION)
+    {
+        fd44_log_printf(log, "Bundle file version %u is not supported.\n", header.Version);
+        fclose(file);
+        return FD44_ERR_INPUT_FILE;
+    }
+    if (header.HeaderCrc32 != hash_crc32(0, &header, (uint32_t)(sizeof(header) - sizeof(header.HeaderCrc32)))
+        || (uint64_t)size != sizeof(header) + (uint64_t)header.ModuleSize
+        || (header.ModuleSize != 0) != ((header.Flags & (FD44_BUNDLE_HAS_MODULE | FD44_BUNDLE_MODULE_EMPTY)) == FD44_BUNDLE_HAS_MODULE))
+    {
+        fd44_log_printf(log, "Bundle file is corrupted.\n");
+        fclose(file);
+        return FD44_ERR_INPUT_FILE;
+    }
+
+    /* Reading and checking module data */
+    if (header.ModuleSize)
+    {
+        donor->fd44Module = (uint8_t*)malloc(header.ModuleSize);
+        if (!donor->fd44Module)
+        {
+            fd44_log_printf(log, "Can't allocate memory for FD44 module.\nFD44 module can't be copied.\n");
+            fclose(file);
+            return FD44_ERR_MEMORY;
+        }
+        if (fread(donor->fd44Module, sizeof(char), header.ModuleSize, file) != header.ModuleSize
+            || header.ModuleCrc32 != hash_crc32(0, donor->fd44Module, header.ModuleSize))
+        {
+            fd44_log_printf(log, "Bundle file is corrupted.\n");
+            fclose(file);
+            return FD44_ERR_INPUT_FILE;
+        }
+        donor->fd44ModuleSize = header.ModuleSize;
+    }
+    fclose(file);
+
+    /* Filling donor data */
+    memcpy(donor->motherboardName, header.MotherboardName, sizeof(header.MotherboardName));
+    donor->motherboardName[sizeof(header.MotherboardName)] = '\0';
+    donor->hasGbe = (header.Flags & FD44_BUNDLE_HAS_GBE) != 0;
+    if (donor->hasGbe)
+        memcpy(donor->gbeMac, header.GbeMac, sizeof(donor->gbeMac));
+    donor->hasSLIC = (header.Flags & FD44_BUNDLE_HAS_SLIC) != 0;
+    if (donor->hasSLIC)
+    {
+        memcpy(donor->slicPubkey, header.SlicPubkey, sizeof(donor->slicPubkey));
+        memcpy(donor->slicMarker, header.SlicMarker, sizeof(donor->slicMarker));
+    }
+    donor->isModuleEmpty = (header.Flags & FD44_BUNDLE_MODULE_EMPTY) != 0;
+
+    return FD44_OK;
+}
@@ -0,0 +1,43 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <stdint.h>
+#include "bios.h"
+
+/* Donor bundle file format.
+ * Bundle is a small file holding only data extracted from input file,
+ * it is applied to output files instead of the input file itself.
+ * All fields are little-endian, header is followed by ModuleSize bytes of FD44 module data */
+
+/* Bundle signature */
+static const uint8_t FD44_BUNDLE_SIGNATURE[] = {'F','D','4','4','B','N','D','L'};
+
+/* Current bundle format version */
+#define FD44_BUNDLE_VERSION             1
+
+/* Bundle flags */
+#define FD44_BUNDLE_HAS_GBE             0x0001  /* GbeMac is valid */
+#define FD44_BUNDLE_HAS_SLIC            0x0002  /* SlicPubkey and SlicMarker are valid */
+#define FD44_BUNDLE_HAS_MODULE          0x0004  /* FD44 module was extracted */
+#define FD44_BUNDLE_MODULE_EMPTY        0x0008  /* all FD44 modules of input file are empty, there is no module data */
+
+#pragma pack(push, 1)
+typedef struct _FD44_BUNDLE_HEADER {
+    uint8_t  Signature[sizeof(FD44_BUNDLE_SIGNATURE)];                    /* FD44_BUNDLE_SIGNATURE */
+    uint16_t Version;                                                     /* FD44_BUNDLE_VERSION */
+    uint16_t Flags;                                                       /* FD44_BUNDLE_* flags */
+    uint32_t ModuleSize;                                                  /* size of FD44 module data after header */
+    uint8_t  MotherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH];            /* motherboard name, zero padded */
+    uint8_t  GbeMac[GBE_MAC_LENGTH];                                      /* GbE MAC address */
+    uint8_t  SlicPubkey[SLIC_PUBKEY_LENGTH
+                        - sizeof(SLIC_PUBKEY_HEADER)
+                        - sizeof(SLIC_PUBKEY_PART1)];                     /* SLIC pubkey */
+    uint8_t  SlicMarker[SLIC_MARKER_LENGTH
+                        - sizeof(SLIC_MARKER_HEADER)
+                        - sizeof(SLIC_MARKER_PART1)];                     /* SLIC marker */
+    uint32_t ModuleCrc32;                                                 /* CRC-32 of FD44 module data */
+    uint32_t HeaderCrc32;                                                 /* CRC-32 of all header fields before this one */
+} FD44_BUNDLE_HEADER;
+#pragma pack(pop)
+
+#endif /* BUNDLE_H */
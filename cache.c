@@ -0,0 +1,234 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cache.h"
+#include "hash.h"
+#include "image.h"
+#include "bios.h"
+#include "matchers.h"
+
+/* Builds path of cache file for BIOS data of given size and XXH64.
+ * Returns allocated path or NULL on failure */
+static char* cache_path(const char* directory, uint32_t size, uint64_t hash)
+{
+    char name[64];
+    char* path;
+
+    sprintf(name, "/%08X%08X-%08X" FD44_CACHE_EXTENSION, (uint32_t)(hash >> 32), (uint32_t)hash, size);
+    path = (char*)malloc(strlen(directory) + strlen(name) + 1);
+    if (!path)
+        return NULL;
+    strcpy(path, directory);
+    strcat(path, name);
+    return path;
+}
+
+/* Calculates CRC-32 of signature table, cache files made with another table are not used */
+static uint32_t signatures_crc32(void)
+{
+    uint32_t crc = 0;
+    uint32_t sig;
+
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        crc = hash_crc32(crc, &SIGNATURES[sig].length, sizeof(SIGNATURES[sig].length));
+        crc = hash_crc32(crc, SIGNATURES[sig].pattern, SIGNATURES[sig].length);
+    }
+    return crc;
+}
+
+/* Loads signatures and volumes of BIOS data with given XXH64 from cache directory.
+ * Returns 1 on success and 0 if there is no valid cache file, hits and index are empty in that case */
+int cache_load(const char* directory, const uint8_t* buffer, uint32_t size, uint64_t hash, SCAN_RESULT* hits, FFS_INDEX* index)
+{
+    FD44_CACHE_HEADER header;
+    const FD44_CACHE_HIT* cachedHits;
+    const FD44_CACHE_VOLUME* cachedVolumes;
+    const FD44_CACHE_FILE* cachedFiles;
+    uint8_t* body;
+    uint64_t bodySize;
+    FILE* file;
+    char* path;
+    uint32_t i;
+
+    if (!directory || !buffer || !hits || !index)
+        return 0;
+    memset(hits, 0, sizeof(SCAN_RESULT));
+    memset(index, 0, sizeof(FFS_INDEX));
+
+    path = cache_path(directory, size, hash);
+    if (!path)
+        return 0;
+    file = fopen(path, "rb");
+    free(path);
+    if (!file)
+        return 0;
+
+    /* Checking that cache file is made for the same data and the same signatures */
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.Signature, FD44_CACHE_SIGNATURE, sizeof(FD44_CACHE_SIGNATURE))
+        || header.Version != FD44_CACHE_VERSION
+        || header.HeaderCrc32 != hash_crc32(0, &header, (uint32_t)(sizeof(header) - sizeof(header.HeaderCrc32)))
+        || header.DataSize != size || header.DataHash != hash
+        || header.SignaturesCrc32 != signatures_crc32()
+        || header.HitCount > size || header.VolumeCount > size || header.FileCount > size)
+    {
+        fclose(file);
+        return 0;
+    }
+
+    /* Reading body */
+    bodySize = (uint64_t)header.HitCount * sizeof(FD44_CACHE_HIT)
+             + (uint64_t)header.VolumeCount * sizeof(FD44_CACHE_VOLUME)
+             + (uint64_t)header.FileCount * sizeof(FD44_CACHE_FILE);
+    body = bodySize <= 0x7FFFFFFF ? (uint8_t*)malloc((size_t)bodySize + 1) : NULL;
+    if (!body || fread(body, 1, (size_t)bodySize, file) != bodySize
+        || hash_crc32(0, body, (uint32_t)bodySize) != header.BodyCrc32)
+    {
+        free(body);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    cachedHits = (const FD44_CACHE_HIT*)body;
+    cachedVolumes = (const FD44_CACHE_VOLUME*)(cachedHits + header.HitCount);
+    cachedFiles = (const FD44_CACHE_FILE*)(cachedVolumes + header.VolumeCount);
+
+    hits->hits = (SCAN_HIT*)malloc((header.HitCount ? header.HitCount : 1) * sizeof(SCAN_HIT));
+    index->volumes = (FFS_VOLUME*)malloc((header.VolumeCount ? header.VolumeCount : 1) * sizeof(FFS_VOLUME));
+    index->files = (FFS_FILE*)malloc((header.FileCount ? header.FileCount : 1) * sizeof(FFS_FILE));
+    if (!hits->hits || !index->volumes || !index->files)
+        goto invalid;
+    hits->capacity = header.HitCount;
+    index->volumeCapacity = header.VolumeCount;
+    index->fileCapacity = header.FileCount;
+
+    /* Every hit must point to its signature in data, so hash collision can't lead to patching wrong bytes */
+    for (i = 0; i < header.HitCount; i++)
+    {
+        uint32_t offset = cachedHits[i].Offset;
+        uint32_t signature = cachedHits[i].Signature;
+        if (signature >= SIG_COUNT || SIGNATURES[signature].length > size || offset > size - SIGNATURES[signature].length
+            || (i && offset < cachedHits[i - 1].Offset)
+            || !MATCHERS[signature].match(buffer + offset))
+            goto invalid;
+        hits->hits[i].offset = offset;
+        hits->hits[i].signature = signature;
+    }
+    hits->count = header.HitCount;
+
+    for (i = 0; i < header.VolumeCount; i++)
+    {
+        const FD44_CACHE_VOLUME* cached = &cachedVolumes[i];
+        if (cached->Offset > size || cached->Length > size - cached->Offset
+            || cached->FirstFile > header.FileCount || cached->FileCount > header.FileCount - cached->FirstFile
+            || cached->FreeOffset < cached->Offset || cached->FreeOffset > cached->Offset + cached->Length)
+            goto invalid;
+        index->volumes[i].offset = cached->Offset;
+        index->volumes[i].length = cached->Length;
+        index->volumes[i].firstFile = cached->FirstFile;
+        index->volumes[i].fileCount = cached->FileCount;
+        index->volumes[i].freeOffset = cached->FreeOffset;
+        index->volumes[i].isFfs = cached->IsFfs;
+        index->volumes[i].erasePolarity = cached->ErasePolarity;
+    }
+    index->volumeCount = header.VolumeCount;
+
+    for (i = 0; i < header.FileCount; i++)
+    {
+        const FD44_CACHE_FILE* cached = &cachedFiles[i];
+        if (cached->Offset > size || cached->Size > size - cached->Offset || cached->Volume >= header.VolumeCount)
+            goto invalid;
+        index->files[i].offset = cached->Offset;
+        index->files[i].size = cached->Size;
+        index->files[i].volume = cached->Volume;
+        index->files[i].type = cached->Type;
+        index->files[i].state = cached->State;
+    }
+    index->fileCount = header.FileCount;
+
+    free(body);
+    return 1;
+
+invalid:
+    free(body);
+    scan_result_free(hits);
+    ffs_index_free(index);
+    return 0;
+}
+
+/* Saves signatures and volumes of BIOS data with given XXH64 to cache directory, existing file is replaced atomically.
+ * Returns 1 on success and 0 on failure */
+int cache_save(const char* directory, uint32_t size, uint64_t hash, const SCAN_RESULT* hits, const FFS_INDEX* index)
+{
+    FD44_CACHE_HEADER* header;
+    FD44_CACHE_HIT* cachedHits;
+    FD44_CACHE_VOLUME* cachedVolumes;
+    FD44_CACHE_FILE* cachedFiles;
+    IMAGE file;
+    char* path;
+    uint32_t i;
+    int status;
+
+    if (!directory || !hits || !index)
+        return 0;
+
+    /* Building the whole file in memory, so it is written by a single atomic replace */
+    memset(&file, 0, sizeof(file));
+    file.size = (uint32_t)(sizeof(FD44_CACHE_HEADER) + hits->count * sizeof(FD44_CACHE_HIT)
+              + index->volumeCount * sizeof(FD44_CACHE_VOLUME) + index->fileCount * sizeof(FD44_CACHE_FILE));
+    file.data = (uint8_t*)calloc(1, file.size);
+    path = cache_path(directory, size, hash);
+    if (!file.data || !path)
+    {
+        free(file.data);
+        free(path);
+        return 0;
+    }
+    header = (FD44_CACHE_HEADER*)file.data;
+    cachedHits = (FD44_CACHE_HIT*)(header + 1);
+    cachedVolumes = (FD44_CACHE_VOLUME*)(cachedHits + hits->count);
+    cachedFiles = (FD44_CACHE_FILE*)(cachedVolumes + index->volumeCount);
+
+    for (i = 0; i < hits->count; i++)
+    {
+        cachedHits[i].Offset = hits->hits[i].offset;
+        cachedHits[i].Signature = hits->hits[i].signature;
+    }
+    for (i = 0; i < index->volumeCount; i++)
+    {
+        cachedVolumes[i].Offset = index->volumes[i].offset;
+        cachedVolumes[i].Length = index->volumes[i].length;
+        cachedVolumes[i].FirstFile = index->volumes[i].firstFile;
+        cachedVolumes[i].FileCount = index->volumes[i].fileCount;
+        cachedVolumes[i].FreeOffset = index->volumes[i].freeOffset;
+        cachedVolumes[i].IsFfs = (uint8_t)index->volumes[i].isFfs;
+        cachedVolumes[i].ErasePolarity = index->volumes[i].erasePolarity;
+    }
+    for (i = 0; i < index->fileCount; i++)
+    {
+        cachedFiles[i].Offset = index->files[i].offset;
+        cachedFiles[i].Size = index->files[i].size;
+        cachedFiles[i].Volume = index->files[i].volume;
+        cachedFiles[i].Type = index->files[i].type;
+        cachedFiles[i].State = index->files[i].state;
+    }
+
+    memcpy(header->Signature, FD44_CACHE_SIGNATURE, sizeof(header->Signature));
+    header->Version = FD44_CACHE_VERSION;
+    header->DataSize = size;
+    header->DataHash = hash;
+    header->SignaturesCrc32 = signatures_crc32();
+    header->HitCount = hits->count;
+    header->VolumeCount = index->volumeCount;
+    header->FileCount = index->fileCount;
+    header->BodyCrc32 = hash_crc32(0, header + 1, file.size - (uint32_t)sizeof(FD44_CACHE_HEADER));
+    header->HeaderCrc32 = hash_crc32(0, header, (uint32_t)(sizeof(FD44_CACHE_HEADER) - sizeof(header->HeaderCrc32)));
+
+    status = image_save(&file, path, 0, NULL);
+    free(file.data);
+    free(path);
+    return status == IMAGE_OK;
+}
@@ -0,0 +1,75 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include "scan.h"
+#include "ffs.h"
+
+/* Signature cache file format.
+ * Cache file holds signatures and firmware volumes found in BIOS data, so identical data doesn't need to be scanned again.
+ * Files are named by XXH64 and size of BIOS data they are made for.
+ * All fields are little-endian, header is followed by HitCount hits, VolumeCount volumes and FileCount files */
+
+/* Cache signature */
+static const uint8_t FD44_CACHE_SIGNATURE[] = {'F','D','4','4','S','C','A','N'};
+
+/* Current cache format version */
+#define FD44_CACHE_VERSION              1
+
+/* Cache file name extension */
+#define FD44_CACHE_EXTENSION            ".fd44c"
+
+#pragma pack(push, 1)
+typedef struct _FD44_CACHE_HEADER {
+    uint8_t  Signature[sizeof(FD44_CACHE_SIGNATURE)];                     /* FD44_CACHE_SIGNATURE */
+    uint16_t Version;                                                     /* FD44_CACHE_VERSION */
+    uint16_t Reserved;                                                    /* zero */
+    uint32_t DataSize;                                                    /* size of BIOS data */
+    uint64_t DataHash;                                                    /* XXH64 of BIOS data */
+    uint32_t SignaturesCrc32;                                             /* CRC-32 of signature table used to scan data */
+    uint32_t HitCount;                                                    /* number of found signatures */
+    uint32_t VolumeCount;                                                 /* number of found volumes */
+    uint32_t FileCount;                                                   /* number of found files */
+    uint32_t BodyCrc32;                                                   /* CRC-32 of hits, volumes and files */
+    uint32_t HeaderCrc32;                                                 /* CRC-32 of all header fields before this one */
+} FD44_CACHE_HEADER;
+
+/* Found signature */
+typedef struct _FD44_CACHE_HIT {
+    uint32_t Offset;                                                      /* offset of signature from the beginning of BIOS data */
+    uint32_t Signature;                                                   /* SIG_* identifier */
+} FD44_CACHE_HIT;
+
+/* Found volume */
+typedef struct _FD44_CACHE_VOLUME {
+    uint32_t Offset;                                                      /* offset of volume header */
+    uint32_t Length;                                                      /* volume length */
+    uint32_t FirstFile;                                                   /* index of first file of volume */
+    uint32_t FileCount;                                                   /* number of files in volume */
+    uint32_t FreeOffset;                                                  /* offset of free space after the last file */
+    uint8_t  IsFfs;                                                       /* 1 if volume files are indexed */
+    uint8_t  ErasePolarity;                                               /* value of erased byte */
+    uint16_t Reserved;                                                    /* zero */
+} FD44_CACHE_VOLUME;
+
+/* Found file */
+typedef struct _FD44_CACHE_FILE {
+    uint32_t Offset;                                                      /* offset of file header */
+    uint32_t Size;                                                        /* file size including header */
+    uint32_t Volume;                                                      /* index of volume containing the file */
+    uint8_t  Type;                                                        /* EFI_FV_FILETYPE_* value */
+    uint8_t  State;                                                       /* file state with erase polarity applied */
+    uint16_t Reserved;                                                    /* zero */
+} FD44_CACHE_FILE;
+#pragma pack(pop)
+
+/* Loads signatures and volumes of BIOS data with given XXH64 from cache directory.
+ * Everything loaded is checked against data, so stale or damaged cache files are never used.
+ * Returns 1 on success and 0 if there is no valid cache file, hits and index are empty in that case */
+int cache_load(const char* directory, const uint8_t* buffer, uint32_t size, uint64_t hash, SCAN_RESULT* hits, FFS_INDEX* index);
+
+/* Saves signatures and volumes of BIOS data with given XXH64 to cache directory, existing file is replaced atomically.
+ * Returns 1 on success and 0 on failure */
+int cache_save(const char* directory, uint32_t size, uint64_t hash, const SCAN_RESULT* hits, const FFS_INDEX* index);
+
+#endif /* CACHE_H */
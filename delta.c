@@ -0,0 +1,261 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fd44.h"
+#include "delta.h"
+#include "hash.h"
+
+/* Returns XXH64 of the whole loaded file, it must be called before fd44_apply to get hash of unchanged file */
+uint64_t fd44_source_hash(const FD44_IMAGE* image)
+{
+    if (!image || !image->image.data)
+        return 0;
+    return hash_xxh64(image->image.data, image->image.size, 0);
+}
+
+/* Writes ranges changed by fd44_apply to delta file instead of saving the whole output file.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_delta_save(const FD44_IMAGE* image, uint64_t sourceHash, const char* path, FD44_LOG* log)
+{
+    FD44_DELTA_HEADER header;
+    FD44_DELTA_RANGE* ranges;
+    FILE* file;
+    uint32_t i;
+
+    if (!image || !image->buffer || !path)
+        return FD44_ERR_ARGS;
+
+    /* Converting modified ranges to offsets from the beginning of BIOS data */
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Signature, FD44_DELTA_SIGNATURE, sizeof(header.Signature));
+    header.Version = FD44_DELTA_VERSION;
+    header.SourceSize = image->image.size;
+    header.SourceOffset = (uint32_t)(image->buffer - image->image.data);
+    header.SourceHash = sourceHash;
+    header.ResultHash = hash_xxh64(image->buffer, image->size, 0);
+    header.RangeCount = image->image.dirtyCount;
+
+    ranges = (FD44_DELTA_RANGE*)malloc((header.RangeCount ? header.RangeCount : 1) * sizeof(FD44_DELTA_RANGE));
+    if (!ranges)
+    {
+        fd44_log_printf(log, "Can't allocate memory for delta file.\n");
+        return FD44_ERR_MEMORY;
+    }
+    for (i = 0; i < header.RangeCount; i++)
+    {
+        ranges[i].Offset = image->image.dirty[i].offset - header.SourceOffset;
+        ranges[i].Length = image->image.dirty[i].length;
+        header.DataSize += ranges[i].Length;
+    }
+    header.BodyCrc32 = hash_crc32(0, ranges, header.RangeCount * sizeof(FD44_DELTA_RANGE));
+    for (i = 0; i < header.RangeCount; i++)
+        header.BodyCrc32 = hash_crc32(header.BodyCrc32, image->buffer + ranges[i].Offset, ranges[i].Length);
+    header.HeaderCrc32 = hash_crc32(0, &header, (uint32_t)(sizeof(header) - sizeof(header.HeaderCrc32)));
+
+    /* Writing header, ranges and their data */
+    file = fopen(path, "wb");
+    if (!file)
+    {
+        fd44_log_perror(log, "Can't open delta file.\n");
+        free(ranges);
+        return FD44_ERR_OUTPUT_FILE;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(ranges, sizeof(FD44_DELTA_RANGE), header.RangeCount, file);
+    for (i = 0; i < header.RangeCount; i++)
+        fwrite(image->buffer + ranges[i].Offset, sizeof(char), ranges[i].Length, file);
+    free(ranges);
+    if (ferror(file))
+    {
+        fd44_log_perror(log, "Can't write delta file.\n");
+        fclose(file);
+        return FD44_ERR_OUTPUT_FILE;
+    }
+    if (fclose(file))
+    {
+        fd44_log_perror(log, "Can't write delta file.\n");
+        return FD44_ERR_OUTPUT_FILE;
+    }
+
+    fd44_log_printf(log, "Delta file written, %u ranges of %u bytes changed.\n", header.RangeCount, header.DataSize);
+    return FD44_OK;
+}
+
+/* Reads whole delta file and checks its header and checksums.
+ * Returns pointer to allocated delta contents on success or NULL on error */
+static uint8_t* delta_read(const char* path, FD44_LOG* log, int* result)
+{
+    FD44_DELTA_HEADER* header;
+    FILE* file;
+    FD44_DELTA_RANGE* ranges;
+    uint8_t* delta;
+    long size;
+    uint64_t expected;
+    uint64_t total;
+    uint32_t i;
+
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        fd44_log_perror(log, "Can't open delta file.\n");
+        *result = FD44_ERR_INPUT_FILE;
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < (long)sizeof(FD44_DELTA_HEADER))
+    {
+        fd44_log_printf(log, "Delta file is truncated.\n");
+        fclose(file);
+        *result = FD44_ERR_INPUT_FILE;
+        return NULL;
+    }
+
+    delta = (uint8_t*)malloc(size);
+    if (!delta)
+    {
+        fd44_log_printf(log, "Can't allocate memory for delta file.\n");
+        fclose(file);
+        *result = FD44_ERR_MEMORY;
+        return NULL;
+    }
+    if (fread(delta, sizeof(char), size, file) != (size_t)size)
+    {
+        fd44_log_perror(log, "Can't read delta file.\n");
+        fclose(file);
+        free(delta);
+        *result = FD44_ERR_INPUT_FILE;
+        return NULL;
+    }
+    fclose(file);
+
+    /* Checking header */
+    header = (FD44_DELTA_HEADER*)delta;
+    *result = FD44_ERR_INPUT_FILE;
+    if (memcmp(header->Signature, FD44_DELTA_SIGNATURE, sizeof(header->Signature)))
+        fd44_log_printf(log, "Delta file signature not found.\n");
+    else if (header->Version != FD44_DELTA_VERSION)
+        fd44_log_printf(log, "Delta file version %u is not supported.\n", header->Version);
+    else
+    {
+        expected = sizeof(FD44_DELTA_HEADER) + (uint64_t)header->RangeCount * sizeof(FD44_DELTA_RANGE) + header->DataSize;
+        if (header->HeaderCrc32 != hash_crc32(0, header, (uint32_t)(sizeof(FD44_DELTA_HEADER) - sizeof(header->HeaderCrc32)))
+            || expected != (uint64_t)size
+            || header->BodyCrc32 != hash_crc32(0, delta + sizeof(FD44_DELTA_HEADER), (uint32_t)(size - sizeof(FD44_DELTA_HEADER))))
+            fd44_log_printf(log, "Delta file is corrupted.\n");
+        else
+        {
+            /* Checking that ranges match their data */
+            ranges = (FD44_DELTA_RANGE*)(delta + sizeof(FD44_DELTA_HEADER));
+            for (i = 0, total = 0; i < header->RangeCount; i++)
+                total += ranges[i].Length;
+            if (total != header->DataSize)
+                fd44_log_printf(log, "Delta file is corrupted.\n");
+            else
+                *result = FD44_OK;
+        }
+    }
+    if (*result != FD44_OK)
+    {
+        free(delta);
+        return NULL;
+    }
+    return delta;
+}
+
+/* Applies delta file to the output file it was made for, only changed ranges are written.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, output file is not changed in that case */
+int fd44_delta_apply(const char* delta, const char* path, uint32_t flags, FD44_LOG* log)
+{
+    FD44_DELTA_HEADER* header;
+    FD44_DELTA_RANGE* ranges;
+    const uint8_t* data;
+    uint8_t* contents;
+    IMAGE image;
+    uint32_t i;
+    int status;
+    int result;
+
+    if (!delta || !path)
+        return FD44_ERR_ARGS;
+
+    contents = delta_read(delta, log, &result);
+    if (!contents)
+        return result;
+    header = (FD44_DELTA_HEADER*)contents;
+    ranges = (FD44_DELTA_RANGE*)(contents + sizeof(FD44_DELTA_HEADER));
+    data = (const uint8_t*)(ranges + header->RangeCount);
+
+    /* Opening output file and checking that it is the file delta is made for */
+    status = image_open(&image, path, flags | IMAGE_WRITABLE);
+    if (status != IMAGE_OK)
+    {
+        if (status == IMAGE_ERR_MEMORY)
+            fd44_log_printf(log, "Can't allocate memory for output file.\n");
+        else
+            fd44_log_perror(log, status == IMAGE_ERR_OPEN ? "Can't open output file.\n" : "Can't read output file.\n");
+        free(contents);
+        return status == IMAGE_ERR_MEMORY ? FD44_ERR_MEMORY : FD44_ERR_OUTPUT_FILE;
+    }
+    result = FD44_OK;
+    if (image.size != header->SourceSize || header->SourceOffset > image.size
+        || hash_xxh64(image.data, image.size, 0) != header->SourceHash)
+    {
+        fd44_log_printf(log, "Output file differs from the file delta is made for.\n");
+        result = FD44_ERR_OUTPUT_FILE;
+    }
+
+    /* Copying changed ranges */
+    for (i = 0; result == FD44_OK && i < header->RangeCount; i++)
+    {
+        if (ranges[i].Offset > image.size - header->SourceOffset
+            || ranges[i].Length > image.size - header->SourceOffset - ranges[i].Offset)
+        {
+            fd44_log_printf(log, "Delta file is corrupted.\n");
+            result = FD44_ERR_INPUT_FILE;
+        }
+        else if (!image_patch(&image, image.data + header->SourceOffset + ranges[i].Offset, data, ranges[i].Length))
+        {
+            fd44_log_printf(log, "Memcpy failed.\nDelta can't be applied.\n");
+            result = FD44_ERR_MEMORY;
+        }
+        data += ranges[i].Length;
+    }
+
+    /* Checking result before writing anything */
+    if (result == FD44_OK
+        && hash_xxh64(image.data + header->SourceOffset, image.size - header->SourceOffset, 0) != header->ResultHash)
+    {
+        fd44_log_printf(log, "Result of delta differs from the file delta is made from.\n");
+        result = FD44_ERR_OUTPUT_FILE;
+    }
+
+    /* Writing changed ranges, or the whole file if capsule header is removed */
+    if (result == FD44_OK)
+    {
+        status = image_write(&image, path, header->SourceOffset, NULL);
+        if (status == IMAGE_ERR_MEMORY)
+        {
+            fd44_log_printf(log, "Can't allocate memory for output file.\n");
+            result = FD44_ERR_MEMORY;
+        }
+        else if (status != IMAGE_OK)
+        {
+            fd44_log_perror(log, "Can't write output file.\n");
+            result = FD44_ERR_OUTPUT_FILE;
+        }
+        else
+        {
+            fd44_log_printf(log, "Delta applied, %u ranges of %u bytes changed.\n", header->RangeCount, header->DataSize);
+            if (header->SourceOffset)
+                fd44_log_printf(log, "Capsule file header removed.\n");
+        }
+    }
+
+    image_close(&image);
+    free(contents);
+    return result;
+}
@@ -0,0 +1,38 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+
+/* Delta file format.
+ * Delta holds only the ranges changed in output file, so it can be applied to an exact copy of that file later.
+ * All fields are little-endian, header is followed by RangeCount ranges and then by their data in the same order */
+
+/* Delta signature */
+static const uint8_t FD44_DELTA_SIGNATURE[] = {'F','D','4','4','D','L','T','A'};
+
+/* Current delta format version */
+#define FD44_DELTA_VERSION              1
+
+#pragma pack(push, 1)
+typedef struct _FD44_DELTA_HEADER {
+    uint8_t  Signature[sizeof(FD44_DELTA_SIGNATURE)];                     /* FD44_DELTA_SIGNATURE */
+    uint16_t Version;                                                     /* FD44_DELTA_VERSION */
+    uint16_t Reserved;                                                    /* zero */
+    uint32_t SourceSize;                                                  /* size of file delta is made for */
+    uint32_t SourceOffset;                                                /* size of capsule header removed from the beginning of file */
+    uint64_t SourceHash;                                                  /* XXH64 of file delta is made for */
+    uint64_t ResultHash;                                                  /* XXH64 of file after applying delta */
+    uint32_t RangeCount;                                                  /* number of changed ranges */
+    uint32_t DataSize;                                                    /* total length of changed ranges */
+    uint32_t BodyCrc32;                                                   /* CRC-32 of ranges and their data */
+    uint32_t HeaderCrc32;                                                 /* CRC-32 of all header fields before this one */
+} FD44_DELTA_HEADER;
+
+/* Changed range */
+typedef struct _FD44_DELTA_RANGE {
+    uint32_t Offset;                                                      /* offset of range from SourceOffset */
+    uint32_t Length;                                                      /* length of range */
+} FD44_DELTA_RANGE;
+#pragma pack(pop)
+
+#endif /* DELTA_H */
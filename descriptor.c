@@ -0,0 +1,40 @@
+#include <string.h>
+#include "descriptor.h"
+#include "bios.h"
+
+/* Reads 32-bit little-endian value */
+static uint32_t read32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/* Looks up flash region in Intel flash descriptor located at the beginning of buffer.
+ * Returns 1 and stores region offset and length if descriptor is found and region is used,
+ * or 0 if there is no descriptor, region is unused or doesn't fit into buffer */
+int descriptor_region(const uint8_t* buffer, uint32_t size, uint32_t region, uint32_t* offset, uint32_t* length)
+{
+    uint32_t regionBase;
+    uint32_t entry;
+    uint32_t base;
+    uint32_t limit;
+
+    if (region > FLASH_REGION_GBE || size < FLASH_DESCRIPTOR_LENGTH
+        || memcmp(buffer + FLASH_DESCRIPTOR_SIGNATURE_OFFSET, FLASH_DESCRIPTOR_SIGNATURE, sizeof(FLASH_DESCRIPTOR_SIGNATURE)))
+        return 0;
+
+    /* Region section base is stored in FLMAP0 in 16-byte units */
+    regionBase = ((read32(buffer + FLASH_DESCRIPTOR_FLMAP0_OFFSET) >> 16) & 0xFF) << 4;
+    if (regionBase + (region + 1) * sizeof(uint32_t) > FLASH_DESCRIPTOR_LENGTH)
+        return 0;
+
+    /* FLREG entry holds region base and limit in 4K units, unused regions have base above limit */
+    entry = read32(buffer + regionBase + region * sizeof(uint32_t));
+    base = (entry & FLASH_REGION_MASK) << 12;
+    limit = (((entry >> 16) & FLASH_REGION_MASK) << 12) | 0xFFF;
+    if (base > limit || limit >= size)
+        return 0;
+
+    *offset = base;
+    *length = limit - base + 1;
+    return 1;
+}
@@ -0,0 +1,12 @@
+#ifndef DESCRIPTOR_H
+#define DESCRIPTOR_H
+
+#include <stdint.h>
+
+/* Looks up flash region in Intel flash descriptor located at the beginning of buffer.
+ * region is one of FLASH_REGION_* values.
+ * Returns 1 and stores region offset and length if descriptor is found and region is used,
+ * or 0 if there is no descriptor, region is unused or doesn't fit into buffer */
+int descriptor_region(const uint8_t* buffer, uint32_t size, uint32_t region, uint32_t* offset, uint32_t* length);
+
+#endif /* DESCRIPTOR_H */
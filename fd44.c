@@ -0,0 +1,1855 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include "fd44.h"
+#include "search.h"
+#include "ffs.h"
+#include "descriptor.h"
+#include "stream.h"
+#include "cache.h"
+#include "hash.h"
+
+/* Returns statistics collected with log messages, NULL if there is no log or statistics are not collected */
+static STATS* log_stats(FD44_LOG* log)
+{
+    return log ? log->stats : NULL;
+}
+
+/* Calculates 2's complement 8-bit checksum of data from data[0] to data[length-1] and stores it to *checksum
+ * Returns 1 on success and 0 on failure */
+static int calculate_checksum(uint8_t* data, uint32_t length, uint8_t* checksum)
+{
+    if (!data || !length || !checksum)
+        return 0;
+    *checksum = (uint8_t)(~hash_sum8(data, length) + 1);
+    return 1;
+}
+
+/* Converts SIZE field of MODULE_HEADER (3 bytes in reversed order) to uint32_t.
+ * Returns 1 on success or 0 on error */
+static int size2int(uint8_t* module_size, uint32_t* size)
+{
+    if (!module_size || !size)
+        return 0;
+
+    *size = (module_size[2] << 16) + 
+            (module_size[1] << 8) + 
+             module_size[0];
+    return 1;
+}
+
+/* Looks up the first FD44 module starting at or after from.
+ * Modules are looked up in firmware volume index, so GUID matches inside of files are skipped,
+ * scan result is used only if there are no FD44 modules in indexed volumes at all.
+ * Returns pointer to module header or NULL if not found */
+static uint8_t* find_fd44_module(const FD44_IMAGE* context, uint8_t* from)
+{
+    const FFS_FILE* file;
+
+    file = ffs_find_file(&context->index, context->buffer, FD44_MODULE_HEADER, FFS_ANY_VOLUME, NULL);
+    if (!file)
+        return find_hit(&context->hits, context->buffer, SIG_FD44_MODULE, from, context->buffer + context->size);
+
+    for (; file; file = ffs_find_file(&context->index, context->buffer, FD44_MODULE_HEADER, FFS_ANY_VOLUME, file))
+        if (context->buffer + file->offset >= from)
+            return context->buffer + file->offset;
+    return NULL;
+}
+
+/* Locates GbE headers of both banks.
+ * For full flash images banks are taken from GbE region of flash descriptor,
+ * for BIOS region images and images with empty GbE region two first GbE signatures are used */
+static void find_gbe(FD44_IMAGE* context)
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t count = 0;
+    uint32_t i;
+
+    if (descriptor_region(context->buffer, context->size, FLASH_REGION_GBE, &offset, &length))
+    {
+        for (i = 0; i < GBE_BANK_COUNT; i++)
+        {
+            uint8_t* header = context->buffer + offset + i * (length / GBE_BANK_COUNT) - GBE_MAC_OFFSET;
+            if (!memcmp(header, GBE_HEADER, sizeof(GBE_HEADER)))
+                context->gbe[count++] = header;
+        }
+        if (count)
+            return;
+    }
+
+    context->gbe[0] = find_hit(&context->hits, context->buffer, SIG_GBE, context->buffer, context->buffer + context->size);
+    if (context->gbe[0])
+        context->gbe[1] = find_hit(&context->hits, context->buffer, SIG_GBE, context->gbe[0] + sizeof(GBE_HEADER), context->buffer + context->size);
+}
+
+/* Checks that donor has all data requested by options, donor loaded from bundle could be extracted with other options.
+ * Returns FD44_OK if it has or FD44_ERR_* code if it hasn't */
+static int check_donor(const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log)
+{
+    if (options->copyGbe && !options->defaultOptions && !donor->hasGbe)
+    {
+        fd44_log_printf(log, "GbE region not found in input file, but required by -g option.\n");
+        return FD44_ERR_NO_GBE;
+    }
+    if (options->copySLIC && !options->defaultOptions && !donor->hasSLIC)
+    {
+        fd44_log_printf(log, "SLIC pubkey and marker not found in input file, but required by -s option.\n");
+        return FD44_ERR_NO_SLIC;
+    }
+    if (options->copyModule && !donor->isModuleEmpty && !donor->fd44Module)
+    {
+        fd44_log_printf(log, "FD44 module not found in input file.\n");
+        return FD44_ERR_NO_FD44_MODULE;
+    }
+    return FD44_OK;
+}
+
+/* Locates free space for SLIC pubkey and marker modules after the last file of volume, volume offsets are relative to buffer.
+ * Returns 1 and stores module locations if there is enough erased space and 0 if there isn't */
+static int find_slic_space(uint8_t* buffer, const FFS_VOLUME* volume, uint8_t** pubkey_module, uint8_t** marker_module)
+{
+    *pubkey_module = buffer + volume->freeOffset;
+    *marker_module = *pubkey_module + ((SLIC_PUBKEY_LENGTH + EFI_FFS_ALIGNMENT - 1) & ~(EFI_FFS_ALIGNMENT - 1));
+    return volume->erasePolarity == 0xFF
+        && volume->offset + volume->length - volume->freeOffset >= (uint32_t)(*marker_module - *pubkey_module) + SLIC_MARKER_LENGTH
+        && !find_not_byte(*pubkey_module, *marker_module + SLIC_MARKER_LENGTH, 0xFF);
+}
+
+/* Writes SLIC pubkey and marker modules with donor data to image.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int insert_slic(IMAGE* image, uint8_t* pubkey_module, uint8_t* marker_module, const FD44_DONOR* donor, FD44_LOG* log)
+{
+    uint8_t data_checksum;
+    STATS_MARK mark;                                                      /* start of checksum calculation */
+    int calculated;                                                       /* checksum calculation result */
+
+    /* Writing pubkey header */
+    if (!image_patch(image, pubkey_module, SLIC_PUBKEY_HEADER, sizeof(SLIC_PUBKEY_HEADER)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing pubkey first part */
+    if (!image_patch(image, pubkey_module + sizeof(SLIC_PUBKEY_HEADER), SLIC_PUBKEY_PART1, sizeof(SLIC_PUBKEY_PART1)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing pubkey */
+    if (!image_patch(image, pubkey_module + sizeof(SLIC_PUBKEY_HEADER) + sizeof(SLIC_PUBKEY_PART1), donor->slicPubkey, sizeof(donor->slicPubkey)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Calculating pubkey module data checksum */
+    stats_begin(log_stats(log), &mark);
+    calculated = calculate_checksum(pubkey_module + MODULE_DATA_CHECKSUM_START, SLIC_PUBKEY_LENGTH - MODULE_DATA_CHECKSUM_START, &data_checksum);
+    stats_end(log_stats(log), STATS_CHECKSUM, &mark, SLIC_PUBKEY_LENGTH - MODULE_DATA_CHECKSUM_START, 1);
+    if (!calculated)
+    {
+        fd44_log_printf(log, "Pubkey module checksum calculation failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing pubkey module data checksum */
+    if (!image_patch(image, pubkey_module + MODULE_DATA_CHECKSUM_OFFSET, &data_checksum, sizeof(data_checksum)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+
+    /* Writing marker header*/
+    if (!image_patch(image, marker_module, SLIC_MARKER_HEADER, sizeof(SLIC_MARKER_HEADER)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing marker first part*/
+    if (!image_patch(image, marker_module + sizeof(SLIC_MARKER_HEADER), SLIC_MARKER_PART1, sizeof(SLIC_MARKER_PART1)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing marker */
+    if (!image_patch(image, marker_module + sizeof(SLIC_MARKER_HEADER) + sizeof(SLIC_MARKER_PART1), donor->slicMarker, sizeof(donor->slicMarker)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Calculating pubkey module data checksum */
+    stats_begin(log_stats(log), &mark);
+    calculated = calculate_checksum(marker_module + MODULE_DATA_CHECKSUM_START, SLIC_MARKER_LENGTH - MODULE_DATA_CHECKSUM_START, &data_checksum);
+    stats_end(log_stats(log), STATS_CHECKSUM, &mark, SLIC_MARKER_LENGTH - MODULE_DATA_CHECKSUM_START, 1);
+    if (!calculated)
+    {
+        fd44_log_printf(log, "Marker module checksum calculation failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+    /* Writing marker module data checksum */
+    if (!image_patch(image, marker_module + MODULE_DATA_CHECKSUM_OFFSET, &data_checksum, sizeof(data_checksum)))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nSLIC table can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+
+    fd44_log_printf(log, "SLIC pubkey and marker copied.\n");
+    return FD44_OK;
+}
+
+/* Copies donor FD44 module data to module at fd44 if it has BSA signature, offset of module is used in messages.
+ * Returns FD44_OK if data is copied or module is skipped, *copied is set in the first case,
+ * FD44_ERR_NO_FD44_MODULE if module is too small or FD44_ERR_MEMORY on error */
+static int copy_fd44_module(IMAGE* image, uint8_t* fd44, uint32_t offset, const FD44_DONOR* donor, int8_t* copied, FD44_LOG* log)
+{
+    uint32_t currentModuleSize;
+    uint8_t data_checksum;
+    STATS_MARK mark;                                                      /* start of checksum calculation */
+
+    if (memcmp(fd44 + FD44_MODULE_HEADER_BSA_OFFSET, FD44_MODULE_HEADER_BSA, sizeof(FD44_MODULE_HEADER_BSA)))
+        return FD44_OK;
+
+    /* Checking that there is enough space in module to insert data */
+    size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &currentModuleSize);
+    if (currentModuleSize - FD44_MODULE_HEADER_LENGTH < donor->fd44ModuleSize)
+    {
+        fd44_log_printf(log, "FD44 module at %08X is too small.\n", offset + FD44_MODULE_HEADER_LENGTH);
+        return FD44_ERR_NO_FD44_MODULE;
+    }
+    /* Copying module data*/
+    if (!image_patch(image, fd44 + FD44_MODULE_HEADER_LENGTH, donor->fd44Module, donor->fd44ModuleSize))
+    {
+        fd44_log_printf(log, "Memcpy failed.\nFD44 module can't be copied.\n");
+        return FD44_ERR_MEMORY;
+    }
+
+    /* Updating file data checksum if module has one, it covers copied data */
+    if ((((const EFI_FFS_FILE_HEADER*)fd44)->Attributes & EFI_FFS_ATTRIB_CHECKSUM) && currentModuleSize <= (uint32_t)(image->data + image->size - fd44))
+    {
+        stats_begin(log_stats(log), &mark);
+        calculate_checksum(fd44 + MODULE_DATA_CHECKSUM_START, currentModuleSize - MODULE_DATA_CHECKSUM_START, &data_checksum);
+        stats_end(log_stats(log), STATS_CHECKSUM, &mark, currentModuleSize - MODULE_DATA_CHECKSUM_START, 1);
+        if (!image_patch(image, fd44 + MODULE_DATA_CHECKSUM_OFFSET, &data_checksum, sizeof(data_checksum)))
+        {
+            fd44_log_printf(log, "Memcpy failed.\nFD44 module can't be copied.\n");
+            return FD44_ERR_MEMORY;
+        }
+    }
+    *copied = 1;
+    return FD44_OK;
+}
+
+/* Prints formatted message to console or appends it to log buffer, nothing is done if log is NULL */
+void fd44_log_printf(FD44_LOG* log, const char* format, ...)
+{
+    va_list args;
+    int length;
+
+    if (!log)
+        return;
+    va_start(args, format);
+    if (!log->buffered)
+    {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length <= 0)
+        return;
+
+    if (log->length + length + 1 > log->capacity)
+    {
+        uint32_t capacity = (log->length + length + 1) * 2;
+        char* buffer = (char*)realloc(log->buffer, capacity);
+        if (!buffer)
+            return;
+        log->buffer = buffer;
+        log->capacity = capacity;
+    }
+    va_start(args, format);
+    vsnprintf(log->buffer + log->length, log->capacity - log->length, format, args);
+    va_end(args);
+    log->length += length;
+}
+
+/* Prints message followed by description of current errno value as perror does, nothing is done if log is NULL */
+void fd44_log_perror(FD44_LOG* log, const char* message)
+{
+    const char* description = strerror(errno);
+    if (!log)
+        return;
+    if (!log->buffered)
+    {
+        fprintf(stderr, "%s: %s\n", message, description);
+        return;
+    }
+    fd44_log_printf(log, "%s: %s\n", message, description);
+}
+
+/* Selects search kernel for current CPU and builds signature scanner.
+ * Returns 1 on success and 0 on failure */
+int fd44_init(FD44* fd44)
+{
+    if (!fd44)
+        return 0;
+
+    search_init();
+    hash_init();
+    fd44->scanThreads = 1;
+    fd44->cacheDir = NULL;
+    return scanner_init(&fd44->scanner);
+}
+
+/* Frees library state */
+void fd44_free(FD44* fd44)
+{
+    if (fd44)
+        scanner_free(&fd44->scanner);
+}
+
+/* Loads BIOS image file and locates all known structures in it.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, image is closed in that case */
+int fd44_open(const FD44* fd44, FD44_IMAGE* context, const char* path, uint32_t flags, FD44_LOG* log)
+{
+    int8_t isOutput = (flags & IMAGE_WRITABLE) != 0;                      /* flag that image is output file */
+    const char* name = isOutput ? "output" : "input";                     /* file role used in messages */
+    int error = isOutput ? FD44_ERR_OUTPUT_FILE : FD44_ERR_INPUT_FILE;    /* result of file errors */
+    int status;                                                           /* image operation result */
+    int cached = 0;                                                       /* flag that scan results are loaded from cache */
+    uint64_t cacheHash = 0;                                               /* XXH64 of BIOS data used as cache key */
+    STATS_MARK mark;                                                      /* start of current stage */
+
+    memset(context, 0, sizeof(FD44_IMAGE));
+    if (!fd44 || !path)
+        return FD44_ERR_ARGS;
+
+    /* Opening file, input files are mapped shared with page cache,
+     * output files are mapped copy-on-write, so only modified pages are copied */
+    stats_begin(log_stats(log), &mark);
+    status = image_open(&context->image, path, flags);
+    stats_end(log_stats(log), isOutput ? STATS_LOAD_OUTPUT : STATS_LOAD_INPUT, &mark, context->image.size, 0);
+    if (status == IMAGE_ERR_OPEN)
+    {
+        fd44_log_perror(log, isOutput ? "Can't open output file.\n" : "Can't open input file.\n");
+        return error;
+    }
+    if (status == IMAGE_ERR_MEMORY)
+    {
+        fd44_log_printf(log, "Can't allocate memory for %s file.\n", name);
+        return FD44_ERR_MEMORY;
+    }
+    if (status != IMAGE_OK)
+    {
+        fd44_log_perror(log, isOutput ? "Can't read output file.\n" : "Can't read input file.\n");
+        return error;
+    }
+    context->buffer = context->image.data;
+    context->size = context->image.size;
+
+    context->path = (char*)malloc(strlen(path) + 1);
+    if (!context->path)
+    {
+        fd44_log_printf(log, "Can't allocate memory for %s file.\n", name);
+        fd44_close(context);
+        return FD44_ERR_MEMORY;
+    }
+    strcpy(context->path, path);
+
+    /* Searching for capsule file signature in output file, if found - remove capsule file header */
+    if (isOutput && context->size >= sizeof(APTIO_CAPSULE_HEADER)
+        && find_pattern(context->buffer, context->buffer + sizeof(APTIO_CAPSULE_GUID), APTIO_CAPSULE_GUID, sizeof(APTIO_CAPSULE_GUID)))
+    {
+        APTIO_CAPSULE_HEADER *header = (APTIO_CAPSULE_HEADER*)context->buffer;
+        if (header->RomImageOffset < context->size)
+        {
+            context->hasCapsuleHeader = 1;
+            context->buffer += header->RomImageOffset;
+            context->size -= header->RomImageOffset;
+        }
+    }
+
+    /* Loading signatures and volumes found in identical data before, if signature cache is used */
+    stats_begin(log_stats(log), &mark);
+    if (fd44->cacheDir)
+    {
+        cacheHash = hash_xxh64(context->buffer, context->size, 0);
+        cached = cache_load(fd44->cacheDir, context->buffer, context->size, cacheHash, &context->hits, &context->index);
+    }
+
+    /* Scanning whole file for all known signatures at once, large files are split between scan threads.
+     * Patches are written only to GbE MAC, free space and FD44 module data,
+     * none of them can contain a signature searched after them, so one scan is enough */
+    if (!cached && !scanner_scan_parallel(&fd44->scanner, context->buffer, context->buffer + context->size, &context->hits, fd44->scanThreads))
+    {
+        fd44_log_printf(log, "Can't allocate memory for %s file signatures.\n", name);
+        fd44_close(context);
+        return FD44_ERR_MEMORY;
+    }
+    stats_end(log_stats(log), isOutput ? STATS_SCAN_OUTPUT : STATS_SCAN_INPUT, &mark, context->size, context->hits.count);
+
+    /* Indexing firmware volumes and their files */
+    stats_begin(log_stats(log), &mark);
+    if (!cached && !ffs_index_build(&context->index, context->buffer, context->size, &context->hits))
+    {
+        fd44_log_printf(log, "Can't allocate memory for %s file volumes.\n", name);
+        fd44_close(context);
+        return FD44_ERR_MEMORY;
+    }
+    stats_end(log_stats(log), isOutput ? STATS_INDEX_OUTPUT : STATS_INDEX_INPUT, &mark, 0, context->index.volumeCount);
+
+    /* Saving scan results for the next run, cache is optional, so failures are ignored */
+    if (fd44->cacheDir && !cached)
+        cache_save(fd44->cacheDir, context->size, cacheHash, &context->hits, &context->index);
+
+    /* Locating GbE banks */
+    find_gbe(context);
+
+    /* Searching for bootefi signature */
+    context->bootefi = find_hit(&context->hits, context->buffer, SIG_BOOTEFI, context->buffer, context->buffer + context->size);
+    if (!context->bootefi)
+    {
+        fd44_log_printf(log, "ASUS BIOS file signature not found in %s file.\n", name);
+        fd44_close(context);
+        return error;
+    }
+
+    return FD44_OK;
+}
+
+/* Rebases pointer into data of source image to the same place in data of clone, NULL stays NULL */
+static uint8_t* rebase(const FD44_IMAGE* source, const FD44_IMAGE* clone, const uint8_t* pointer)
+{
+    return pointer ? clone->image.data + (pointer - source->image.data) : NULL;
+}
+
+/* Makes independent copy of output file image with all located structures, so it isn't loaded and scanned again.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, clone is closed in that case */
+int fd44_clone(const FD44_IMAGE* source, FD44_IMAGE* clone, FD44_LOG* log)
+{
+    uint32_t i;
+    STATS_MARK mark;                                                      /* start of cloning */
+
+    memset(clone, 0, sizeof(FD44_IMAGE));
+    if (!source || !source->bootefi || !(source->image.flags & IMAGE_WRITABLE))
+        return FD44_ERR_ARGS;
+
+    /* Copying file data and all lists pointing into it */
+    stats_begin(log_stats(log), &mark);
+    clone->path = (char*)malloc(strlen(source->path) + 1);
+    clone->hits.hits = (SCAN_HIT*)malloc((source->hits.count ? source->hits.count : 1) * sizeof(SCAN_HIT));
+    clone->index.volumes = (FFS_VOLUME*)malloc((source->index.volumeCount ? source->index.volumeCount : 1) * sizeof(FFS_VOLUME));
+    clone->index.files = (FFS_FILE*)malloc((source->index.fileCount ? source->index.fileCount : 1) * sizeof(FFS_FILE));
+    if (!clone->path || !clone->hits.hits || !clone->index.volumes || !clone->index.files
+        || image_copy(&clone->image, &source->image) != IMAGE_OK)
+    {
+        fd44_log_printf(log, "Can't allocate memory for output file.\n");
+        fd44_close(clone);
+        return FD44_ERR_MEMORY;
+    }
+    strcpy(clone->path, source->path);
+    memcpy(clone->hits.hits, source->hits.hits, source->hits.count * sizeof(SCAN_HIT));
+    clone->hits.count = clone->hits.capacity = source->hits.count;
+    memcpy(clone->index.volumes, source->index.volumes, source->index.volumeCount * sizeof(FFS_VOLUME));
+    clone->index.volumeCount = clone->index.volumeCapacity = source->index.volumeCount;
+    memcpy(clone->index.files, source->index.files, source->index.fileCount * sizeof(FFS_FILE));
+    clone->index.fileCount = clone->index.fileCapacity = source->index.fileCount;
+
+    /* Pointing located structures to copied data */
+    clone->buffer = rebase(source, clone, source->buffer);
+    clone->size = source->size;
+    clone->hasCapsuleHeader = source->hasCapsuleHeader;
+    clone->bootefi = rebase(source, clone, source->bootefi);
+    for (i = 0; i < GBE_BANK_COUNT; i++)
+        clone->gbe[i] = rebase(source, clone, source->gbe[i]);
+
+    stats_end(log_stats(log), STATS_CLONE, &mark, clone->image.size, clone->hits.count);
+    return FD44_OK;
+}
+
+/* Extracts data to be copied from input file image, fd44_extract without statistics.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error */
+static int extract(const FD44_IMAGE* context, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log)
+{
+    uint8_t* buffer;                                                      /* BIOS data */
+    uint8_t* end;                                                         /* end of BIOS data */
+    uint8_t* bootefi;                                                     /* BOOTEFI header */
+    const SCAN_RESULT* hits;                                              /* signatures found in BIOS data */
+
+    memset(donor, 0, sizeof(FD44_DONOR));
+    if (!context || !context->bootefi || !options)
+        return FD44_ERR_ARGS;
+    buffer = context->buffer;
+    end = buffer + context->size;
+    bootefi = context->bootefi;
+    hits = &context->hits;
+
+    /* Storing motherboard name, bytes after the end of data are left zero as fd44_probe does */
+    if (!options->skipMotherboardNameCheck && end - bootefi > BOOTEFI_MOTHERBOARD_NAME_OFFSET)
+    {
+        memcpy(donor->motherboardName, bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET,
+               end - bootefi >= BOOTEFI_MOTHERBOARD_NAME_OFFSET + BOOTEFI_MOTHERBOARD_NAME_LENGTH
+               ? BOOTEFI_MOTHERBOARD_NAME_LENGTH : (uint32_t)(end - bootefi) - BOOTEFI_MOTHERBOARD_NAME_OFFSET);
+        donor->motherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH] = 0;
+    }
+
+    /* Searching for GbE and storing MAC address if it is found */
+    if (options->copyGbe)
+    {
+        uint8_t* gbe = context->gbe[0];
+        donor->hasGbe = 0;
+        if (gbe)
+        {
+            donor->hasGbe = 1;
+            /* Checking if first GbE is a stub */
+            if (!memcmp(gbe + GBE_MAC_OFFSET, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)))
+            {
+                uint8_t* gbe2 = context->gbe[1];
+                /* Checking if second GbE is not a stub */
+                if(gbe2 && memcmp(gbe2 + GBE_MAC_OFFSET, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)))
+                    gbe = gbe2;
+            }
+
+            if (!memcpy(donor->gbeMac, gbe + GBE_MAC_OFFSET, GBE_MAC_LENGTH))
+            {
+                fd44_log_printf(log, "Memcpy failed.\nGbE MAC can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+        }
+
+        if (!options->defaultOptions && !donor->hasGbe)
+        {
+            fd44_log_printf(log, "GbE region not found in input file, but required by -g option.\n");
+            return FD44_ERR_NO_GBE;
+        }
+    }
+
+    /* Searching for SLIC pubkey and marker and storing them if found*/
+    if (options->copySLIC)
+    {
+        uint8_t* slic_pubkey = find_hit(hits, buffer, SIG_SLIC_PUBKEY, buffer, end);
+        uint8_t* slic_marker = find_hit(hits, buffer, SIG_SLIC_MARKER, buffer, end);
+        donor->hasSLIC = 0;
+        if (slic_pubkey && slic_marker)
+        {
+            slic_pubkey += sizeof(SLIC_PUBKEY_HEADER) + sizeof(SLIC_PUBKEY_PART1);
+            slic_marker += sizeof(SLIC_MARKER_HEADER) + sizeof(SLIC_MARKER_PART1);
+            if (!memcpy(donor->slicPubkey, slic_pubkey, sizeof(donor->slicPubkey)))
+            {
+                fd44_log_printf(log, "Memcpy failed.\nSLIC pubkey can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+            if (!memcpy(donor->slicMarker, slic_marker, sizeof(donor->slicMarker)))
+            {
+                fd44_log_printf(log, "Memcpy failed.\nSLIC marker can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+            donor->hasSLIC = 1;
+        }
+        else /* If SLIC headers not found, searching for SLIC pubkey and marker in ASUSBKP module */
+        {
+            uint8_t* asusbkp = find_hit(hits, buffer, SIG_ASUSBKP, buffer, end);
+            if (asusbkp)
+            {
+                slic_pubkey = find_hit(hits, buffer, SIG_ASUSBKP_PUBKEY, asusbkp, end);
+                slic_marker = find_hit(hits, buffer, SIG_ASUSBKP_MARKER, asusbkp, end);
+                if (slic_pubkey && slic_marker)
+                {
+                    slic_pubkey += sizeof(ASUSBKP_PUBKEY_HEADER);
+                    slic_marker += sizeof(ASUSBKP_MARKER_HEADER);
+                    if (!memcpy(donor->slicPubkey, slic_pubkey, sizeof(donor->slicPubkey)))
+                    {
+                        fd44_log_printf(log, "Memcpy failed\nSLIC pubkey can't be copied.\n");
+                        return FD44_ERR_MEMORY;
+                    }
+                    if (!memcpy(donor->slicMarker, slic_marker, sizeof(donor->slicMarker)))
+                    {
+                        fd44_log_printf(log, "Memcpy failed\nSLIC marker can't be copied.\n");
+                        return FD44_ERR_MEMORY;
+                    }
+                    donor->hasSLIC = 1;
+                    donor->isSlicFromAsusbkp = 1;
+                }
+            }
+        }
+
+        if (!options->defaultOptions && !donor->hasSLIC)
+        {
+            fd44_log_printf(log, "SLIC pubkey and marker not found in input file, but required by -s option.\n");
+            return FD44_ERR_NO_SLIC;
+        }
+    }
+
+    /* Searching for FD44 module header */
+    if (options->copyModule)
+    {
+        uint8_t* module = 0;
+        uint8_t* fd44 = find_fd44_module(context, buffer);
+        if (!fd44)
+        {
+            fd44_log_printf(log, "FD44 module not found in input file.\n");
+            return FD44_ERR_NO_FD44_MODULE;
+        }
+        donor->isModuleEmpty = 1;
+
+        /* Looking for non-empty module */
+        while(donor->isModuleEmpty && fd44)
+        {
+
+            /* Getting module size */
+            size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &donor->fd44ModuleSize);
+            
+            /* Checking that module has BSA signature */
+            if (!memcmp(fd44 + FD44_MODULE_HEADER_BSA_OFFSET, FD44_MODULE_HEADER_BSA, sizeof(FD44_MODULE_HEADER_BSA))
+                && donor->fd44ModuleSize > FD44_MODULE_HEADER_LENGTH)
+            {
+                uint8_t* module_end;
+                uint8_t* data;
+                STATS_MARK mark;
+                module = fd44 + FD44_MODULE_HEADER_LENGTH;
+                module_end = fd44 + donor->fd44ModuleSize;
+                if (module_end > end)
+                {
+                    module_end = end;
+                    donor->fd44ModuleSize = (uint32_t)(end - fd44);
+                }
+
+                /* Looking for non-FF byte starting from the beginning of data, if found - this module is not empty */
+                stats_begin(log_stats(log), &mark);
+                data = find_not_byte(module, module_end, 0xFF);
+                stats_end(log_stats(log), STATS_EMPTY_CHECK, &mark, (data ? data + 1 : module_end) - module, 1);
+                if (data)
+                    donor->isModuleEmpty = 0;
+            }
+
+            /* Finding next module */
+            fd44 = find_fd44_module(context, fd44 + FD44_MODULE_HEADER_LENGTH);
+        }
+
+        /* Checking if all modules are empty */
+        if (donor->isModuleEmpty)
+        {
+            fd44_log_printf(log, "FD44 modules are empty in input file. Data restoration required.\nUse FD44Editor to restore your data.\n");
+        }
+        else /* Storing module contents */       
+        {
+            /* No need to store module header and FF bytes after the last non-FF byte of data */
+            donor->fd44ModuleSize = rfind_not_byte(module, module + donor->fd44ModuleSize - FD44_MODULE_HEADER_LENGTH, 0xFF) - module + 1;
+
+            /* Allocating memory for module storage */
+            donor->fd44Module = (uint8_t*)malloc(donor->fd44ModuleSize);
+            if (!donor->fd44Module)
+            {
+                fd44_log_printf(log, "Can't allocate memory for FD44 module.\nFD44 module can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+
+            /* Storing module contents */
+            if (!memcpy(donor->fd44Module, module, donor->fd44ModuleSize))
+            {
+                fd44_log_printf(log, "Memcpy failed.\nFD44 module can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+        }
+    }
+
+    return FD44_OK;
+}
+
+/* Extracts data to be copied from input file image.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error.
+ * Donor must be freed by fd44_donor_free in both cases */
+int fd44_extract(const FD44_IMAGE* context, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log)
+{
+    STATS_MARK mark;
+    int result;
+
+    stats_begin(log_stats(log), &mark);
+    result = extract(context, options, donor, log);
+    stats_end(log_stats(log), STATS_EXTRACT, &mark, donor->fd44ModuleSize, donor->hasGbe + donor->hasSLIC + (donor->fd44Module != NULL));
+    return result;
+}
+
+/* Frees memory allocated for donor data */
+void fd44_donor_free(FD44_DONOR* donor)
+{
+    if (!donor)
+        return;
+    free(donor->fd44Module);
+    donor->fd44Module = NULL;
+}
+
+/* Merges data extracted from many input files of the same motherboard, every field is selected independently.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error */
+int fd44_donor_merge(const FD44_DONOR* donors, uint32_t count, const FD44_OPTIONS* options, FD44_DONOR* donor, int32_t* sources, FD44_LOG* log)
+{
+    int8_t hasModule = 0;                                                 /* flag that any input file has FD44 module, even an empty one */
+    uint32_t i;
+
+    if (donor)
+        memset(donor, 0, sizeof(FD44_DONOR));
+    if (!donors || !count || !options || !donor || !sources)
+        return FD44_ERR_ARGS;
+    for (i = 0; i < FD44_FIELD_COUNT; i++)
+        sources[i] = -1;
+
+    /* Motherboard name is stored only if it is checked, input files are compared by caller, which can name them */
+    memcpy(donor->motherboardName, donors[0].motherboardName, sizeof(donor->motherboardName));
+
+    for (i = 0; i < count; i++)
+    {
+        const FD44_DONOR* current = &donors[i];
+
+        /* MAC address stub is used only if no input file has a real one */
+        if (options->copyGbe && current->hasGbe && (sources[FD44_FIELD_GBE] < 0
+            || (!memcmp(donor->gbeMac, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)) && memcmp(current->gbeMac, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)))))
+        {
+            memcpy(donor->gbeMac, current->gbeMac, GBE_MAC_LENGTH);
+            donor->hasGbe = 1;
+            sources[FD44_FIELD_GBE] = (int32_t)i;
+        }
+
+        /* SLIC modules are preferred to ASUSBKP module, as extract does in one input file */
+        if (options->copySLIC && current->hasSLIC && (sources[FD44_FIELD_SLIC] < 0 || (donor->isSlicFromAsusbkp && !current->isSlicFromAsusbkp)))
+        {
+            memcpy(donor->slicPubkey, current->slicPubkey, sizeof(donor->slicPubkey));
+            memcpy(donor->slicMarker, current->slicMarker, sizeof(donor->slicMarker));
+            donor->hasSLIC = 1;
+            donor->isSlicFromAsusbkp = current->isSlicFromAsusbkp;
+            sources[FD44_FIELD_SLIC] = (int32_t)i;
+        }
+
+        if (options->copyModule && (current->isModuleEmpty || current->fd44Module))
+            hasModule = 1;
+        if (options->copyModule && current->fd44Module && sources[FD44_FIELD_MODULE] < 0)
+        {
+            donor->fd44Module = (uint8_t*)malloc(current->fd44ModuleSize);
+            if (!donor->fd44Module)
+            {
+                fd44_log_printf(log, "Can't allocate memory for FD44 module.\nFD44 module can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+            memcpy(donor->fd44Module, current->fd44Module, current->fd44ModuleSize);
+            donor->fd44ModuleSize = current->fd44ModuleSize;
+            sources[FD44_FIELD_MODULE] = (int32_t)i;
+        }
+    }
+
+    /* Modules are empty only if every found module is empty, otherwise missing module is reported by check_donor */
+    if (hasModule && !donor->fd44Module)
+    {
+        donor->isModuleEmpty = 1;
+        fd44_log_printf(log, "FD44 modules are empty in all input files. Data restoration required.\nUse FD44Editor to restore your data.\n");
+    }
+    return check_donor(options, donor, log);
+}
+
+/* Prints failed integrity checks, offsets relative to verified buffer are shifted by shift in messages.
+ * Returns FD44_OK if there are no failures or FD44_ERR_INTEGRITY if there are */
+static int report_failures(const FFS_VERIFY* verify, int64_t shift, FD44_LOG* log)
+{
+    uint32_t i;
+
+    for (i = 0; i < verify->failureCount && i < FFS_VERIFY_FAILURES; i++)
+    {
+        const FFS_FAILURE* failure = &verify->failures[i];
+        uint32_t offset = (uint32_t)(failure->offset + shift);
+        uint32_t volume = (uint32_t)(failure->volume + shift);
+
+        switch (failure->check)
+        {
+        case FFS_CHECK_VOLUME_CHECKSUM:
+            fd44_log_printf(log, "Volume at %08X has header checksum %04X, but %04X is expected.\n", offset, failure->stored, failure->expected);
+            break;
+        case FFS_CHECK_HEADER_CHECKSUM:
+            fd44_log_printf(log, "File at %08X has header checksum %02X, but %02X is expected.\n", offset, failure->stored, failure->expected);
+            break;
+        case FFS_CHECK_DATA_CHECKSUM:
+            fd44_log_printf(log, "File at %08X has data checksum %02X, but %02X is expected.\n", offset, failure->stored, failure->expected);
+            break;
+        case FFS_CHECK_FILE_LAYOUT:
+            fd44_log_printf(log, "File at %08X has invalid size or doesn't fit into volume at %08X.\n", offset, volume);
+            break;
+        case FFS_CHECK_FREE_SPACE:
+            fd44_log_printf(log, "Free space of volume at %08X has byte %02X at %08X, but it must be %02X.\n", volume, failure->stored, offset, failure->expected);
+            break;
+        }
+    }
+    if (!verify->failureCount)
+        return FD44_OK;
+
+    if (verify->failureCount > FFS_VERIFY_FAILURES)
+        fd44_log_printf(log, "%u more integrity checks failed.\n", verify->failureCount - FFS_VERIFY_FAILURES);
+    fd44_log_printf(log, "Patched output file failed integrity verification.\n");
+    return FD44_ERR_INTEGRITY;
+}
+
+/* Verifies checksums and free space of changed volumes and files, or of all of them.
+ * Returns FD44_OK if all checks pass, FD44_ERR_INTEGRITY if any check fails or FD44_ERR_ARGS on error */
+int fd44_verify(const FD44_IMAGE* context, int8_t mode, FD44_LOG* log)
+{
+    FFS_VERIFY verify;
+    STATS_MARK mark;
+    uint32_t base;                                                        /* offset of BIOS data in loaded file */
+    uint32_t i;
+
+    if (!context || !context->buffer || mode < FD44_VERIFY_NONE || mode > FD44_VERIFY_ALL)
+        return FD44_ERR_ARGS;
+    if (mode == FD44_VERIFY_NONE || (mode == FD44_VERIFY_TOUCHED && !context->image.dirtyCount))
+        return FD44_OK;
+
+    /* Changed ranges are relative to loaded file, so volumes are verified in it and offsets are shifted to BIOS data in messages */
+    stats_begin(log_stats(log), &mark);
+    base = (uint32_t)(context->buffer - context->image.data);
+    ffs_verify_init(&verify, mode == FD44_VERIFY_ALL ? NULL : context->image.dirty, context->image.dirtyCount);
+    for (i = 0; i < context->index.volumeCount; i++)
+        ffs_verify_volume(&verify, context->image.data, base + context->index.volumes[i].offset, context->index.volumes[i].length);
+    stats_end(log_stats(log), STATS_VERIFY, &mark, verify.bytes, verify.volumeCount + verify.fileCount);
+
+    return report_failures(&verify, -(int64_t)base, log);
+}
+
+/* Copies donor data to output file image in memory, fd44_apply without statistics.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int apply(FD44_IMAGE* context, const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log)
+{
+    IMAGE* image;                                                         /* loaded file, patched in memory */
+    uint8_t* buffer;                                                      /* BIOS data */
+    uint8_t* end;                                                         /* end of BIOS data */
+    uint8_t* bootefi;                                                     /* BOOTEFI header */
+    const SCAN_RESULT* hits;                                              /* signatures found in BIOS data */
+    int result;                                                           /* helper result */
+
+    if (!context || !context->bootefi || !options || !donor || !(context->image.flags & IMAGE_WRITABLE) || (context->image.flags & IMAGE_TEMPLATE))
+        return FD44_ERR_ARGS;
+    image = &context->image;
+    buffer = context->buffer;
+    end = buffer + context->size;
+    bootefi = context->bootefi;
+    hits = &context->hits;
+
+    /* Checking that donor has all requested data, donor loaded from bundle could be extracted with other options */
+    result = check_donor(options, donor, log);
+    if (result != FD44_OK)
+        return result;
+
+    /* Checking motherboard name */
+    if (!options->skipMotherboardNameCheck)
+    {
+        result = fd44_check_board(donor->motherboardName, bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET, log);
+        if (result != FD44_OK)
+            return result;
+    }
+
+    /* If input file had GbE block, searching for it in output file and replacing it */
+    if (options->copyGbe && donor->hasGbe)
+    {
+        /* First GbE block */
+        uint8_t* gbe = context->gbe[0];
+        if (!gbe)
+        {
+            fd44_log_printf(log, "GbE region not found in output file.\n");
+            return FD44_ERR_NO_GBE;
+        }
+        if (!image_patch(image, gbe + GBE_MAC_OFFSET, donor->gbeMac, sizeof(donor->gbeMac)))
+        {
+            fd44_log_printf(log, "Memcpy failed.\nGbE MAC can't be copied.\n");
+            return FD44_ERR_MEMORY;
+        }
+
+        /* Second GbE block */
+        gbe = context->gbe[1];
+        
+        if (gbe && !image_patch(image, gbe + GBE_MAC_OFFSET, donor->gbeMac, sizeof(donor->gbeMac)))
+        {
+            fd44_log_printf(log, "Memcpy failed.\nGbE MAC can't be copied.\n");
+            return FD44_ERR_MEMORY;
+        }
+        
+        fd44_log_printf(log, "GbE MAC address copied.\n");
+    }
+
+    /* Searching for EFI volume containing MSOA module and add SLIC pubkey and marker modules if found */
+    if (options->copySLIC && donor->hasSLIC)
+    {
+        const FFS_VOLUME* volume;
+        uint32_t volume_index;
+        uint8_t* pubkey_module;
+        uint8_t* marker_module;
+        STATS_MARK mark;
+        
+        do
+        {
+            /* Searching for existing SLIC modules */
+            pubkey_module = find_hit(hits, buffer, SIG_SLIC_PUBKEY, buffer, end);
+            marker_module = find_hit(hits, buffer, SIG_SLIC_MARKER, buffer, end);
+            if (pubkey_module ||  marker_module)
+            {
+                fd44_log_printf(log, "SLIC pubkey or marker found in output file.\nSLIC table copy is not needed.\n");
+                break;
+            }
+
+            /* Looking up second EFI volume to insert SLIC */
+            if (!ffs_find_volume(&context->index, 0))
+            {
+                fd44_log_printf(log, "First EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
+                break;
+            }
+            volume = ffs_find_volume(&context->index, 1);
+            if (!volume)
+            {
+                fd44_log_printf(log, "Second EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
+                break;
+            }
+            volume_index = (uint32_t)(volume - context->index.volumes);
+
+            /* Looking up DummyMSOA or MSOA module */
+            if (!ffs_find_file(&context->index, buffer, DUMMY_MSOA_MODULE_HEADER, volume_index, NULL)
+                && !ffs_find_file(&context->index, buffer, MSOA_MODULE_HEADER, volume_index, NULL))
+            {
+                fd44_log_printf(log, "DummyMSOA and MSOA module not found in first EFI volume.\nSLIC table can't be copied.\n");
+                break;
+            }
+
+            /* Inserting pubkey and marker modules to free space after the last file of EFI volume with MSOA module */
+            stats_begin(log_stats(log), &mark);
+            result = find_slic_space(buffer, volume, &pubkey_module, &marker_module);
+            stats_end(log_stats(log), STATS_FREE_SPACE, &mark, marker_module + SLIC_MARKER_LENGTH - pubkey_module, 1);
+            if (!result)
+            {
+                fd44_log_printf(log, "Not enough free space to insert SLIC modules.\nSLIC table can't be copied.\n");
+                break;
+            }
+            result = insert_slic(image, pubkey_module, marker_module, donor, log);
+            if (result != FD44_OK)
+                return result;
+        } while (0); /* Used for break */
+    }
+
+    /* Searching for module header */
+    if (options->copyModule)
+    {
+        int8_t isCopied;
+        uint32_t currentModuleSize;
+        uint8_t* fd44 = find_fd44_module(context, buffer);
+        if (!fd44)
+        {
+            fd44_log_printf(log, "FD44 module not found in output file.\n");
+            return FD44_ERR_NO_FD44_MODULE;
+        }
+
+        if (!donor->isModuleEmpty)
+        {
+            /* Copying data to all BSA_ modules */
+            isCopied = 0;
+            while (fd44)
+            {
+                /* Getting module size */
+                size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &currentModuleSize);
+                result = copy_fd44_module(image, fd44, (uint32_t)(fd44 - buffer), donor, &isCopied, log);
+                if (result == FD44_ERR_NO_FD44_MODULE)
+                    break;
+                if (result != FD44_OK)
+                    return result;
+            
+                fd44 = find_fd44_module(context, fd44 + (currentModuleSize > FD44_MODULE_HEADER_LENGTH ? currentModuleSize : FD44_MODULE_HEADER_LENGTH));
+            }
+                
+            /* Checking if there is at least one non-empty module after copying */
+            if(isCopied)
+                fd44_log_printf(log, "FD44 module copied.\n");
+            else
+            {
+                fd44_log_printf(log, "FD44 module can't be copied.\n");
+                return FD44_ERR_NO_FD44_MODULE;
+            }
+        }
+    }
+
+    return FD44_OK;
+}
+
+/* Copies donor data to output file image in memory.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_apply(FD44_IMAGE* context, const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log)
+{
+    STATS_MARK mark;
+    uint64_t bytes = 0;                                                   /* number of changed bytes */
+    uint32_t i;
+    int result;
+
+    stats_begin(log_stats(log), &mark);
+    result = apply(context, options, donor, log);
+    if (context)
+        for (i = 0; i < context->image.dirtyCount; i++)
+            bytes += context->image.dirty[i].length;
+    stats_end(log_stats(log), STATS_PATCH, &mark, bytes, context ? context->image.dirtyCount : 0);
+
+    /* Checking that patched files and volumes are still valid */
+    if (result == FD44_OK && options->verify != FD44_VERIFY_NONE)
+        result = fd44_verify(context, options->verify, log);
+    return result;
+}
+
+/* Returns BIOS data of image without capsule header and stores its size to *size */
+const uint8_t* fd44_data(const FD44_IMAGE* context, uint32_t* size)
+{
+    if (!context)
+        return NULL;
+    if (size)
+        *size = context->size;
+    return context->buffer;
+}
+
+/* Stores SHA-256 of the whole file as it was loaded to digest.
+ * Returns 1 on success and 0 if image is not loaded with IMAGE_HASH flag */
+int fd44_file_hash(const FD44_IMAGE* image, uint8_t* digest)
+{
+    if (!image || !image->image.data || !(image->image.flags & IMAGE_HASH))
+        return 0;
+    memcpy(digest, image->image.sha256, HASH_SHA256_LENGTH);
+    return 1;
+}
+
+/* Writes changed output file image back to its file, or to another file if path is not NULL.
+ * SHA-256 of the written file is stored to digest if it is not NULL.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_save(const FD44_IMAGE* context, const char* path, uint8_t* digest, FD44_LOG* log)
+{
+    uint32_t offset;                                                      /* size of removed capsule header */
+    int status;                                                           /* image operation result */
+    uint64_t bytes = 0;                                                   /* number of written bytes */
+    uint32_t i;
+    STATS_MARK mark;                                                      /* start of writing */
+
+    if (!context || !context->buffer)
+        return FD44_ERR_ARGS;
+
+    /* Writing modified ranges to output file, or replacing the whole file if capsule header is removed or file is saved as another one */
+    offset = (uint32_t)(context->buffer - context->image.data);
+    stats_begin(log_stats(log), &mark);
+    if (path)
+        status = image_save(&context->image, path, offset, digest);
+    else
+        status = image_write(&context->image, context->path, offset, digest);
+    if (path || offset)
+        bytes = context->size;
+    else
+        for (i = 0; i < context->image.dirtyCount; i++)
+            bytes += context->image.dirty[i].length;
+    stats_end(log_stats(log), STATS_WRITE, &mark, bytes, (path || offset) ? 1 : context->image.dirtyCount);
+    if (status == IMAGE_ERR_MEMORY)
+    {
+        fd44_log_printf(log, "Can't allocate memory for output file.\n");
+        return FD44_ERR_MEMORY;
+    }
+    if (status != IMAGE_OK)
+    {
+        fd44_log_perror(log, "Can't write output file.\n");
+        return FD44_ERR_OUTPUT_FILE;
+    }
+
+    if (context->hasCapsuleHeader)
+        fd44_log_printf(log, "Capsule file header removed.\n");
+    return FD44_OK;
+}
+
+/* Closes image and frees all its data */
+void fd44_close(FD44_IMAGE* context)
+{
+    if (!context)
+        return;
+    ffs_index_free(&context->index);
+    scan_result_free(&context->hits);
+    image_close(&context->image);
+    free(context->path);
+    memset(context, 0, sizeof(FD44_IMAGE));
+}
+
+/* Probing window sizes */
+#define PROBE_WINDOW    0x40000                                           /* window size */
+#define PROBE_TAIL      (BOOTEFI_MOTHERBOARD_NAME_OFFSET + BOOTEFI_MOTHERBOARD_NAME_LENGTH + 1) /* bytes of BOOTEFI block needed to read motherboard name */
+
+/* Searches window of file data at offset for BOOTEFI header and stores motherboard name to probe if it is found.
+ * Capsule header of output file is skipped by setting *start when the first window is searched.
+ * Headers starting in the last PROBE_TAIL bytes of window are searched again in the next window unless eof is set, so the name is read whole.
+ * Returns 1 if header is found and 0 if it isn't, *used is set to number of bytes not needed by the next window then */
+static int probe_window(FD44_PROBE* probe, uint8_t* window, uint32_t size, uint32_t offset, int8_t eof, int8_t isOutput, uint64_t fileSize, uint32_t* start, uint32_t* used)
+{
+    uint8_t* begin;
+    uint8_t* limit;
+    uint8_t* end = window + size;
+    uint8_t* bootefi;
+
+    /* Skipping capsule header of output file, as fd44_open removes it */
+    if (!offset && isOutput && fileSize >= sizeof(APTIO_CAPSULE_HEADER) && size >= sizeof(APTIO_CAPSULE_HEADER)
+        && !memcmp(window, APTIO_CAPSULE_GUID, sizeof(APTIO_CAPSULE_GUID))
+        && ((APTIO_CAPSULE_HEADER*)window)->RomImageOffset < fileSize)
+        *start = ((APTIO_CAPSULE_HEADER*)window)->RomImageOffset;
+
+    begin = window + (*start > offset ? *start - offset : 0);
+    limit = (eof || size < PROBE_TAIL) ? end : end - PROBE_TAIL;
+    if (begin > limit)
+        begin = limit;
+    *used = (uint32_t)(limit - window);
+    bootefi = find_signature(begin, limit + sizeof(BOOTEFI_HEADER) - 1 < end ? limit + sizeof(BOOTEFI_HEADER) - 1 : end, SIG_BOOTEFI);
+    if (!bootefi)
+        return 0;
+
+    /* Name is copied as fd44_extract does, bytes after the end of file are left zero */
+    if (end - bootefi > BOOTEFI_MOTHERBOARD_NAME_OFFSET)
+        memcpy(probe->motherboardName, bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET,
+               end - bootefi >= PROBE_TAIL ? BOOTEFI_MOTHERBOARD_NAME_LENGTH + 1 : (uint32_t)(end - bootefi) - BOOTEFI_MOTHERBOARD_NAME_OFFSET);
+    probe->motherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH] = 0;
+    probe->bootefiOffset = offset + (uint32_t)(bootefi - window) - *start;
+    return 1;
+}
+
+/* Reads BIOS image file only until its BOOTEFI header is found, so incompatible files are rejected before loading.
+ * Mapped files are searched in place, only pages before the header are read. Files that must not be mapped are read window by window.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_probe(const char* path, uint32_t flags, FD44_PROBE* probe, FD44_LOG* log)
+{
+    int8_t isOutput = (flags & IMAGE_WRITABLE) != 0;                      /* flag that file is output file */
+    const char* name = isOutput ? "output" : "input";                     /* file role used in messages */
+    int error = isOutput ? FD44_ERR_OUTPUT_FILE : FD44_ERR_INPUT_FILE;    /* result of file errors */
+    uint32_t start = 0;                                                   /* offset of BIOS data, non-zero if capsule header is skipped */
+    uint32_t used;                                                        /* bytes of window already searched */
+    int found = 0;                                                        /* flag that BOOTEFI header is found */
+    int result = FD44_OK;
+    STATS_MARK mark;
+
+    memset(probe, 0, sizeof(FD44_PROBE));
+    if (!path)
+        return FD44_ERR_ARGS;
+    stats_begin(log_stats(log), &mark);
+
+    if (!(flags & IMAGE_NO_MMAP))
+    {
+        /* Searching mapped file as one window */
+        IMAGE image;
+        int status = image_open(&image, path, 0);
+        if (status == IMAGE_ERR_OPEN)
+        {
+            fd44_log_perror(log, isOutput ? "Can't open output file.\n" : "Can't open input file.\n");
+            return error;
+        }
+        if (status == IMAGE_ERR_MEMORY)
+        {
+            fd44_log_printf(log, "Can't allocate memory for %s file.\n", name);
+            return FD44_ERR_MEMORY;
+        }
+        if (status != IMAGE_OK)
+        {
+            fd44_log_perror(log, isOutput ? "Can't read output file.\n" : "Can't read input file.\n");
+            return error;
+        }
+        found = probe_window(probe, image.data, image.size, 0, 1, isOutput, image.size, &start, &used);
+        probe->read = found && probe->bootefiOffset + start + PROBE_TAIL < image.size ? probe->bootefiOffset + start + PROBE_TAIL : image.size;
+        image_close(&image);
+    }
+    else
+    {
+        /* Reading file window by window */
+        STREAM stream;
+        FILE* file;
+        long size;
+
+        file = fopen(path, "rb");
+        if (!file)
+        {
+            fd44_log_perror(log, isOutput ? "Can't open output file.\n" : "Can't open input file.\n");
+            return error;
+        }
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (!stream_init(&stream, file, NULL, PROBE_WINDOW))
+        {
+            fd44_log_printf(log, "Can't allocate memory for %s file.\n", name);
+            fclose(file);
+            return FD44_ERR_MEMORY;
+        }
+        while (!found)
+        {
+            if (!stream_fill(&stream))
+            {
+                fd44_log_perror(log, isOutput ? "Can't read output file.\n" : "Can't read input file.\n");
+                result = error;
+                break;
+            }
+            found = probe_window(probe, stream.window.data, stream.window.size, stream.offset, stream.eof, isOutput, (uint64_t)size, &start, &used);
+            if (found || stream.eof)
+                break;
+            stream_drop(&stream, used, 0);
+        }
+        probe->read = stream.offset + stream.window.size;
+        stream_free(&stream);
+        fclose(file);
+    }
+
+    if (result == FD44_OK && !found)
+    {
+        fd44_log_printf(log, "ASUS BIOS file signature not found in %s file.\n", name);
+        result = error;
+    }
+    stats_end(log_stats(log), STATS_PROBE, &mark, probe->read, found);
+    return result;
+}
+
+/* Compares motherboard name at targetName with motherboardName up to the zero terminating motherboardName,
+ * names are at most BOOTEFI_MOTHERBOARD_NAME_LENGTH bytes long, so a name filling the whole field is compared without terminator.
+ * Returns 1 if names are the same and 0 if they aren't */
+int fd44_same_board(const uint8_t* motherboardName, const uint8_t* targetName)
+{
+    uint32_t length = 0;                                                  /* length of donor name */
+
+    while (length < BOOTEFI_MOTHERBOARD_NAME_LENGTH && motherboardName[length])
+        length++;
+    return !memcmp(motherboardName, targetName, length);
+}
+
+/* Checks that output file with motherboard name at targetName is made for motherboard named motherboardName, as fd44_apply does.
+ * Returns FD44_OK if it is or FD44_ERR_DIFFERENT_BOARD if it isn't */
+int fd44_check_board(const uint8_t* motherboardName, const uint8_t* targetName, FD44_LOG* log)
+{
+    if (!motherboardName || !targetName)
+        return FD44_ERR_ARGS;
+    if (!fd44_same_board(motherboardName, targetName))
+    {
+        fd44_log_printf(log, "Motherboard name in output file differs from motherboard name in input file.\n");
+        return FD44_ERR_DIFFERENT_BOARD;
+    }
+    return FD44_OK;
+}
+
+/* Streaming window sizes */
+#define STREAM_WINDOW   0x100000                                          /* initial window size */
+#define STREAM_TAIL     0x1000                                            /* bytes after signature that are in window when it is handled */
+#define STREAM_HISTORY  0x10                                              /* bytes before signature kept in window, GbE MAC is stored before GbE header */
+#define STREAM_MAX_LOAD 0x4000000                                         /* largest volume loaded to window as a whole, larger ones are passed through */
+
+/* File processed as a stream, either input file data is extracted from or output file that is patched */
+typedef struct _STREAM_STATE {
+    const FD44*         fd44;                                             /* library state */
+    const FD44_OPTIONS* options;                                          /* copying options */
+    FD44_DONOR*         donor;                                            /* donor being extracted, NULL if output file is patched */
+    const FD44_DONOR*   source;                                           /* donor being applied, NULL if input file is extracted */
+    FD44_LOG*           log;                                              /* messages */
+    STREAM              stream;                                           /* file window */
+    SCAN_RESULT         hits;                                             /* signatures found in window */
+    uint32_t            done;                                             /* signatures starting before this offset are handled */
+    uint32_t            nextVolume;                                       /* offset of volume that may follow the last one back to back */
+    uint32_t            ffsVolumes;                                       /* number of handled volumes with FFS file system */
+    uint32_t            gbeRegionEnd;                                     /* end of GbE region from flash descriptor, 0 if there is none */
+    uint32_t            gbeBank[GBE_BANK_COUNT];                          /* offsets of GbE headers of both banks from flash descriptor */
+    uint32_t            gbeCount;                                         /* number of handled GbE headers */
+    int8_t              gbeFallback;                                      /* flag that GbE headers outside of descriptor GbE region are used */
+    uint8_t             gbeMac[GBE_BANK_COUNT][GBE_MAC_LENGTH];           /* MAC of every handled GbE header of input file */
+    uint32_t            nextFd44;                                         /* FD44 modules starting before this offset are skipped */
+    int8_t              hasFd44;                                          /* flag that FD44 module is found */
+    int8_t              fd44Stopped;                                      /* flag that too small FD44 module stopped copying */
+    int8_t              fd44Copied;                                       /* flag that FD44 module data is copied at least once */
+    int8_t              hasBootefi;                                       /* flag that BOOTEFI header is handled */
+    int8_t              hasSlicPubkey;                                    /* flag that SLIC pubkey is found, or any SLIC module in output file */
+    int8_t              hasSlicMarker;                                    /* flag that SLIC marker is found */
+    int8_t              slicInserted;                                     /* flag that SLIC modules are inserted to output file */
+    int8_t              hasAsusbkp;                                       /* flag that ASUSBKP module is found in input file */
+    int8_t              hasAsusbkpPubkey;                                 /* flag that SLIC pubkey is found in ASUSBKP module */
+    int8_t              hasAsusbkpMarker;                                 /* flag that SLIC marker is found in ASUSBKP module */
+    uint8_t             asusbkpPubkey[SLIC_PUBKEY_LENGTH                  /* SLIC pubkey-*/
+                                      - sizeof(SLIC_PUBKEY_HEADER)          /* from-------*/
+                                      - sizeof(SLIC_PUBKEY_PART1)];         /* ASUSBKP----*/
+    uint8_t             asusbkpMarker[SLIC_MARKER_LENGTH                  /* SLIC marker-*/
+                                      - sizeof(SLIC_MARKER_HEADER)          /* from-------*/
+                                      - sizeof(SLIC_MARKER_PART1)];         /* ASUSBKP----*/
+} STREAM_STATE;
+
+/* Checks if GbE header at offset is one of GbE banks.
+ * Banks from flash descriptor are used if it has GbE region, signatures after the region are used only if there are none,
+ * signatures before the end of the region are never used in that case.
+ * Returns 1 if it is and 0 if it isn't */
+static int stream_gbe_bank(STREAM_STATE* state, uint32_t offset)
+{
+    uint32_t i;
+
+    if (state->gbeCount >= GBE_BANK_COUNT)
+        return 0;
+    if (!state->gbeRegionEnd || state->gbeFallback)
+        return 1;
+    if (offset < state->gbeRegionEnd)
+    {
+        for (i = 0; i < GBE_BANK_COUNT; i++)
+            if (state->gbeBank[i] == offset)
+                return 1;
+        return 0;
+    }
+    state->gbeFallback = !state->gbeCount;
+    return state->gbeFallback;
+}
+
+/* Handles signature found in stream, available is number of bytes in window starting from data.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int stream_signature(STREAM_STATE* state, uint32_t signature, uint8_t* data, uint32_t offset, uint32_t available)
+{
+    const FD44_OPTIONS* options = state->options;
+
+    switch (signature)
+    {
+    case SIG_BOOTEFI:
+        if (state->hasBootefi || available < BOOTEFI_MOTHERBOARD_NAME_OFFSET + BOOTEFI_MOTHERBOARD_NAME_LENGTH)
+            break;
+        state->hasBootefi = 1;
+        if (options->skipMotherboardNameCheck)
+            break;
+        if (state->donor)
+            memcpy(state->donor->motherboardName, data + BOOTEFI_MOTHERBOARD_NAME_OFFSET, BOOTEFI_MOTHERBOARD_NAME_LENGTH);
+        else if (fd44_check_board(state->source->motherboardName, data + BOOTEFI_MOTHERBOARD_NAME_OFFSET, state->log) != FD44_OK)
+        {
+            return FD44_ERR_DIFFERENT_BOARD;
+        }
+        break;
+
+    case SIG_GBE:
+        if (!options->copyGbe || !stream_gbe_bank(state, offset))
+            break;
+        if (state->donor)
+            memcpy(state->gbeMac[state->gbeCount], data + GBE_MAC_OFFSET, GBE_MAC_LENGTH);
+        else if (state->source->hasGbe)
+        {
+            if (!image_patch(&state->stream.window, data + GBE_MAC_OFFSET, state->source->gbeMac, sizeof(state->source->gbeMac)))
+            {
+                fd44_log_printf(state->log, "Memcpy failed.\nGbE MAC can't be copied.\n");
+                return FD44_ERR_MEMORY;
+            }
+            if (!state->gbeCount)
+                fd44_log_printf(state->log, "GbE MAC address copied.\n");
+        }
+        state->gbeCount++;
+        break;
+
+    case SIG_SLIC_PUBKEY:
+    case SIG_SLIC_MARKER:
+        if (!options->copySLIC)
+            break;
+        if (!state->donor)
+        {
+            /* SLIC modules after the inserted ones can't be found before output is written */
+            if (state->slicInserted)
+            {
+                fd44_log_printf(state->log, "SLIC pubkey or marker found in output file after SLIC table was inserted.\nOutput file is not valid.\n");
+                return FD44_ERR_OUTPUT_FILE;
+            }
+            state->hasSlicPubkey = 1;
+        }
+        else if (signature == SIG_SLIC_PUBKEY && !state->hasSlicPubkey && available >= SLIC_PUBKEY_LENGTH)
+        {
+            memcpy(state->donor->slicPubkey, data + sizeof(SLIC_PUBKEY_HEADER) + sizeof(SLIC_PUBKEY_PART1), sizeof(state->donor->slicPubkey));
+            state->hasSlicPubkey = 1;
+        }
+        else if (signature == SIG_SLIC_MARKER && !state->hasSlicMarker && available >= SLIC_MARKER_LENGTH)
+        {
+            memcpy(state->donor->slicMarker, data + sizeof(SLIC_MARKER_HEADER) + sizeof(SLIC_MARKER_PART1), sizeof(state->donor->slicMarker));
+            state->hasSlicMarker = 1;
+        }
+        break;
+
+    case SIG_ASUSBKP:
+        state->hasAsusbkp = 1;
+        break;
+
+    case SIG_ASUSBKP_PUBKEY:
+        if (state->donor && state->hasAsusbkp && !state->hasAsusbkpPubkey
+            && available >= sizeof(ASUSBKP_PUBKEY_HEADER) + sizeof(state->asusbkpPubkey))
+        {
+            memcpy(state->asusbkpPubkey, data + sizeof(ASUSBKP_PUBKEY_HEADER), sizeof(state->asusbkpPubkey));
+            state->hasAsusbkpPubkey = 1;
+        }
+        break;
+
+    case SIG_ASUSBKP_MARKER:
+        if (state->donor && state->hasAsusbkp && !state->hasAsusbkpMarker
+            && available >= sizeof(ASUSBKP_MARKER_HEADER) + sizeof(state->asusbkpMarker))
+        {
+            memcpy(state->asusbkpMarker, data + sizeof(ASUSBKP_MARKER_HEADER), sizeof(state->asusbkpMarker));
+            state->hasAsusbkpMarker = 1;
+        }
+        break;
+    }
+
+    return FD44_OK;
+}
+
+/* Handles FD44 module found in stream, available is number of bytes in window starting from fd44.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int stream_fd44(STREAM_STATE* state, uint8_t* fd44, uint32_t offset, uint32_t available)
+{
+    FD44_DONOR* donor = state->donor;
+    uint32_t currentModuleSize;
+    int result;
+
+    if (!state->options->copyModule || offset < state->nextFd44 || state->fd44Stopped || available < FD44_MODULE_HEADER_LENGTH)
+        return FD44_OK;
+    state->hasFd44 = 1;
+    size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &currentModuleSize);
+
+    /* Storing the first non-empty module of input file */
+    if (donor)
+    {
+        state->nextFd44 = offset + FD44_MODULE_HEADER_LENGTH;
+        if (!donor->isModuleEmpty || currentModuleSize <= FD44_MODULE_HEADER_LENGTH
+            || memcmp(fd44 + FD44_MODULE_HEADER_BSA_OFFSET, FD44_MODULE_HEADER_BSA, sizeof(FD44_MODULE_HEADER_BSA)))
+            return FD44_OK;
+        if (currentModuleSize > available)
+            currentModuleSize = available;
+
+        /* Looking for non-FF byte, no need to store FF bytes after the last non-FF byte of data */
+        fd44 += FD44_MODULE_HEADER_LENGTH;
+        if (!find_not_byte(fd44, fd44 + currentModuleSize - FD44_MODULE_HEADER_LENGTH, 0xFF))
+            return FD44_OK;
+        donor->isModuleEmpty = 0;
+        donor->fd44ModuleSize = rfind_not_byte(fd44, fd44 + currentModuleSize - FD44_MODULE_HEADER_LENGTH, 0xFF) - fd44 + 1;
+        donor->fd44Module = (uint8_t*)malloc(donor->fd44ModuleSize);
+        if (!donor->fd44Module)
+        {
+            fd44_log_printf(state->log, "Can't allocate memory for FD44 module.\nFD44 module can't be copied.\n");
+            return FD44_ERR_MEMORY;
+        }
+        memcpy(donor->fd44Module, fd44, donor->fd44ModuleSize);
+        return FD44_OK;
+    }
+
+    /* Copying data to all BSA_ modules of output file */
+    state->nextFd44 = offset + (currentModuleSize > FD44_MODULE_HEADER_LENGTH ? currentModuleSize : FD44_MODULE_HEADER_LENGTH);
+    if (state->source->isModuleEmpty)
+        return FD44_OK;
+    result = copy_fd44_module(&state->stream.window, fd44, offset, state->source, &state->fd44Copied, state->log);
+    if (result == FD44_ERR_NO_FD44_MODULE)
+        state->fd44Stopped = 1;
+    else if (result != FD44_OK)
+        return result;
+    return FD44_OK;
+}
+
+/* Handles firmware volume fully loaded to window, available is number of bytes in window starting from volume.
+ * Signatures in volume are handled in order, FD44 modules are taken from volume files if there are any.
+ * SLIC modules are inserted into free space of the second FFS volume of output file.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int stream_volume(STREAM_STATE* state, uint8_t* volume, uint32_t offset, uint32_t length, uint32_t available)
+{
+    FFS_INDEX index;
+    SCAN_RESULT hits;
+    const FFS_FILE* file;
+    uint8_t* pubkey_module;
+    uint8_t* marker_module;
+    int8_t isFfs;
+    int8_t hasFd44Files;
+    uint32_t i;
+    int result = FD44_OK;
+
+    memset(&index, 0, sizeof(index));
+    memset(&hits, 0, sizeof(hits));
+    if (!scanner_scan(&state->fd44->scanner, volume, volume + length, &hits) || !ffs_index_volume(&index, volume, length, 0))
+    {
+        fd44_log_printf(state->log, "Can't allocate memory for firmware volume at %08X.\n", offset);
+        scan_result_free(&hits);
+        ffs_index_free(&index);
+        return FD44_ERR_MEMORY;
+    }
+    isFfs = index.volumeCount && index.volumes[0].isFfs;
+    hasFd44Files = ffs_find_file(&index, volume, FD44_MODULE_HEADER, 0, NULL) != NULL;
+
+    for (i = 0; i < hits.count && result == FD44_OK; i++)
+    {
+        uint32_t hit = hits.hits[i].offset;
+        if (hits.hits[i].signature == SIG_EFI_VOLUME)
+            continue;
+        if (hits.hits[i].signature != SIG_FD44_MODULE)
+        {
+            result = stream_signature(state, hits.hits[i].signature, volume + hit, offset + hit, available - hit);
+            continue;
+        }
+
+        /* GUID matches inside of files are skipped */
+        if (hasFd44Files)
+        {
+            for (file = ffs_find_file(&index, volume, FD44_MODULE_HEADER, 0, NULL); file && file->offset != hit;
+                 file = ffs_find_file(&index, volume, FD44_MODULE_HEADER, 0, file))
+                ;
+            if (!file)
+                continue;
+        }
+        result = stream_fd44(state, volume + hit, offset + hit, length - hit);
+    }
+    scan_result_free(&hits);
+
+    if (result == FD44_OK && isFfs && state->ffsVolumes++ == 1 && !state->donor
+        && state->options->copySLIC && state->source->hasSLIC && !state->hasSlicPubkey)
+    {
+        if (!ffs_find_file(&index, volume, DUMMY_MSOA_MODULE_HEADER, 0, NULL) && !ffs_find_file(&index, volume, MSOA_MODULE_HEADER, 0, NULL))
+            fd44_log_printf(state->log, "DummyMSOA and MSOA module not found in first EFI volume.\nSLIC table can't be copied.\n");
+        else if (!find_slic_space(volume, &index.volumes[0], &pubkey_module, &marker_module))
+            fd44_log_printf(state->log, "Not enough free space to insert SLIC modules.\nSLIC table can't be copied.\n");
+        else
+        {
+            result = insert_slic(&state->stream.window, pubkey_module, marker_module, state->source, state->log);
+            state->slicInserted = (result == FD44_OK);
+        }
+    }
+
+    /* Verifying patched volume while it is in window, changed ranges of window are relative to window data */
+    if (result == FD44_OK && !state->donor && (state->options->verify == FD44_VERIFY_ALL
+        || (state->options->verify == FD44_VERIFY_TOUCHED && state->stream.window.dirtyCount)))
+    {
+        FFS_VERIFY verify;
+        STATS_MARK mark;
+        uint32_t start = (uint32_t)(volume - state->stream.window.data);
+
+        stats_begin(log_stats(state->log), &mark);
+        ffs_verify_init(&verify, state->options->verify == FD44_VERIFY_ALL ? NULL : state->stream.window.dirty, state->stream.window.dirtyCount);
+        ffs_verify_volume(&verify, state->stream.window.data, start, length);
+        stats_end(log_stats(state->log), STATS_VERIFY, &mark, verify.bytes, verify.volumeCount + verify.fileCount);
+        result = report_failures(&verify, (int64_t)offset - start, state->log);
+    }
+
+    ffs_index_free(&index);
+    return result;
+}
+
+/* Reads stream window by window and handles all signatures in order.
+ * Volumes and FD44 modules are loaded to window as a whole before they are handled,
+ * the rest of data is kept in window only until signatures in it are handled.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+static int stream_run(STREAM_STATE* state)
+{
+    STREAM* stream = &state->stream;
+    const char* name = state->donor ? "input" : "output";                 /* file role used in messages */
+    int error = state->donor ? FD44_ERR_INPUT_FILE : FD44_ERR_OUTPUT_FILE; /* result of file errors */
+    uint32_t offset;
+    uint32_t length;
+    uint32_t bank;
+
+    for (;;)
+    {
+        uint8_t* window;
+        uint32_t end;
+        uint32_t limit;
+        uint32_t base = state->done;
+        uint32_t i = 0;
+        int8_t hold = 0;
+
+        if (!stream_fill(stream))
+        {
+            fd44_log_perror(state->log, state->donor ? "Can't read input file.\n" : "Can't read output file.\n");
+            return error;
+        }
+        window = stream->window.data;
+        end = stream->offset + stream->window.size;
+        limit = stream->eof ? end : end - STREAM_TAIL;
+
+        /* Reading GbE region from flash descriptor at the beginning of data */
+        if (!stream->offset && !state->done
+            && descriptor_region(window, stream->eof ? end : 0xFFFFFFFF, FLASH_REGION_GBE, &offset, &length))
+        {
+            for (bank = 0; bank < GBE_BANK_COUNT; bank++)
+                state->gbeBank[bank] = offset + bank * (length / GBE_BANK_COUNT) - GBE_MAC_OFFSET;
+            state->gbeRegionEnd = offset + length;
+        }
+
+        state->hits.count = 0;
+        if (!scanner_scan(&state->fd44->scanner, window + (base - stream->offset), window + stream->window.size, &state->hits))
+        {
+            fd44_log_printf(state->log, "Can't allocate memory for %s file signatures.\n", name);
+            return FD44_ERR_MEMORY;
+        }
+
+        while (!hold)
+        {
+            uint32_t signature = SIG_EFI_VOLUME;
+            int8_t probe = 0;
+            int result;
+
+            /* Next signature or volume that may follow the last one */
+            while (i < state->hits.count && base + state->hits.hits[i].offset < state->done)
+                i++;
+            offset = i < state->hits.count ? base + state->hits.hits[i].offset : 0xFFFFFFFF;
+            if (i < state->hits.count)
+                signature = state->hits.hits[i].signature;
+            if (state->nextVolume >= state->done && state->nextVolume < offset)
+            {
+                offset = state->nextVolume;
+                signature = SIG_EFI_VOLUME;
+                probe = 1;
+            }
+            if (offset >= limit)
+                break;
+            if (!probe)
+                i++;
+
+            if (signature == SIG_EFI_VOLUME || (signature == SIG_FD44_MODULE && state->options->copyModule))
+            {
+                uint8_t* data = window + (offset - stream->offset);
+                if (signature == SIG_EFI_VOLUME)
+                {
+                    /* Length read from stream is bounded, so a corrupt header can't make window grow without limit */
+                    length = ffs_volume_length(data, stream->eof ? end - offset : STREAM_MAX_LOAD, 0);
+                    if (probe)
+                        state->nextVolume = 0xFFFFFFFF;
+                    if (!length)
+                        continue;
+                }
+                else
+                {
+                    size2int(data + FD44_MODULE_SIZE_OFFSET, &length);
+                    if (length < FD44_MODULE_HEADER_LENGTH)
+                        length = FD44_MODULE_HEADER_LENGTH;
+                }
+
+                /* Loading the whole structure to window and handling it from the beginning */
+                if (length > end - offset && !stream->eof)
+                {
+                    uint32_t keep = offset - stream->offset > STREAM_HISTORY ? STREAM_HISTORY : offset - stream->offset;
+                    if (!stream_drop(stream, offset - keep - stream->offset, 1))
+                    {
+                        fd44_log_perror(state->log, "Can't write output file.\n");
+                        return FD44_ERR_OUTPUT_FILE;
+                    }
+                    if (!stream_reserve(stream, keep + length + STREAM_TAIL))
+                    {
+                        fd44_log_printf(state->log, "Can't allocate memory for %s file window.\n", name);
+                        return FD44_ERR_MEMORY;
+                    }
+                    if (probe)
+                        state->nextVolume = offset;
+                    state->done = offset;
+                    hold = 1;
+                    continue;
+                }
+
+                if (signature == SIG_EFI_VOLUME)
+                {
+                    result = stream_volume(state, data, offset, length, end - offset);
+                    state->done = offset + length;
+                    state->nextVolume = offset + length;
+                }
+                else
+                    result = stream_fd44(state, data, offset, end - offset);
+            }
+            else
+                result = stream_signature(state, signature, window + (offset - stream->offset), offset, end - offset);
+            if (result != FD44_OK)
+                return result;
+        }
+        if (hold)
+            continue;
+
+        /* Writing handled data, bytes before signatures that are not handled yet are kept */
+        if (state->done < limit)
+            state->done = limit;
+        if (stream->eof)
+            break;
+        if (state->done - STREAM_HISTORY > stream->offset && !stream_drop(stream, state->done - STREAM_HISTORY - stream->offset, 1))
+        {
+            fd44_log_perror(state->log, "Can't write output file.\n");
+            return FD44_ERR_OUTPUT_FILE;
+        }
+    }
+
+    if (!stream_drop(stream, stream->window.size, 1) || (stream->output && fflush(stream->output)))
+    {
+        fd44_log_perror(state->log, "Can't write output file.\n");
+        return FD44_ERR_OUTPUT_FILE;
+    }
+    if (!state->hasBootefi)
+    {
+        fd44_log_printf(state->log, "ASUS BIOS file signature not found in %s file.\n", name);
+        return error;
+    }
+    return FD44_OK;
+}
+
+/* Extracts data to be copied from input file read from stream window by window.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error.
+ * Donor must be freed by fd44_donor_free in both cases */
+int fd44_stream_extract(const FD44* fd44, FILE* input, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log)
+{
+    STREAM_STATE state;
+    uint32_t bank;
+    int result;
+
+    if (!fd44 || !input || !options || !donor)
+        return FD44_ERR_ARGS;
+    memset(donor, 0, sizeof(FD44_DONOR));
+    memset(&state, 0, sizeof(state));
+    state.fd44 = fd44;
+    state.options = options;
+    state.donor = donor;
+    state.log = log;
+    state.nextVolume = 0xFFFFFFFF;
+    donor->isModuleEmpty = 1;
+    if (!stream_init(&state.stream, input, NULL, STREAM_WINDOW))
+    {
+        fd44_log_printf(log, "Can't allocate memory for input file window.\n");
+        return FD44_ERR_MEMORY;
+    }
+
+    result = stream_run(&state);
+    stream_free(&state.stream);
+    scan_result_free(&state.hits);
+    if (result != FD44_OK)
+        return result;
+
+    /* Using the second GbE bank if the first one is a stub */
+    if (options->copyGbe)
+    {
+        donor->hasGbe = state.gbeCount > 0;
+        if (donor->hasGbe)
+        {
+            bank = (!memcmp(state.gbeMac[0], GBE_MAC_STUB, sizeof(GBE_MAC_STUB)) && state.gbeCount > 1
+                    && memcmp(state.gbeMac[1], GBE_MAC_STUB, sizeof(GBE_MAC_STUB))) ? 1 : 0;
+            memcpy(donor->gbeMac, state.gbeMac[bank], GBE_MAC_LENGTH);
+        }
+        else if (!options->defaultOptions)
+        {
+            fd44_log_printf(log, "GbE region not found in input file, but required by -g option.\n");
+            return FD44_ERR_NO_GBE;
+        }
+    }
+
+    /* Using SLIC pubkey and marker from ASUSBKP module if SLIC modules are not found */
+    if (options->copySLIC)
+    {
+        if (state.hasSlicPubkey && state.hasSlicMarker)
+            donor->hasSLIC = 1;
+        else if (state.hasAsusbkpPubkey && state.hasAsusbkpMarker)
+        {
+            memcpy(donor->slicPubkey, state.asusbkpPubkey, sizeof(donor->slicPubkey));
+            memcpy(donor->slicMarker, state.asusbkpMarker, sizeof(donor->slicMarker));
+            donor->hasSLIC = 1;
+            donor->isSlicFromAsusbkp = 1;
+        }
+        if (!options->defaultOptions && !donor->hasSLIC)
+        {
+            fd44_log_printf(log, "SLIC pubkey and marker not found in input file, but required by -s option.\n");
+            return FD44_ERR_NO_SLIC;
+        }
+    }
+
+    if (options->copyModule)
+    {
+        if (!state.hasFd44)
+        {
+            fd44_log_printf(log, "FD44 module not found in input file.\n");
+            return FD44_ERR_NO_FD44_MODULE;
+        }
+        if (donor->isModuleEmpty)
+            fd44_log_printf(log, "FD44 modules are empty in input file. Data restoration required.\nUse FD44Editor to restore your data.\n");
+    }
+
+    return FD44_OK;
+}
+
+/* Copies donor data to output file read from input stream window by window and writes patched data to output stream.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_stream_apply(const FD44* fd44, FILE* input, FILE* output, const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log)
+{
+    STREAM_STATE state;
+    int8_t hasCapsuleHeader = 0;
+    int result;
+
+    if (!fd44 || !input || !output || !options || !donor)
+        return FD44_ERR_ARGS;
+    result = check_donor(options, donor, log);
+    if (result != FD44_OK)
+        return result;
+
+    memset(&state, 0, sizeof(state));
+    state.fd44 = fd44;
+    state.options = options;
+    state.source = donor;
+    state.log = log;
+    state.nextVolume = 0xFFFFFFFF;
+    if (!stream_init(&state.stream, input, output, STREAM_WINDOW))
+    {
+        fd44_log_printf(log, "Can't allocate memory for output file window.\n");
+        return FD44_ERR_MEMORY;
+    }
+
+    /* Removing capsule file header, offsets of BIOS data start after it */
+    if (!stream_fill(&state.stream))
+    {
+        fd44_log_perror(log, "Can't read output file.\n");
+        result = FD44_ERR_OUTPUT_FILE;
+    }
+    else if (state.stream.window.size >= sizeof(APTIO_CAPSULE_HEADER)
+        && !memcmp(state.stream.window.data, APTIO_CAPSULE_GUID, sizeof(APTIO_CAPSULE_GUID)))
+    {
+        APTIO_CAPSULE_HEADER* header = (APTIO_CAPSULE_HEADER*)state.stream.window.data;
+        if (header->RomImageOffset < state.stream.window.size)
+        {
+            hasCapsuleHeader = 1;
+            stream_drop(&state.stream, header->RomImageOffset, 0);
+            state.stream.offset = 0;
+        }
+    }
+
+    if (result == FD44_OK)
+        result = stream_run(&state);
+    stream_free(&state.stream);
+    scan_result_free(&state.hits);
+    if (result != FD44_OK)
+        return result;
+
+    if (options->copyGbe && donor->hasGbe && !state.gbeCount)
+    {
+        fd44_log_printf(log, "GbE region not found in output file.\n");
+        return FD44_ERR_NO_GBE;
+    }
+
+    if (options->copySLIC && donor->hasSLIC && !state.slicInserted)
+    {
+        if (state.hasSlicPubkey)
+            fd44_log_printf(log, "SLIC pubkey or marker found in output file.\nSLIC table copy is not needed.\n");
+        else if (!state.ffsVolumes)
+            fd44_log_printf(log, "First EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
+        else if (state.ffsVolumes == 1)
+            fd44_log_printf(log, "Second EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
+    }
+
+    if (options->copyModule)
+    {
+        if (!state.hasFd44)
+        {
+            fd44_log_printf(log, "FD44 module not found in output file.\n");
+            return FD44_ERR_NO_FD44_MODULE;
+        }
+        if (!donor->isModuleEmpty)
+        {
+            if (!state.fd44Copied)
+            {
+                fd44_log_printf(log, "FD44 module can't be copied.\n");
+                return FD44_ERR_NO_FD44_MODULE;
+            }
+            fd44_log_printf(log, "FD44 module copied.\n");
+        }
+    }
+
+    if (hasCapsuleHeader)
+        fd44_log_printf(log, "Capsule file header removed.\n");
+    return FD44_OK;
+}
+
+/* Frees collected messages */
+void fd44_log_free(FD44_LOG* log)
+{
+    if (!log)
+        return;
+    free(log->buffer);
+    log->buffer = NULL;
+    log->length = 0;
+    log->capacity = 0;
+}
@@ -0,0 +1,225 @@
+#ifndef FD44_H
+#define FD44_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bios.h"
+#include "image.h"
+#include "scan.h"
+#include "ffs.h"
+#include "stats.h"
+
+/* Return codes */
+#define FD44_OK                      0
+#define FD44_ERR_EMPTY_FD44_MODULE   1
+#define FD44_ERR_ARGS                2
+#define FD44_ERR_INPUT_FILE          3
+#define FD44_ERR_OUTPUT_FILE         4
+#define FD44_ERR_MEMORY              5
+#define FD44_ERR_NO_FD44_MODULE      6
+#define FD44_ERR_DIFFERENT_BOARD     7
+#define FD44_ERR_NO_GBE              8
+#define FD44_ERR_NO_SLIC             9
+#define FD44_ERR_INTEGRITY          10
+
+/* Integrity verification modes of patched output files */
+#define FD44_VERIFY_NONE             0                                    /* patched files are not verified */
+#define FD44_VERIFY_TOUCHED          1                                    /* changed files and volumes containing them are verified */
+#define FD44_VERIFY_ALL              2                                    /* all volumes and files are verified */
+
+/* Fields of donor data selected independently by fd44_donor_merge */
+#define FD44_FIELD_GBE               0                                    /* GbE MAC address */
+#define FD44_FIELD_SLIC              1                                    /* SLIC pubkey and marker */
+#define FD44_FIELD_MODULE            2                                    /* FD44 module */
+#define FD44_FIELD_COUNT             3
+
+/* Library state shared by all images, read-only after fd44_init */
+typedef struct _FD44 {
+    SCANNER scanner;                                                      /* multi-pattern signature scanner */
+    uint32_t scanThreads;                                                 /* number of threads scanning large images, 1 by default */
+    const char* cacheDir;                                                 /* directory of signature cache files, NULL if cache is not used */
+} FD44;
+
+/* Options of copying */
+typedef struct _FD44_OPTIONS {
+    int8_t   defaultOptions;                                              /* flag that program is ran with default options */
+    int8_t   copyModule;                                                  /* flag that FD44 module copying is requested */
+    int8_t   copyGbe;                                                     /* flag that GbE MAC copying is requested */
+    int8_t   copySLIC;                                                    /* flag that SLIC copying is requested */
+    int8_t   skipMotherboardNameCheck;                                    /* flag that motherboard name in output file doesn't need to be checked */
+    int8_t   verify;                                                      /* FD44_VERIFY_* mode of patched output file verification */
+} FD44_OPTIONS;
+
+/* Data extracted from input file, can be applied to any number of output files */
+typedef struct _FD44_DONOR {
+    uint8_t motherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH + 1];         /* motherboard name storage, always zero terminated */
+    int8_t hasGbe;                                                        /* flag that input file has GbE region */
+    int8_t hasSLIC;                                                       /* flag that input file has SLIC pubkey and marker */
+    int8_t isSlicFromAsusbkp;                                             /* flag that SLIC pubkey and marker are taken from ASUSBKP module */
+    int8_t isModuleEmpty;                                                 /* flag that FD44 module is empty in input file */
+    uint8_t gbeMac[GBE_MAC_LENGTH];                                       /* GbE MAC storage */
+    uint8_t slicPubkey[SLIC_PUBKEY_LENGTH                                 /* SLIC----*/
+                             - sizeof(SLIC_PUBKEY_HEADER)                       /* pubkey--*/
+                             - sizeof(SLIC_PUBKEY_PART1)];                      /* storage */
+    uint8_t slicMarker[SLIC_MARKER_LENGTH                                 /* SLIC----*/
+                             - sizeof(SLIC_MARKER_HEADER)                       /* marker--*/
+                             - sizeof(SLIC_MARKER_PART1)];                      /* storage */
+    uint8_t* fd44Module;                                                  /* FD44 module storage, allocated if module is not empty */
+    uint32_t fd44ModuleSize;                                              /* size of FD44 module */
+} FD44_DONOR;
+
+/* Motherboard name read from the beginning of BIOS image file without loading the whole file */
+typedef struct _FD44_PROBE {
+    uint8_t  motherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH + 1];        /* motherboard name storage, always zero terminated */
+    uint32_t bootefiOffset;                                               /* offset of BOOTEFI header from the beginning of BIOS data */
+    uint32_t read;                                                        /* number of bytes read to find it */
+} FD44_PROBE;
+
+/* Messages of library calls, printed to console immediately or collected to buffer, and their statistics */
+typedef struct _FD44_LOG {
+    int8_t   buffered;                                                    /* flag that messages are collected to buffer */
+    char*    buffer;                                                      /* collected messages */
+    uint32_t length;                                                      /* length of collected messages */
+    uint32_t capacity;                                                    /* size of allocated buffer */
+    STATS*   stats;                                                       /* time and counters of library call stages, NULL if not collected */
+} FD44_LOG;
+
+/* BIOS image opened once, with structures located by a single scan */
+typedef struct _FD44_IMAGE {
+    IMAGE       image;                                                    /* loaded file */
+    char*       path;                                                     /* path the file was loaded from */
+    uint8_t*    buffer;                                                   /* BIOS data without capsule header */
+    uint32_t    size;                                                     /* size of BIOS data */
+    int8_t      hasCapsuleHeader;                                         /* flag that capsule header is removed from data */
+    SCAN_RESULT hits;                                                     /* all signatures found in BIOS data */
+    FFS_INDEX   index;                                                    /* firmware volumes and their files */
+    uint8_t*    bootefi;                                                  /* BOOTEFI header */
+    uint8_t*    gbe[GBE_BANK_COUNT];                                      /* GbE headers in order of banks, NULL if not found */
+} FD44_IMAGE;
+
+/* Selects search and hash kernels for current CPU and builds signature scanner.
+ * Images are scanned by current thread until scanThreads is changed, scan results are cached only if cacheDir is set.
+ * Returns 1 on success and 0 on failure */
+int fd44_init(FD44* fd44);
+
+/* Frees library state */
+void fd44_free(FD44* fd44);
+
+/* Loads BIOS image file and locates all known structures in it.
+ * Images opened with IMAGE_WRITABLE flag are output files: capsule header is removed from their data
+ * and they can be changed by fd44_apply, other images are input files.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, image is closed in that case */
+int fd44_open(const FD44* fd44, FD44_IMAGE* image, const char* path, uint32_t flags, FD44_LOG* log);
+
+/* Makes independent copy of output file image with all located structures, so one loaded file can be patched many times.
+ * Source image is only read, so it can be cloned by many threads at the same time. Output files opened with IMAGE_TEMPLATE flag
+ * can't be patched themselves, but their clones share unchanged pages with them, so a clone takes only a few pages of memory.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, clone is closed in that case */
+int fd44_clone(const FD44_IMAGE* source, FD44_IMAGE* clone, FD44_LOG* log);
+
+/* Reads BIOS image file only until its BOOTEFI header is found, without loading and scanning the whole file,
+ * so files made for another motherboard can be rejected before they are opened by fd44_open.
+ * Files opened with IMAGE_WRITABLE flag are output files, their capsule header is skipped as fd44_open removes it.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, errors and their messages are the same as of fd44_open */
+int fd44_probe(const char* path, uint32_t flags, FD44_PROBE* probe, FD44_LOG* log);
+
+/* Compares motherboard name at targetName with motherboardName up to the zero terminating motherboardName
+ * and at most BOOTEFI_MOTHERBOARD_NAME_LENGTH bytes, as fd44_check_board does.
+ * Returns 1 if names are the same and 0 if they aren't */
+int fd44_same_board(const uint8_t* motherboardName, const uint8_t* targetName);
+
+/* Checks that output file with motherboard name at targetName is made for the motherboard named motherboardName,
+ * targetName is the name of FD44_PROBE or the name in BOOTEFI block of output file.
+ * Returns FD44_OK if it is or FD44_ERR_DIFFERENT_BOARD if it isn't */
+int fd44_check_board(const uint8_t* motherboardName, const uint8_t* targetName, FD44_LOG* log);
+
+/* Extracts data to be copied from input file image.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error.
+ * Donor must be freed by fd44_donor_free in both cases */
+int fd44_extract(const FD44_IMAGE* image, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log);
+
+/* Frees memory allocated for donor data */
+void fd44_donor_free(FD44_DONOR* donor);
+
+/* Merges data extracted from many input files of the same motherboard, which caller checks by fd44_same_board,
+ * every field is selected independently:
+ * the first GbE MAC address which is not a stub, SLIC pubkey and marker of SLIC modules before ones of ASUSBKP module,
+ * and the first non-empty FD44 module. Donors should be extracted with default options, so missing fields are not errors,
+ * requirements of options are checked after merging. Index of donor every field is taken from is stored to
+ * sources[FD44_FIELD_*], -1 if no donor has it.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error.
+ * Merged donor must be freed by fd44_donor_free in both cases */
+int fd44_donor_merge(const FD44_DONOR* donors, uint32_t count, const FD44_OPTIONS* options, FD44_DONOR* donor, int32_t* sources, FD44_LOG* log);
+
+/* Copies donor data to output file image in memory and verifies patched image in options->verify mode.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_apply(FD44_IMAGE* image, const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log);
+
+/* Verifies checksums of volume and file headers, file data checksums and free space of volumes.
+ * FD44_VERIFY_TOUCHED mode verifies only files changed by fd44_apply and volumes containing them, FD44_VERIFY_ALL verifies the whole image.
+ * Every failed check is reported with its offset.
+ * Returns FD44_OK if all checks pass, FD44_ERR_INTEGRITY if any check fails or FD44_ERR_ARGS on error */
+int fd44_verify(const FD44_IMAGE* image, int8_t mode, FD44_LOG* log);
+
+/* Returns BIOS data of image without capsule header and stores its size to *size */
+const uint8_t* fd44_data(const FD44_IMAGE* image, uint32_t* size);
+
+/* Writes changed output file image back to its file, or to another file if path is not NULL.
+ * If digest is not NULL, HASH_SHA256_LENGTH bytes of SHA-256 of the written file are stored there, they are calculated while it is written.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_save(const FD44_IMAGE* image, const char* path, uint8_t* digest, FD44_LOG* log);
+
+/* Closes image and frees all its data */
+void fd44_close(FD44_IMAGE* image);
+
+/* Checks if file is a donor bundle.
+ * Returns 1 if it is and 0 if it isn't or can't be read */
+int fd44_is_bundle(const char* path);
+
+/* Writes donor data to bundle file, which can be loaded by fd44_bundle_load instead of extracting it from input file again.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_bundle_save(const FD44_DONOR* donor, const char* path, FD44_LOG* log);
+
+/* Loads donor data from bundle file and verifies its checksums.
+ * Returns FD44_OK on success or FD44_ERR_* code on error. Donor must be freed by fd44_donor_free in both cases */
+int fd44_bundle_load(FD44_DONOR* donor, const char* path, FD44_LOG* log);
+
+/* Stores HASH_SHA256_LENGTH bytes of SHA-256 of the whole file as it was loaded to digest,
+ * it is calculated while the file is loaded with IMAGE_HASH flag, clones have the hash of their source.
+ * Returns 1 on success and 0 if image is not loaded with IMAGE_HASH flag */
+int fd44_file_hash(const FD44_IMAGE* image, uint8_t* digest);
+
+/* Returns XXH64 of the whole loaded file, it must be called before fd44_apply to get hash of unchanged file */
+uint64_t fd44_source_hash(const FD44_IMAGE* image);
+
+/* Writes ranges changed by fd44_apply to delta file instead of saving the whole output file.
+ * sourceHash is the result of fd44_source_hash called before changes.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_delta_save(const FD44_IMAGE* image, uint64_t sourceHash, const char* path, FD44_LOG* log);
+
+/* Applies delta file to the output file it was made for, only changed ranges are written.
+ * Returns FD44_OK on success or FD44_ERR_* code on error, output file is not changed in that case */
+int fd44_delta_apply(const char* delta, const char* path, uint32_t flags, FD44_LOG* log);
+
+/* Extracts data to be copied from input file read from stream window by window, so memory use doesn't depend on file size.
+ * Returns FD44_OK on success, including all FD44 modules being empty, or FD44_ERR_* code on error.
+ * Donor must be freed by fd44_donor_free in both cases */
+int fd44_stream_extract(const FD44* fd44, FILE* input, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log);
+
+/* Copies donor data to output file read from input stream window by window and writes patched data to output stream.
+ * Only firmware volumes and FD44 modules are loaded to memory as a whole, capsule header is removed.
+ * Data is written before the whole file is checked, so written data must be discarded if FD44_OK is not returned.
+ * Volumes are verified in options->verify mode while they are loaded.
+ * Returns FD44_OK on success or FD44_ERR_* code on error */
+int fd44_stream_apply(const FD44* fd44, FILE* input, FILE* output, const FD44_OPTIONS* options, const FD44_DONOR* donor, FD44_LOG* log);
+
+/* Prints formatted message to console or appends it to log buffer, nothing is done if log is NULL */
+void fd44_log_printf(FD44_LOG* log, const char* format, ...);
+
+/* Prints message followed by description of current errno value as perror does, nothing is done if log is NULL */
+void fd44_log_perror(FD44_LOG* log, const char* message);
+
+/* Frees collected messages */
+void fd44_log_free(FD44_LOG* log);
+
+#endif /* FD44_H */
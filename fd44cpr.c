@@ -4,681 +4,2038 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include "bios.h"
+#include "fd44.h"
+#include "thread.h"
+#include "pool.h"
+#include "ioqueue.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
 
 /* Return codes */
-#define ERR_OK                      0
-#define ERR_EMPTY_FD44_MODULE       1
-#define ERR_ARGS                    2
-#define ERR_INPUT_FILE              3
-#define ERR_OUTPUT_FILE             4
-#define ERR_MEMORY                  5
-#define ERR_NO_FD44_MODULE          6
-#define ERR_DIFFERENT_BOARD         7
-#define ERR_NO_GBE                  8
-#define ERR_NO_SLIC                 9
-
-/* Implementation of GNU memmem function using Boyer-Moore-Horspool algorithm
-*  Returns pointer to the beginning of found pattern of NULL if not found */
-uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen)
-{
-    uint32_t scan = 0;
-    uint32_t bad_char_skip[256];
-    uint32_t last;
-    uint32_t slen;
-
-    if (plen == 0 || !begin || !pattern || !end || end <= begin)
+#define ERR_OK                      FD44_OK
+#define ERR_EMPTY_FD44_MODULE       FD44_ERR_EMPTY_FD44_MODULE
+#define ERR_ARGS                    FD44_ERR_ARGS
+#define ERR_INPUT_FILE              FD44_ERR_INPUT_FILE
+#define ERR_OUTPUT_FILE             FD44_ERR_OUTPUT_FILE
+#define ERR_MEMORY                  FD44_ERR_MEMORY
+#define ERR_NO_FD44_MODULE          FD44_ERR_NO_FD44_MODULE
+#define ERR_DIFFERENT_BOARD         FD44_ERR_DIFFERENT_BOARD
+#define ERR_NO_GBE                  FD44_ERR_NO_GBE
+#define ERR_NO_SLIC                 FD44_ERR_NO_SLIC
+#define ERR_INTEGRITY               FD44_ERR_INTEGRITY
+
+/* File name standing for standard input, patched output file read from it is written to standard output */
+#define STDIO_FILE                  "-"
+
+/* Audit record of job, hashes are calculated while files are read and written */
+typedef struct _AUDIT {
+    uint8_t      inputHash[HASH_SHA256_LENGTH];                           /* SHA-256 of input file */
+    uint8_t      targetHash[HASH_SHA256_LENGTH];                          /* SHA-256 of output file before patching */
+    uint8_t      outputHash[HASH_SHA256_LENGTH];                          /* SHA-256 of patched output file as written */
+    int8_t       hasInputHash;                                            /* flag that input file hash is calculated */
+    int8_t       hasTargetHash;                                           /* flag that output file hash before patching is calculated */
+    int8_t       hasOutputHash;                                           /* flag that patched output file hash is calculated */
+    IMAGE_RANGE* patched;                                                 /* ranges changed in output file, offsets are in written file */
+    uint32_t     patchedCount;                                            /* number of changed ranges */
+} AUDIT;
+
+/* Copying job, input file data is copied to one output file */
+typedef struct _JOB {
+    FD44_OPTIONS      options;                                            /* job options */
+    uint32_t          imageFlags;                                         /* flags used to load input and output files */
+    const char*       inputfile;                                          /* path to input file */
+    const char*       outputfile;                                         /* path to output file */
+    const char*       saveas;                                             /* path to save patched output file to, NULL if it's patched in place */
+    const FD44_DONOR* donor;                                              /* input file data extracted beforehand, NULL if it's extracted by job */
+    const FD44_IMAGE* target;                                             /* output file loaded beforehand and cloned by job, NULL if it's loaded by job */
+    int8_t            extract;                                            /* flag that input file data is saved to bundle OUTFILE instead of being copied */
+    const char*       delta;                                              /* path to delta file written instead of changing output file, NULL if it's changed */
+    uint32_t          line;                                               /* manifest line of job, 0 for command line jobs */
+    int               result;                                             /* ERR_* result of job */
+    uint64_t          started;                                            /* job start time from the start of run, in microseconds */
+    uint64_t          extractTime;                                        /* time spent on input file, in microseconds */
+    uint64_t          patchTime;                                          /* time spent on output file or bundle, in microseconds */
+    STATS*            stats;                                              /* time and counters of job stages, NULL if not collected */
+    int8_t            prefetched;                                         /* flag that job files are queued to be read ahead */
+    AUDIT*            audit;                                              /* hashes and changed ranges of job files, NULL if not collected */
+} JOB;
+
+/* Jobs ran in parallel */
+typedef struct _RUN {
+    const FD44*    fd44;                                                  /* library state */
+    JOB*           jobs;                                                  /* jobs */
+    uint32_t       count;                                                 /* number of jobs */
+    uint64_t       started;                                               /* run start time */
+    MUTEX          mutex;                                                 /* lock for console output and prefetch flags */
+    IOQUEUE        io;                                                    /* background reads and writes */
+    int8_t         background;                                            /* flag that background I/O is used */
+} RUN;
+
+/* Patched output file written in background after its job is done */
+typedef struct _WRITE_TASK {
+    RUN*           run;                                                   /* run of job */
+    JOB*           job;                                                   /* job that patched output file */
+    FD44_IMAGE     image;                                                 /* patched output file */
+    FD44_LOG       log;                                                   /* messages of job */
+    uint64_t       queued;                                                /* time output file was queued */
+} WRITE_TASK;
+
+/* Default number of background reads and writes of batch and manifest modes */
+#define IO_DEPTH                    4
+
+/* Default number of megabytes held by output files waiting to be written in background */
+#define IO_MEMORY                   256
+
+/* Prints collected messages prefixing every line with name and frees log buffer */
+static void log_flush(FD44_LOG* log, const char* name)
+{
+    char* line = log->buffer;
+    while (line && line < log->buffer + log->length)
+    {
+        char* next = strchr(line, '\n');
+        if (!next)
+            next = log->buffer + log->length;
+        printf("%s: %.*s\n", name, (int)(next - line), line);
+        line = next + 1;
+    }
+    fd44_log_free(log);
+}
+
+/* Separator of input files in INFILE given as a list of backup dumps of one motherboard, e.g. dump1.bin+dump2.bin */
+#define INPUT_SEPARATOR             '+'
+
+/* Input file of job given as a list, extracted by pool task */
+typedef struct _DONOR_TASK {
+    const FD44*    fd44;                                                  /* library state */
+    const char*    path;                                                  /* path to input file */
+    uint32_t       imageFlags;                                            /* flags used to load input file */
+    FD44_OPTIONS   options;                                               /* extraction options */
+    FD44_DONOR     donor;                                                 /* extracted data */
+    FD44_LOG       log;                                                   /* messages of extraction */
+    STATS          stats;                                                 /* counters of extraction, added to job statistics */
+    int            result;                                                /* ERR_* result of extraction */
+} DONOR_TASK;
+
+/* Checks if INFILE is a list of input files: it has separators and isn't an existing file itself.
+ * Returns 1 if it is and 0 if it isn't */
+static int is_input_list(const char* inputfile)
+{
+    FILE* file;
+
+    if (!strchr(inputfile, INPUT_SEPARATOR))
+        return 0;
+    file = fopen(inputfile, "rb");
+    if (!file)
+        return 1;
+    fclose(file);
+    return 0;
+}
+
+/* Loads input file or bundle at path and extracts data to be copied from it, input file hash is recorded to audit if it is not NULL.
+ * Returns ERR_OK on success, including all FD44 modules being empty, or ERR_* code on error */
+static int load_donor(const FD44* fd44, const char* path, uint32_t imageFlags, const FD44_OPTIONS* options, AUDIT* audit, FD44_DONOR* donor, FD44_LOG* log)
+{
+    FD44_IMAGE image;                                                     /* input file with located structures */
+    int result;                                                           /* extraction result */
+
+    /* Loading bundle, it holds only extracted data, so there is nothing to search for */
+    if (fd44_is_bundle(path))
+    {
+        STATS_MARK mark;
+        stats_begin(log->stats, &mark);
+        result = fd44_bundle_load(donor, path, log);
+        stats_end(log->stats, STATS_LOAD_INPUT, &mark, donor->fd44ModuleSize, 0);
+        if (result == ERR_OK && options->copyModule && donor->isModuleEmpty)
+            fd44_log_printf(log, "FD44 modules are empty in input file. Data restoration required.\nUse FD44Editor to restore your data.\n");
+        return result;
+    }
+
+    memset(donor, 0, sizeof(FD44_DONOR));
+    result = fd44_open(fd44, &image, path, imageFlags, log);
+    if (result != ERR_OK)
+        return result;
+    if (audit)
+        audit->hasInputHash = (int8_t)fd44_file_hash(&image, audit->inputHash);
+
+    result = fd44_extract(&image, options, donor, log);
+    fd44_close(&image);
+    return result;
+}
+
+/* Pool task, extracts one input file of list with its own log and statistics */
+static void donor_task(void* context, uint32_t index)
+{
+    DONOR_TASK* task = &((DONOR_TASK*)context)[index];
+    task->result = load_donor(task->fd44, task->path, task->imageFlags, &task->options, NULL, &task->donor, &task->log);
+}
+
+/* Appends collected messages of task to log prefixing every line with name and frees task log buffer */
+static void log_append(FD44_LOG* log, FD44_LOG* task, const char* name)
+{
+    char* line = task->buffer;
+    while (line && line < task->buffer + task->length)
+    {
+        char* next = strchr(line, '\n');
+        if (!next)
+            next = task->buffer + task->length;
+        fd44_log_printf(log, "%s: %.*s\n", name, (int)(next - line), line);
+        line = next + 1;
+    }
+    fd44_log_free(task);
+}
+
+/* Extracts data from every input file of INFILE list and merges it, selecting every field from the best input file.
+ * Input files are extracted in parallel by fd44->scanThreads threads, each of them scanning its file on its own thread,
+ * so they are extracted one by one when jobs themselves run in parallel. Input files which can't be loaded are skipped.
+ * Returns ERR_OK on success, including all FD44 modules being empty, or ERR_* code on error */
+static int extract_list(const FD44* fd44, const JOB* job, const FD44_OPTIONS* options, FD44_DONOR* donor, FD44_LOG* log)
+{
+    static const char* FIELD_NAMES[FD44_FIELD_COUNT] = { "GbE MAC address", "SLIC pubkey and marker", "FD44 module" };
+    FD44 serial = *fd44;                                                  /* library state scanning on one thread */
+    DONOR_TASK* tasks;                                                    /* input files of list */
+    FD44_DONOR* donors;                                                   /* data of input files which are loaded */
+    uint32_t* loaded;                                                     /* task indexes of loaded input files */
+    int32_t sources[FD44_FIELD_COUNT];                                    /* donor indexes of merged fields */
+    char* paths;                                                          /* copy of list, separators are replaced by zeros */
+    char* path;
+    uint32_t count = 1;                                                   /* number of input files */
+    uint32_t donorCount = 0;                                              /* number of loaded input files */
+    uint32_t i;
+    int result = ERR_OK;
+
+    memset(donor, 0, sizeof(FD44_DONOR));
+    for (path = strchr(job->inputfile, INPUT_SEPARATOR); path; path = strchr(path + 1, INPUT_SEPARATOR))
+        count++;
+    paths = (char*)malloc(strlen(job->inputfile) + 1);
+    tasks = (DONOR_TASK*)calloc(count, sizeof(DONOR_TASK));
+    donors = (FD44_DONOR*)malloc(count * sizeof(FD44_DONOR));
+    loaded = (uint32_t*)malloc(count * sizeof(uint32_t));
+    if (!paths || !tasks || !donors || !loaded)
+    {
+        fd44_log_printf(log, "Can't allocate memory for input files.\n");
+        free(paths);
+        free(tasks);
+        free(donors);
+        free(loaded);
+        return ERR_MEMORY;
+    }
+
+    /* Missing fields of one input file are taken from others, so they are checked after merging */
+    strcpy(paths, job->inputfile);
+    serial.scanThreads = 1;
+    for (i = 0, path = paths; i < count; i++)
+    {
+        char* next = strchr(path, INPUT_SEPARATOR);
+        if (next)
+            *next = '\0';
+        tasks[i].fd44 = &serial;
+        tasks[i].imageFlags = job->imageFlags;
+        tasks[i].path = path;
+        tasks[i].options = *options;
+        tasks[i].options.defaultOptions = 1;
+        tasks[i].log.buffered = 1;
+        if (log->stats)
+        {
+            stats_init(&tasks[i].stats, 0);
+            tasks[i].log.stats = &tasks[i].stats;
+        }
+        if (!path[0] || !strcmp(path, STDIO_FILE))
+        {
+            fd44_log_printf(log, "Input file list can't have empty names or standard input.\n");
+            result = ERR_ARGS;
+        }
+        if (next)
+            path = next + 1;
+    }
+
+    if (result == ERR_OK && !pool_run(count, fd44->scanThreads < count ? fd44->scanThreads : count, donor_task, tasks))
+    {
+        fd44_log_printf(log, "Can't start threads extracting input files.\n");
+        result = ERR_MEMORY;
+    }
+
+    if (result == ERR_OK)
+    {
+        /* Input file without FD44 module can still have other fields */
+        for (i = 0; i < count; i++)
+        {
+            log_append(log, &tasks[i].log, tasks[i].path);
+            if (log->stats)
+                stats_add(log->stats, &tasks[i].stats);
+            if (tasks[i].result == ERR_OK || tasks[i].result == ERR_NO_FD44_MODULE)
+            {
+                donors[donorCount] = tasks[i].donor;
+                loaded[donorCount++] = i;
+            }
+            else if (result == ERR_OK)
+                result = tasks[i].result;
+        }
+
+        /* Input files are named in report, so their motherboard names are compared before merging */
+        for (i = 1; i < donorCount && !options->skipMotherboardNameCheck; i++)
+        {
+            if (!fd44_same_board(donors[0].motherboardName, donors[i].motherboardName))
+            {
+                fd44_log_printf(log, "Motherboard name in %s differs from motherboard name in %s.\n", tasks[loaded[i]].path, tasks[loaded[0]].path);
+                donorCount = 0;
+                result = ERR_DIFFERENT_BOARD;
+                break;
+            }
+        }
+
+        if (donorCount)
+        {
+            result = fd44_donor_merge(donors, donorCount, options, donor, sources, log);
+            for (i = 0; i < FD44_FIELD_COUNT; i++)
+                if (sources[i] >= 0)
+                    fd44_log_printf(log, "%s taken from %s.\n", FIELD_NAMES[i], tasks[loaded[sources[i]]].path);
+        }
+        else if (result != ERR_DIFFERENT_BOARD)
+            fd44_log_printf(log, "No input file can be loaded.\n");
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        fd44_donor_free(&tasks[i].donor);
+        fd44_log_free(&tasks[i].log);
+    }
+    free(paths);
+    free(tasks);
+    free(donors);
+    free(loaded);
+    return result;
+}
+
+/* Loads input file or bundle, or every input file of INFILE list, and extracts data to be copied from it.
+ * Returns ERR_OK on success, including all FD44 modules being empty, or ERR_* code on error */
+static int extract_donor(const FD44* fd44, const JOB* job, FD44_DONOR* donor, FD44_LOG* log)
+{
+    FD44_OPTIONS options = job->options;                                  /* extraction options */
+
+    /* Motherboard name is always stored to bundle, so it can be checked when bundle is applied */
+    if (job->extract)
+        options.skipMotherboardNameCheck = 0;
+
+    /* Reading input file from standard input window by window */
+    if (!strcmp(job->inputfile, STDIO_FILE))
+        return fd44_stream_extract(fd44, stdin, &options, donor, log);
+
+    if (is_input_list(job->inputfile))
+        return extract_list(fd44, job, &options, donor, log);
+
+    return load_donor(fd44, job->inputfile, job->imageFlags, &options, job->audit, donor, log);
+}
+
+/* Records ranges changed in output file to job audit, offsets are converted to offsets in written file without capsule header.
+ * Returns ERR_OK on success or ERR_MEMORY on error */
+static int audit_patched(AUDIT* audit, const FD44_IMAGE* image, FD44_LOG* log)
+{
+    uint32_t offset = (uint32_t)(fd44_data(image, NULL) - image->image.data); /* size of removed capsule header */
+    uint32_t i;
+
+    free(audit->patched);
+    audit->patched = (IMAGE_RANGE*)malloc((image->image.dirtyCount ? image->image.dirtyCount : 1) * sizeof(IMAGE_RANGE));
+    audit->patchedCount = 0;
+    if (!audit->patched)
+    {
+        fd44_log_printf(log, "Can't allocate memory for audit record.\n");
+        return ERR_MEMORY;
+    }
+    for (i = 0; i < image->image.dirtyCount; i++)
+    {
+        audit->patched[i].offset = image->image.dirty[i].offset - offset;
+        audit->patched[i].length = image->image.dirty[i].length;
+    }
+    audit->patchedCount = image->image.dirtyCount;
+    return ERR_OK;
+}
+
+/* Writes patched output file of job, its hash is recorded to job audit.
+ * Returns ERR_OK on success or ERR_* code on error */
+static int save_output(const JOB* job, const FD44_IMAGE* image, FD44_LOG* log)
+{
+    int result = fd44_save(image, job->saveas, job->audit ? job->audit->outputHash : NULL, log);
+    if (job->audit)
+        job->audit->hasOutputHash = (result == ERR_OK);
+    return result;
+}
+
+/* Loads output file, copies input file data to it and writes it back,
+ * or saves it to another file if job->saveas is not NULL, or writes only changes to delta file if job->delta is not NULL.
+ * If pending is not NULL, patched output file which isn't written to delta file is moved there instead of being written,
+ * so caller writes it by save_output and closes it.
+ * Returns ERR_OK on success, ERR_EMPTY_FD44_MODULE if input file had only empty FD44 modules, or ERR_* code on error */
+static int patch_target(const FD44* fd44, const JOB* job, const FD44_DONOR* donor, FD44_LOG* log, FD44_IMAGE* pending)
+{
+    FD44_IMAGE image;                                                     /* output file with located structures */
+    uint64_t sourceHash = 0;                                              /* hash of unchanged output file */
+    uint32_t flags;                                                       /* output file loading flags */
+    int result;                                                           /* patching result */
+
+    if (!strcmp(job->outputfile, STDIO_FILE))
+    {
+        /* Patching output file read from standard input and writing it to standard output */
+        if (job->delta)
+        {
+            fd44_log_printf(log, "Delta file can't be written for output file read from standard input.\n");
+            return ERR_ARGS;
+        }
+        result = fd44_stream_apply(fd44, stdin, stdout, &job->options, donor, log);
+    }
+    else
+    {
+        flags = job->imageFlags | IMAGE_WRITABLE | ((job->saveas || job->delta) ? IMAGE_SAVE_AS : 0);
+        if (job->target)
+            result = fd44_clone(job->target, &image, log);
+        else
+            result = fd44_open(fd44, &image, job->outputfile, flags, log);
+        if (result != ERR_OK)
+            return result;
+        if (job->delta)
+            sourceHash = fd44_source_hash(&image);
+        if (job->audit)
+            job->audit->hasTargetHash = (int8_t)fd44_file_hash(&image, job->audit->targetHash);
+
+        result = fd44_apply(&image, &job->options, donor, log);
+        if (result == ERR_OK && job->audit)
+            result = audit_patched(job->audit, &image, log);
+        if (result == ERR_OK && pending && !job->delta)
+        {
+            *pending = image;
+            memset(&image, 0, sizeof(FD44_IMAGE));
+        }
+        else if (result == ERR_OK)
+        {
+            if (job->delta)
+            {
+                STATS_MARK mark;
+                stats_begin(log->stats, &mark);
+                result = fd44_delta_save(&image, sourceHash, job->delta, log);
+                stats_end(log->stats, STATS_WRITE, &mark, 0, image.image.dirtyCount);
+            }
+            else
+                result = save_output(job, &image, log);
+        }
+        fd44_close(&image);
+    }
+
+    if (result == ERR_OK && job->options.copyModule && donor->isModuleEmpty)
+        return ERR_EMPTY_FD44_MODULE;
+
+    return result;
+}
+
+/* Sets job options from short options argument, or default options if it is NULL */
+static void set_options(FD44_OPTIONS* options, const char* arg)
+{
+    if (arg)
+    {
+        /* Setting supplied options */
+        options->copyModule = (strchr(arg, 'm') != NULL);
+        options->copyGbe =    (strchr(arg, 'g') != NULL);
+        options->copySLIC =   (strchr(arg, 's') != NULL);
+        options->skipMotherboardNameCheck =
+                              (strchr(arg, 'n') != NULL);
+        options->defaultOptions = 0;
+    }
+    else
+    {
+        /* Setting default options */
+        options->defaultOptions =            1;
+        options->copyModule =                1;
+        options->copyGbe =                   1;
+        options->copySLIC =                  1;
+        options->skipMotherboardNameCheck =  0;
+    }
+}
+
+/* Checks that output file is made for the same motherboard as input file, reading files only until their BOOTEFI blocks.
+ * Input file is probed too if motherboardName is NULL, otherwise it is the name of input file data.
+ * Returns ERR_OK if files are compatible or aren't checked, or ERR_* code of the first found incompatibility */
+static int probe_job(const JOB* job, const uint8_t* motherboardName, FD44_LOG* log)
+{
+    FD44_PROBE input;                                                     /* beginning of input file */
+    FD44_PROBE output;                                                    /* beginning of output file */
+    const uint8_t* targetName;                                            /* motherboard name of output file */
+    int result;
+
+    /* Output file read from standard input can't be read twice, and names aren't compared with n option */
+    if (job->extract || job->options.skipMotherboardNameCheck || !strcmp(job->outputfile, STDIO_FILE))
+        return ERR_OK;
+
+    if (!motherboardName)
+    {
+        result = fd44_probe(job->inputfile, job->imageFlags, &input, log);
+        if (result != ERR_OK)
+            return result;
+        motherboardName = input.motherboardName;
+    }
+
+    /* Output file loaded beforehand has its BOOTEFI block located already */
+    if (job->target)
+        targetName = job->target->bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET;
+    else
+    {
+        result = fd44_probe(job->outputfile, job->imageFlags | IMAGE_WRITABLE, &output, log);
+        if (result != ERR_OK)
+            return result;
+        targetName = output.motherboardName;
+    }
+    return fd44_check_board(motherboardName, targetName, log);
+}
+
+/* Runs copying job, it uses no global state, so any number of jobs can run at the same time.
+ * Files made for different motherboards are rejected by probing them before they are loaded.
+ * If pending is not NULL, patched output file may be moved there to be written by caller, as patch_target does.
+ * Returns ERR_* result of job, it is also stored to job->result */
+static int run_job(const FD44* fd44, JOB* job, FD44_LOG* log, FD44_IMAGE* pending)
+{
+    FD44_DONOR donor;                                                     /* input file data extracted by job */
+    const FD44_DONOR* source = job->donor;                                /* input file data used by job */
+    uint64_t time = timer_now();                                          /* start time of current stage */
+    int8_t probed = 0;                                                    /* flag that files are checked by probe_job */
+
+    job->extractTime = 0;
+    job->patchTime = 0;
+
+    /* Probing input file image and output file before input file is loaded, bundles and standard input are read whole anyway
+     * and motherboard name of input file list is checked when they are merged, so output file is probed after them */
+    if (!source && strcmp(job->inputfile, STDIO_FILE) && !fd44_is_bundle(job->inputfile) && !is_input_list(job->inputfile))
+    {
+        job->result = probe_job(job, NULL, log);
+        if (job->result != ERR_OK)
+        {
+            job->extractTime = timer_now() - time;
+            return job->result;
+        }
+        probed = 1;
+    }
+
+    /* Extracting input file data if it isn't shared by many jobs */
+    if (!source)
+    {
+        job->result = extract_donor(fd44, job, &donor, log);
+        job->extractTime = timer_now() - time;
+        if (job->result != ERR_OK)
+        {
+            fd44_donor_free(&donor);
+            return job->result;
+        }
+        source = &donor;
+        time = timer_now();
+    }
+
+    /* Probing output file before it is loaded, if input file data is shared or isn't probed */
+    if (!probed)
+    {
+        job->result = probe_job(job, source->motherboardName, log);
+        if (job->result != ERR_OK)
+        {
+            job->patchTime = timer_now() - time;
+            if (!job->donor)
+                fd44_donor_free(&donor);
+            return job->result;
+        }
+    }
+
+    /* Saving input file data to bundle or copying it to output file */
+    if (job->extract)
+    {
+        STATS_MARK mark;
+        stats_begin(log->stats, &mark);
+        job->result = fd44_bundle_save(source, job->outputfile, log);
+        stats_end(log->stats, STATS_WRITE, &mark, source->fd44ModuleSize, 1);
+        if (job->result == ERR_OK)
+        {
+            fd44_log_printf(log, "Bundle file written.\n");
+            if (job->options.copyModule && source->isModuleEmpty)
+                job->result = ERR_EMPTY_FD44_MODULE;
+        }
+    }
+    else
+        job->result = patch_target(fd44, job, source, log, pending);
+    job->patchTime = timer_now() - time;
+
+    if (!job->donor)
+        fd44_donor_free(&donor);
+    return job->result;
+}
+
+/* Prints all messages of finished job at once, so they are not mixed with other jobs */
+static void finish_task(RUN* run, JOB* job, FD44_LOG* log)
+{
+    mutex_lock(&run->mutex);
+    log_flush(log, job->outputfile);
+    printf("%s: done with result %d.\n", job->outputfile, job->result);
+    fflush(stdout);
+    mutex_unlock(&run->mutex);
+}
+
+/* I/O task, reads file to system cache */
+static void prefetch_task(void* context)
+{
+    image_prefetch((const char*)context);
+}
+
+/* I/O task, writes patched output file and finishes its job */
+static void write_task(void* context)
+{
+    WRITE_TASK* task = (WRITE_TASK*)context;
+    JOB* job = task->job;
+    STATS stats;                                                          /* counters of writing, added to job statistics */
+    int result;
+
+    /* Job statistics count its own thread, so writing is counted separately */
+    if (job->stats)
+    {
+        stats_init(&stats, 0);
+        task->log.stats = &stats;
+    }
+    result = save_output(job, &task->image, &task->log);
+    fd44_close(&task->image);
+    if (result != ERR_OK)
+        job->result = result;
+    job->patchTime += timer_now() - task->queued;
+    if (job->stats)
+        stats_add(job->stats, &stats);
+
+    finish_task(task->run, job, &task->log);
+    free(task);
+}
+
+/* Queues files of job to be read to system cache while other jobs are running, files shared by jobs are already loaded */
+static void prefetch_job(RUN* run, JOB* job)
+{
+    mutex_lock(&run->mutex);
+    if (job->prefetched)
+    {
+        mutex_unlock(&run->mutex);
+        return;
+    }
+    job->prefetched = 1;
+    mutex_unlock(&run->mutex);
+
+    /* Reading ahead is optional, so files are skipped if queue is full */
+    if (!job->donor)
+        ioqueue_push(&run->io, prefetch_task, (void*)job->inputfile, 0, 0);
+    if (!job->target)
+        ioqueue_push(&run->io, prefetch_task, (void*)job->outputfile, 0, 0);
+}
+
+/* Pool task, runs one job and prints all its messages at once, so they are not mixed with other jobs.
+ * With background I/O, files of the next job are read ahead and patched output file is written by I/O thread */
+static void run_task(void* context, uint32_t index)
+{
+    RUN* run = (RUN*)context;
+    JOB* job = &run->jobs[index];
+    FD44_LOG log = { 1, NULL, 0, 0, NULL };
+    FD44_IMAGE pending;                                                   /* patched output file to be written in background */
+
+    /* The next task of this thread is usually the next job */
+    memset(&pending, 0, sizeof(FD44_IMAGE));
+    if (run->background && index + 1 < run->count)
+        prefetch_job(run, &run->jobs[index + 1]);
+
+    /* Job runs on this thread only, so its hardware counters count this thread */
+    log.stats = job->stats;
+    stats_start(job->stats);
+    job->started = timer_now() - run->started;
+    run_job(run->fd44, job, &log, run->background ? &pending : NULL);
+    stats_stop(job->stats);
+
+    if (pending.buffer)
+    {
+        /* Output file waits for I/O thread while waiting files hold no more memory than allowed,
+         * mapped files hold only their changed pages */
+        WRITE_TASK* task = (WRITE_TASK*)malloc(sizeof(WRITE_TASK));
+        uint64_t memory = pending.image.size;                             /* bytes held by output file */
+        uint64_t time;                                                    /* start time of writing */
+        uint32_t i;
+        int result;
+
+        if (pending.image.mapped)
+            for (i = 0, memory = 0; i < pending.image.dirtyCount; i++)
+                memory += pending.image.dirty[i].length;
+        if (task)
+        {
+            task->run = run;
+            task->job = job;
+            task->image = pending;
+            task->log = log;
+            task->queued = timer_now();
+            if (ioqueue_push(&run->io, write_task, task, memory, 1))
+                return;
+            free(task);
+        }
+
+        /* Writing output file by this thread if it can't be queued */
+        time = timer_now();
+        result = save_output(job, &pending, &log);
+        fd44_close(&pending);
+        if (result != ERR_OK)
+            job->result = result;
+        job->patchTime += timer_now() - time;
+    }
+
+    finish_task(run, job, &log);
+}
+
+/* Runs all jobs on a work-stealing pool of threads.
+ * Files are read ahead and patched output files are written by ioDepth background I/O threads,
+ * output files waiting for them hold up to ioMemory bytes. Background I/O isn't used if ioDepth is 0.
+ * Returns ERR_OK if all jobs succeeded, or the result of the first failed job in job order */
+static int run_jobs(const FD44* fd44, JOB* jobs, uint32_t count, uint32_t threads, uint32_t ioDepth, uint64_t ioMemory)
+{
+    RUN run;
+    uint32_t i;
+
+    /* Console output is shared by all jobs, so none of them can write its output file there */
+    for (i = 0; i < count; i++)
+    {
+        if (!strcmp(jobs[i].outputfile, STDIO_FILE) || (!jobs[i].donor && !strcmp(jobs[i].inputfile, STDIO_FILE)))
+        {
+            printf("Standard input can be used only in single file mode or as batch INFILE.\n");
+            return ERR_ARGS;
+        }
+    }
+
+    run.fd44 = fd44;
+    run.jobs = jobs;
+    run.count = count;
+    run.started = timer_now();
+    if (!mutex_init(&run.mutex))
+    {
+        printf("Can't initialize job pool.\n");
+        return ERR_MEMORY;
+    }
+    /* Jobs do their I/O themselves if I/O threads can't be started */
+    run.background = ioDepth && ioqueue_start(&run.io, ioDepth, ioMemory);
+    if (!pool_run(count, threads, run_task, &run))
+    {
+        printf("Can't allocate memory for job pool.\n");
+        if (run.background)
+            ioqueue_stop(&run.io);
+        mutex_destroy(&run.mutex);
+        return ERR_MEMORY;
+    }
+    /* Waiting for output files written in background */
+    if (run.background)
+        ioqueue_stop(&run.io);
+    mutex_destroy(&run.mutex);
+
+    for (i = 0; i < count; i++)
+        if (jobs[i].result != ERR_OK)
+            return jobs[i].result;
+    return ERR_OK;
+}
+
+/* Splits next field from manifest line, fields are separated by spaces or tabs and may be enclosed in double quotes.
+ * Returns pointer to zero terminated field or NULL if there are no more fields */
+static char* next_field(char** line)
+{
+    char* field;
+    char* current = *line;
+
+    while (*current == ' ' || *current == '\t')
+        current++;
+    if (!*current)
+        return NULL;
+
+    if (*current == '"')
+    {
+        field = ++current;
+        while (*current && *current != '"')
+            current++;
+    }
+    else
+    {
+        field = current;
+        while (*current && *current != ' ' && *current != '\t')
+            current++;
+    }
+    if (*current)
+        *current++ = '\0';
+
+    *line = current;
+    return field;
+}
+
+/* Parses job written as command line arguments: <-OPTIONS> INFILE OUTFILE <SAVEAS>, job fields point into line split in place.
+ * Returns 1 if job is parsed, 0 if line is empty or starts with # and -1 if line is invalid */
+static int parse_job(char* line, uint32_t imageFlags, int8_t verify, JOB* job)
+{
+    char* fields[4];
+    uint32_t fieldCount;
+    char* field;
+
+    for (fieldCount = 0; (field = next_field(&line)) != NULL; fieldCount++)
+    {
+        if (fieldCount == 0 && field[0] == '#')
+            break;
+        if (fieldCount == 4)
+        {
+            fieldCount++;
+            break;
+        }
+        fields[fieldCount] = field;
+    }
+    if (fieldCount == 0)
+        return 0;
+
+    /* Checking that job has INFILE and OUTFILE */
+    field = fields[0];
+    if (fieldCount < (field[0] == '-' ? 3u : 2u) || fieldCount > (field[0] == '-' ? 4u : 3u))
+        return -1;
+
+    memset(job, 0, sizeof(JOB));
+    if (field[0] == '-')
+    {
+        set_options(&job->options, field);
+        fields[0] = fields[1];
+        fields[1] = fields[2];
+        fields[2] = fields[3];
+        fieldCount--;
+    }
+    else
+        set_options(&job->options, NULL);
+    job->options.verify = verify;
+    job->imageFlags = imageFlags;
+    job->inputfile = fields[0];
+    job->outputfile = fields[1];
+    job->saveas = fieldCount == 3 ? fields[2] : NULL;
+    return 1;
+}
+
+/* Reads manifest file, every line of it is a job written as command line arguments: <-OPTIONS> INFILE OUTFILE <SAVEAS>.
+ * Empty lines and lines starting with # are skipped. Job fields point into text, which must be freed after jobs.
+ * Returns array of jobs on success or NULL on error */
+static JOB* read_manifest(const char* path, uint32_t imageFlags, int8_t verify, uint32_t* count, char** text)
+{
+    FILE* file;
+    long size;
+    JOB* jobs;
+    uint32_t capacity;
+    uint32_t number;
+    char* line;
+
+    /* Reading whole manifest to memory */
+    file = fopen(path, "rb");
+    if (!file)
+    {
+        perror("Can't open manifest file.\n");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *text = (char*)malloc(size + 1);
+    if (!*text)
+    {
+        printf("Can't allocate memory for manifest file.\n");
+        fclose(file);
+        return NULL;
+    }
+    if (fread(*text, sizeof(char), size, file) != (size_t)size)
+    {
+        perror("Can't read manifest file.\n");
+        fclose(file);
+        free(*text);
+        return NULL;
+    }
+    fclose(file);
+    (*text)[size] = '\0';
+
+    /* Parsing jobs */
+    jobs = NULL;
+    capacity = 0;
+    *count = 0;
+    line = *text;
+    for (number = 1; line; number++)
+    {
+        JOB job;
+        int parsed;
+        char* next = strchr(line, '\n');
+
+        if (next)
+            *next++ = '\0';
+        if (*line && line[strlen(line) - 1] == '\r')
+            line[strlen(line) - 1] = '\0';
+
+        parsed = parse_job(line, imageFlags, verify, &job);
+        line = next;
+        if (parsed == 0)
+            continue;
+        if (parsed < 0)
+        {
+            printf("Manifest line %u is invalid.\n", number);
+            free(jobs);
+            free(*text);
+            return NULL;
+        }
+
+        if (*count == capacity)
+        {
+            JOB* grown;
+            capacity = capacity ? capacity * 2 : 16;
+            grown = (JOB*)realloc(jobs, capacity * sizeof(JOB));
+            if (!grown)
+            {
+                printf("Can't allocate memory for manifest jobs.\n");
+                free(jobs);
+                free(*text);
+                return NULL;
+            }
+            jobs = grown;
+        }
+
+        job.line = number;
+        jobs[(*count)++] = job;
+    }
+
+    if (!*count)
+    {
+        printf("Manifest file has no jobs.\n");
+        free(*text);
+        return NULL;
+    }
+    return jobs;
+}
+
+/* Compares output file paths of two jobs for qsort */
+static int compare_outputs(const void* first, const void* second)
+{
+    return strcmp((*(const JOB* const*)first)->outputfile, (*(const JOB* const*)second)->outputfile);
+}
+
+/* Loads output files saved as another files by more than one job, so jobs clone them instead of loading and scanning them again.
+ * Files that can't be loaded are left to jobs, so their errors are reported by every job as usual. Loading is added to stats if it isn't NULL.
+ * Returns array of *count templates to be closed after jobs, or NULL if there are none */
+static FD44_IMAGE* load_templates(const FD44* fd44, JOB* jobs, uint32_t jobCount, uint32_t* count, STATS* stats)
+{
+    FD44_LOG log = { 1, NULL, 0, 0, NULL };                               /* messages are dropped, jobs report them */
+    JOB** sorted;                                                         /* jobs saving output files as another files, sorted by output file */
+    FD44_IMAGE* templates = NULL;                                         /* loaded output files */
+    uint32_t sortedCount = 0;
+    uint32_t first, last;
+    uint32_t i;
+
+    *count = 0;
+    log.stats = stats;
+    sorted = (JOB**)malloc((jobCount ? jobCount : 1) * sizeof(JOB*));
+    if (!sorted)
+        return NULL;
+    for (i = 0; i < jobCount; i++)
+        if (jobs[i].saveas && !jobs[i].delta && strcmp(jobs[i].outputfile, STDIO_FILE))
+            sorted[sortedCount++] = &jobs[i];
+    qsort(sorted, sortedCount, sizeof(JOB*), compare_outputs);
+
+    for (first = 0; first < sortedCount; first = last)
+    {
+        for (last = first + 1; last < sortedCount && !strcmp(sorted[last]->outputfile, sorted[first]->outputfile); last++)
+            ;
+        if (last - first < 2)
+            continue;
+
+        if (!templates)
+        {
+            /* There can't be more templates than half of sorted jobs */
+            templates = (FD44_IMAGE*)malloc(sortedCount / 2 * sizeof(FD44_IMAGE));
+            if (!templates)
+                break;
+        }
+        if (fd44_open(fd44, &templates[*count], sorted[first]->outputfile, sorted[first]->imageFlags | IMAGE_WRITABLE | IMAGE_SAVE_AS | IMAGE_TEMPLATE, &log) != ERR_OK)
+        {
+            fd44_log_free(&log);
+            continue;
+        }
+        for (i = first; i < last; i++)
+            sorted[i]->target = &templates[*count];
+        (*count)++;
+    }
+
+    free(sorted);
+    fd44_log_free(&log);
+    if (!*count)
+    {
+        free(templates);
+        return NULL;
+    }
+    return templates;
+}
+
+/* Writes string to JSON file as quoted and escaped JSON string, or null if string is NULL */
+static void write_json_string(FILE* file, const char* string)
+{
+    if (!string)
+    {
+        fputs("null", file);
+        return;
+    }
+
+    fputc('"', file);
+    for (; *string; string++)
+    {
+        uint8_t c = (uint8_t)*string;
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+/* Writes status and timings of all jobs to results file as JSON array.
+ * Returns 1 on success and 0 on failure */
+static int write_results(const char* path, const JOB* jobs, uint32_t count)
+{
+    FILE* file;
+    uint32_t i;
+
+    file = fopen(path, "w");
+    if (!file)
+        return 0;
+
+    fputs("[\n", file);
+    for (i = 0; i < count; i++)
+    {
+        const JOB* job = &jobs[i];
+        fprintf(file, "  {\"line\": %u, \"input\": ", job->line);
+        write_json_string(file, job->inputfile);
+        fputs(", \"output\": ", file);
+        write_json_string(file, job->outputfile);
+        fputs(", \"saveas\": ", file);
+        write_json_string(file, job->saveas);
+        fprintf(file, ", \"result\": %d, \"started_us\": %llu, \"extract_us\": %llu, \"patch_us\": %llu}%s\n",
+                job->result, (unsigned long long)job->started, (unsigned long long)job->extractTime,
+                (unsigned long long)job->patchTime, i + 1 < count ? "," : "");
+    }
+    fputs("]\n", file);
+
+    if (ferror(file))
+    {
+        fclose(file);
+        return 0;
+    }
+    return fclose(file) == 0;
+}
+
+/* Writes SHA-256 digest to JSON file as hexadecimal string, or null if it isn't calculated */
+static void write_json_hash(FILE* file, const uint8_t* digest, int8_t calculated)
+{
+    uint32_t i;
+
+    if (!calculated)
+    {
+        fputs("null", file);
+        return;
+    }
+    fputc('"', file);
+    for (i = 0; i < HASH_SHA256_LENGTH; i++)
+        fprintf(file, "%02x", digest[i]);
+    fputc('"', file);
+}
+
+/* Writes hashes of files, ranges changed in output file and status of all jobs to audit file as JSON array.
+ * Returns 1 on success and 0 on failure */
+static int write_audit(const char* path, const JOB* jobs, uint32_t count)
+{
+    FILE* file;
+    uint32_t i, j;
+
+    file = fopen(path, "w");
+    if (!file)
+        return 0;
+
+    fputs("[\n", file);
+    for (i = 0; i < count; i++)
+    {
+        const JOB* job = &jobs[i];
+        const AUDIT* audit = job->audit;
+        fprintf(file, "  {\"line\": %u, \"input\": ", job->line);
+        write_json_string(file, job->inputfile);
+        fputs(", \"input_sha256\": ", file);
+        write_json_hash(file, audit->inputHash, audit->hasInputHash);
+        fputs(", \"output\": ", file);
+        write_json_string(file, job->outputfile);
+        fputs(", \"output_sha256\": ", file);
+        write_json_hash(file, audit->targetHash, audit->hasTargetHash);
+        fputs(", \"saveas\": ", file);
+        write_json_string(file, job->saveas);
+        fputs(", \"delta\": ", file);
+        write_json_string(file, job->delta);
+        fputs(", \"patched_sha256\": ", file);
+        write_json_hash(file, audit->outputHash, audit->hasOutputHash);
+        fputs(", \"patched\": [", file);
+        for (j = 0; j < audit->patchedCount; j++)
+            fprintf(file, "%s{\"offset\": %u, \"length\": %u}", j ? ", " : "", audit->patched[j].offset, audit->patched[j].length);
+        fprintf(file, "], \"result\": %d}%s\n", job->result, i + 1 < count ? "," : "");
+    }
+    fputs("]\n", file);
+
+    if (ferror(file))
+    {
+        fclose(file);
+        return 0;
+    }
+    return fclose(file) == 0;
+}
+
+/* Allocates audit records of every job.
+ * Returns allocated records or NULL on failure */
+static AUDIT* alloc_audits(JOB* jobs, uint32_t count)
+{
+    AUDIT* audits;
+    uint32_t i;
+
+    audits = (AUDIT*)calloc(count ? count : 1, sizeof(AUDIT));
+    if (!audits)
         return NULL;
+    for (i = 0; i < count; i++)
+        jobs[i].audit = &audits[i];
+    return audits;
+}
+
+/* Frees audit records of jobs and ranges stored in them */
+static void free_audits(AUDIT* audits, uint32_t count)
+{
+    uint32_t i;
+
+    if (!audits)
+        return;
+    for (i = 0; i < count; i++)
+        free(audits[i].patched);
+    free(audits);
+}
+
+/* Compares two uint64_t values for qsort */
+static int compare_values(const void* first, const void* second)
+{
+    uint64_t a = *(const uint64_t*)first;
+    uint64_t b = *(const uint64_t*)second;
+    return a < b ? -1 : a > b;
+}
 
-    slen = end - begin;
+/* Writes total, percentiles and maximum of sorted values as JSON object */
+static void write_percentiles(FILE* file, const uint64_t* values, uint32_t count)
+{
+    static const uint32_t percents[] = { 50, 90, 99 };
+    uint64_t total = 0;
+    uint32_t i;
 
-    for (scan = 0; scan <= 255; scan++)
-        bad_char_skip[scan] = plen;
+    for (i = 0; i < count; i++)
+        total += values[i];
+    fprintf(file, "{\"total\": %llu", (unsigned long long)total);
+    /* Nearest rank percentiles */
+    for (i = 0; i < sizeof(percents) / sizeof(percents[0]); i++)
+        fprintf(file, ", \"p%u\": %llu", percents[i], (unsigned long long)values[(count * percents[i] + 99) / 100 - 1]);
+    fprintf(file, ", \"max\": %llu}", (unsigned long long)values[count - 1]);
+}
 
-    last = plen - 1;
+/* Writes statistics of all jobs and of stages ran before them to file as JSON object.
+ * Every stage has totals of all calls, wall and CPU time percentiles are taken over jobs, and setup if it isn't NULL, that ran the stage.
+ * Returns 1 on success and 0 on failure */
+static int write_stats(FILE* file, const JOB* jobs, uint32_t count, const STATS* setup, uint64_t wallTime)
+{
+    const STATS** samples;                                                /* statistics of every job and of setup */
+    uint64_t* wall;                                                       /* wall times of stage */
+    uint64_t* cpu;                                                        /* CPU times of stage */
+    uint32_t sampleCount = 0;
+    int8_t hardware = 0;                                                  /* flag that any sample has hardware counters */
+    int8_t first = 1;                                                     /* flag that no stage is written yet */
+    uint32_t stage;
+    uint32_t i;
 
-    for (scan = 0; scan < last; scan++)
-        bad_char_skip[pattern[scan]] = last - scan;
+    samples = (const STATS**)malloc((count + 1) * sizeof(STATS*));
+    wall = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    cpu = (uint64_t*)malloc((count + 1) * sizeof(uint64_t));
+    if (!samples || !wall || !cpu)
+    {
+        free(samples);
+        free(wall);
+        free(cpu);
+        return 0;
+    }
+    if (setup)
+        samples[sampleCount++] = setup;
+    for (i = 0; i < count; i++)
+        if (jobs[i].stats)
+            samples[sampleCount++] = jobs[i].stats;
+    for (i = 0; i < sampleCount; i++)
+        hardware |= samples[i]->hardware;
 
-    while (slen >= plen)
+    fprintf(file, "{\"jobs\": %u, \"wall_us\": %llu, \"hardware\": %s, \"stages\": {",
+            count, (unsigned long long)wallTime, hardware ? "true" : "false");
+    for (stage = 0; stage < STATS_STAGE_COUNT; stage++)
     {
-        for (scan = last; begin[scan] == pattern[scan]; scan--)
-            if (scan == 0)
-                return begin;
+        STATS_COUNTERS total;                                             /* counters of all samples */
+        uint32_t ran = 0;                                                 /* number of samples that ran stage */
+
+        memset(&total, 0, sizeof(total));
+        for (i = 0; i < sampleCount; i++)
+        {
+            const STATS_COUNTERS* counters = &samples[i]->stages[stage];
+            if (!counters->calls)
+                continue;
+            total.calls += counters->calls;
+            total.bytes += counters->bytes;
+            total.items += counters->items;
+            total.cycles += counters->cycles;
+            total.instructions += counters->instructions;
+            wall[ran] = counters->wallTime;
+            cpu[ran] = counters->cpuTime;
+            ran++;
+        }
+        if (!ran)
+            continue;
+        qsort(wall, ran, sizeof(uint64_t), compare_values);
+        qsort(cpu, ran, sizeof(uint64_t), compare_values);
 
-        slen     -= bad_char_skip[begin[last]];
-        begin   += bad_char_skip[begin[last]];
+        fprintf(file, "%s\n  \"%s\": {\"calls\": %llu, \"bytes\": %llu, \"items\": %llu, \"samples\": %u, \"wall_us\": ",
+                first ? "" : ",", stats_stage_name((STATS_STAGE)stage), (unsigned long long)total.calls,
+                (unsigned long long)total.bytes, (unsigned long long)total.items, ran);
+        write_percentiles(file, wall, ran);
+        fputs(", \"cpu_us\": ", file);
+        write_percentiles(file, cpu, ran);
+        if (hardware)
+            fprintf(file, ", \"cycles\": %llu, \"instructions\": %llu",
+                    (unsigned long long)total.cycles, (unsigned long long)total.instructions);
+        fputc('}', file);
+        first = 0;
     }
+    fputs(first ? "}}\n" : "\n}}\n", file);
 
-    return NULL;
+    free(samples);
+    free(wall);
+    free(cpu);
+    return !ferror(file);
 }
 
-/* Finds free space between begin and end to insert new module.
- * Returns aligned pointer to empty space or NULL if it can't be found. */
-uint8_t* find_free_space(uint8_t* begin, uint8_t* end, uint32_t space_length)
+/* Writes statistics to file, or to standard error if path is STDIO_FILE.
+ * Returns 1 on success and 0 on failure */
+static int save_stats(const char* path, const JOB* jobs, uint32_t count, const STATS* setup, uint64_t wallTime)
 {
-    uint8_t* current;
-    uint32_t size;
-    uint32_t allignment;
+    FILE* file;
+    int result;
 
-    current = end;
-    
-    // Skipping 0xFF bytes from end
-    while (*current-- == 0xFF);
-    current++;
+    if (!strcmp(path, STDIO_FILE))
+        return write_stats(stderr, jobs, count, setup, wallTime);
 
-    // Error if begin passed, all bytes are 0xFF, which is incorrect
-    if (current < begin)
-        return NULL;
+    file = fopen(path, "w");
+    if (!file)
+        return 0;
+    result = write_stats(file, jobs, count, setup, wallTime);
+    if (fclose(file))
+        result = 0;
+    return result;
+}
 
-    // Alligning pounter to 8
-    size = current - begin;
-    if (size % 8)
-        allignment = 8 - size % 8;
-    else
-        allignment = 0;
-    
-    if (size + allignment < space_length)
+/* Allocates statistics of every job, so each of them counts stages it runs on its own thread.
+ * Returns allocated statistics or NULL on failure */
+static STATS* alloc_stats(JOB* jobs, uint32_t count)
+{
+    STATS* stats;
+    uint32_t i;
+
+    stats = (STATS*)malloc((count ? count : 1) * sizeof(STATS));
+    if (!stats)
         return NULL;
+    for (i = 0; i < count; i++)
+    {
+        stats_init(&stats[i], 0);
+        jobs[i].stats = &stats[i];
+    }
+    return stats;
+}
+
+/* Default number of output files kept loaded by server */
+#define SERVER_TEMPLATES            16
+
+/* Maximal length of server request line */
+#define SERVER_LINE_LENGTH          0x2000
+
+#ifndef _WIN32
+/* Modification and status change times of stat result, with nanoseconds, so files rewritten within a second are told apart */
+#ifdef __APPLE__
+#define STAT_MTIME(st)              ((uint64_t)(st).st_mtimespec.tv_sec * 1000000000 + (uint64_t)(st).st_mtimespec.tv_nsec)
+#define STAT_CTIME(st)              ((uint64_t)(st).st_ctimespec.tv_sec * 1000000000 + (uint64_t)(st).st_ctimespec.tv_nsec)
+#else
+#define STAT_MTIME(st)              ((uint64_t)(st).st_mtim.tv_sec * 1000000000 + (uint64_t)(st).st_mtim.tv_nsec)
+#define STAT_CTIME(st)              ((uint64_t)(st).st_ctim.tv_sec * 1000000000 + (uint64_t)(st).st_ctim.tv_nsec)
+#endif
+
+/* Output file kept loaded by server, requests saving it as another file clone it instead of loading and scanning it again */
+typedef struct _TEMPLATE {
+    char*             path;                                               /* path the file was loaded from, NULL if slot is empty */
+    uint64_t          size;                                               /* file size when it was loaded */
+    uint64_t          modified;                                           /* file modification time in nanoseconds when it was loaded */
+    uint64_t          changed;                                            /* file status change time in nanoseconds when it was loaded */
+    uint64_t          inode;                                              /* file serial number when it was loaded */
+    FD44_IMAGE        image;                                              /* loaded file with located structures */
+    uint64_t          used;                                               /* server clock at the last use, least recently used file is replaced first */
+    uint32_t          users;                                              /* number of requests cloning the file now, it can't be replaced until 0 */
+    int8_t            stale;                                              /* flag that server patched the file in place, so it isn't used again */
+} TEMPLATE;
+
+/* Requests served from local socket by a fixed set of threads */
+typedef struct _SERVER {
+    const FD44*       fd44;                                               /* library state */
+    uint32_t          imageFlags;                                         /* flags used to load input and output files */
+    int8_t            verify;                                             /* FD44_VERIFY_* mode of patched output files */
+    int               listener;                                           /* listening socket */
+    TEMPLATE*         templates;                                          /* loaded output files */
+    uint32_t          templateCount;                                      /* number of template slots, not less than number of threads */
+    uint64_t          clock;                                              /* number of template uses */
+    int*              connections;                                        /* connection served by every thread, -1 if thread waits for one */
+    MUTEX             mutex;                                              /* lock for templates, clock and connections */
+} SERVER;
+
+/* Server thread */
+typedef struct _SERVER_THREAD {
+    SERVER*           server;                                             /* server state */
+    uint32_t          index;                                              /* index of thread connection */
+    THREAD            thread;                                             /* thread handle */
+} SERVER_THREAD;
+
+/* Flag that termination signal is received */
+static volatile sig_atomic_t serverStopping = 0;
 
-    return current + allignment;
+/* Termination signal handler, server is stopped by the main thread waiting for this flag */
+static void stop_server(int number)
+{
+    (void)number;
+    serverStopping = 1;
 }
 
-/* Calculates 2's complement 8-bit checksum of data from data[0] to data[length-1] and stores it to *checksum
+/* Stores size, times and serial number of file to template, changed file gets other values.
  * Returns 1 on success and 0 on failure */
-int calculate_checksum(uint8_t* data, uint32_t length, uint8_t* checksum)
+static int stamp_template(TEMPLATE* template, const char* path)
 {
-    uint8_t counter;
+    struct stat st;
 
-    if (!data || !length || !checksum)
+    if (stat(path, &st))
         return 0;
-    counter = 0;
-    while (length--)
-        counter += data[length];
-    *checksum = ~counter + 1;
+    template->size = (uint64_t)st.st_size;
+    template->modified = STAT_MTIME(st);
+    template->changed = STAT_CTIME(st);
+    template->inode = (uint64_t)st.st_ino;
     return 1;
 }
 
-/* Converts SIZE field of MODULE_HEADER (3 bytes in reversed order) to uint32_t.
- * Returns 1 on success or 0 on error */
-int size2int(uint8_t* module_size, uint32_t* size)
+/* Looks up loaded output file, or loads it to the least recently used unused template slot.
+ * Returns template with users count increased, or NULL with ERR_* code stored to *result on error */
+static TEMPLATE* acquire_template(SERVER* server, const char* path, FD44_LOG* log, int* result, int8_t* hit)
 {
-    if (!module_size || !size)
-        return 0;
-
-    *size = (module_size[2] << 16) + 
-            (module_size[1] << 8) + 
-             module_size[0];
-    return 1;
-}
+    TEMPLATE loaded;
+    TEMPLATE* slot = NULL;
+    uint32_t i;
 
-/* Entry point */
-int main(int argc, char* argv[])
-{
-    FILE* file;                                                           /* file pointer to work with input and output files */
-    char* inputfile;                                                      /* path to input file*/
-    char* outputfile;                                                     /* path to output file */
-    uint8_t* buffer;                                                      /* buffer to read input and output file */
-    uint8_t* end;                                                         /* pointer to the end of buffer */
-    uint32_t filesize;                                                    /* size of opened file */
-    uint32_t read;                                                        /* read bytes counter */
-    uint8_t* bootefi;                                                     /* BOOTEFI header */
-    uint8_t* capsuleHeader;                                               /* Capsule header */
-    int8_t hasCapsuleHeader;                                              /* flag that output file has capsule header */
-    uint16_t headerSize;                                                  /* size of capsule header */
-    int8_t hasGbe;                                                        /* flag that input file has GbE region */
-    int8_t hasSLIC;                                                       /* flag that input file has SLIC pubkey and marker */
-    int8_t isModuleEmpty = 0;                                             /* flag that FD44 module is empty in input file */
-    int8_t defaultOptions;                                                /* flag that program is ran with default options */
-    int8_t copyModule;                                                    /* flag that FD44 module copying is requested */
-    int8_t copyGbe;                                                       /* flag that GbE MAC copying is requested */
-    int8_t copySLIC;                                                      /* flag that SLIC copying is requested */
-    int8_t skipMotherboardNameCheck;                                      /* flag that motherboard name in output file doesn't need to be checked */
-    uint8_t motherboardName[BOOTEFI_MOTHERBOARD_NAME_LENGTH];             /* motherboard name storage */
-    uint8_t gbeMac[GBE_MAC_LENGTH];                                       /* GbE MAC storage */
-    uint8_t slicPubkey[SLIC_PUBKEY_LENGTH                                 /* SLIC----*/
-                             - sizeof(SLIC_PUBKEY_HEADER)                       /* pubkey--*/
-                             - sizeof(SLIC_PUBKEY_PART1)];                      /* storage */
-    uint8_t slicMarker[SLIC_MARKER_LENGTH                                 /* SLIC----*/
-                             - sizeof(SLIC_MARKER_HEADER)                       /* marker--*/
-                             - sizeof(SLIC_MARKER_PART1)];                      /* storage */
-    uint8_t* fd44Module = 0;                                              /* FD44 module storage, will be allocated later */
-    uint32_t fd44ModuleSize;                                              /* size of FD44 module */
-    
-
-    if (argc < 3 || (argv[1][0] == '-' && argc < 4))
+    memset(&loaded, 0, sizeof(TEMPLATE));
+    *hit = 0;
+    if (!stamp_template(&loaded, path))
     {
-        printf("FD44Copier v0.7.0\nThis program copies GbE MAC address, FD44 module data,\n"\
-               "SLIC pubkey and marker from one BIOS image file to another.\n\n"
-               "Usage: FD44Copier <-OPTIONS> INFILE OUTFILE\n\n"
-               "Options: m - copy module data.\n"
-               "         g - copy GbE MAC address.\n"
-               "         s - copy SLIC pubkey and marker.\n"
-               "         n - do not check that both BIOS files are for same motherboard.\n"
-               "         <none> - copy all available data and check for same motherboard in both BIOS files.\n\n");
-        return ERR_ARGS;
+        fd44_log_perror(log, "Can't open output file.\n");
+        *result = ERR_OUTPUT_FILE;
+        return NULL;
     }
 
-    /* Checking for options presence and setting options */
-    if (argv[1][0] == '-')
+    /* Using loaded file if it wasn't changed since loading */
+    mutex_lock(&server->mutex);
+    for (i = 0; i < server->templateCount && !slot; i++)
     {
-        /* Setting supplied options */
-        copyModule = (strchr(argv[1], 'm') != NULL);
-        copyGbe =    (strchr(argv[1], 'g') != NULL);
-        copySLIC =   (strchr(argv[1], 's') != NULL);
-        skipMotherboardNameCheck =
-                     (strchr(argv[1], 'n') != NULL);
-        defaultOptions = 0;
-        inputfile = argv[2];
-        outputfile = argv[3];
+        TEMPLATE* template = &server->templates[i];
+        if (template->path && !template->stale && !strcmp(template->path, path) && template->size == loaded.size
+            && template->modified == loaded.modified && template->changed == loaded.changed && template->inode == loaded.inode)
+            slot = template;
     }
-    else
+    if (slot)
     {
-        /* Setting default options */
-        defaultOptions =            1;
-        copyModule =                1;
-        copyGbe =                   1;
-        copySLIC =                  1;
-        skipMotherboardNameCheck =  0;
-        inputfile =  argv[1];
-        outputfile = argv[2];
+        slot->users++;
+        slot->used = ++server->clock;
+        *hit = 1;
     }
+    mutex_unlock(&server->mutex);
+    if (slot)
+        return slot;
 
-     /* Opening input file */
-    file = fopen(inputfile, "rb");
-    if (!file)
+    /* Loading file without lock, so other requests are not stopped by it */
+    *result = fd44_open(server->fd44, &loaded.image, path, server->imageFlags | IMAGE_WRITABLE | IMAGE_SAVE_AS | IMAGE_TEMPLATE, log);
+    if (*result != ERR_OK)
+        return NULL;
+    loaded.path = (char*)malloc(strlen(path) + 1);
+    if (!loaded.path)
     {
-        perror("Can't open input file.\n");
-        return ERR_INPUT_FILE;
+        fd44_log_printf(log, "Can't allocate memory for output file.\n");
+        fd44_close(&loaded.image);
+        *result = ERR_MEMORY;
+        return NULL;
     }
+    strcpy(loaded.path, path);
 
-    /* Determining file size */
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    /* Allocating memory for buffer */
-    buffer = (uint8_t*)malloc(filesize);
-    if (!buffer)
+    /* Every thread uses at most one template and there are not less slots than threads, so unused slot always exists */
+    mutex_lock(&server->mutex);
+    for (i = 0; i < server->templateCount; i++)
     {
-        printf("Can't allocate memory for input file.\n");
-        return ERR_MEMORY;
+        TEMPLATE* template = &server->templates[i];
+        if (!template->path)
+        {
+            slot = template;
+            break;
+        }
+        if (!template->users && (!slot || template->used < slot->used))
+            slot = template;
+    }
+    if (slot->path)
+    {
+        fd44_close(&slot->image);
+        free(slot->path);
     }
-    end = buffer + filesize;
+    *slot = loaded;
+    slot->users = 1;
+    slot->used = ++server->clock;
+    mutex_unlock(&server->mutex);
+    return slot;
+}
+
+/* Allows template to be replaced when no other request uses it */
+static void release_template(SERVER* server, TEMPLATE* template)
+{
+    mutex_lock(&server->mutex);
+    template->users--;
+    mutex_unlock(&server->mutex);
+}
 
-    /* Reading whole file to buffer */
-    read = fread((void*)buffer, sizeof(char), filesize, file);
-    if (read != filesize)
+/* Drops templates of output file patched in place by server, templates still cloned by requests are freed when they are replaced */
+static void drop_templates(SERVER* server, const char* path)
+{
+    uint32_t i;
+
+    mutex_lock(&server->mutex);
+    for (i = 0; i < server->templateCount; i++)
     {
-        perror("Can't read input file.\n");
-        return ERR_INPUT_FILE;
+        TEMPLATE* template = &server->templates[i];
+        if (!template->path || strcmp(template->path, path))
+            continue;
+        if (template->users)
+            template->stale = 1;
+        else
+        {
+            fd44_close(&template->image);
+            free(template->path);
+            memset(template, 0, sizeof(TEMPLATE));
+        }
     }
+    mutex_unlock(&server->mutex);
+}
+
+/* Runs job written in request line and writes its result, timings and messages to reply as JSON object on one line.
+ * Line is NULL if request is too long */
+static void serve_request(SERVER* server, char* line, FILE* reply)
+{
+    JOB job;                                                              /* requested job */
+    FD44_LOG log = { 1, NULL, 0, 0, NULL };                               /* job messages sent with reply */
+    TEMPLATE* template = NULL;                                            /* loaded output file cloned by job */
+    const char* cache = "none";                                           /* template use: none, hit or miss */
+    uint64_t loadTime = 0;                                                /* time spent on looking up or loading template */
+    int8_t hit;
 
-    /* Searching for bootefi signature */
-    bootefi = find_pattern(buffer, end, BOOTEFI_HEADER, sizeof(BOOTEFI_HEADER));
-    if (!bootefi)
+    memset(&job, 0, sizeof(JOB));
+    if (!line || parse_job(line, server->imageFlags, server->verify, &job) <= 0)
     {
-        printf("ASUS BIOS file signature not found in input file.\n");
-        return ERR_INPUT_FILE;
+        fd44_log_printf(&log, "Request is invalid.\n");
+        job.result = ERR_ARGS;
     }
-    
-    /* Storing motherboard name */
-    if (!skipMotherboardNameCheck && !memcpy(motherboardName, bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET, sizeof(motherboardName)))
+    else if (!strcmp(job.inputfile, STDIO_FILE) || !strcmp(job.outputfile, STDIO_FILE))
     {
-        printf("Memcpy failed.\nMotherboard name can't be stored.\n");
-        return ERR_MEMORY;
+        fd44_log_printf(&log, "Standard input can't be used in server mode.\n");
+        job.result = ERR_ARGS;
     }
-
-    /* Searching for GbE and storing MAC address if it is found */
-    if (copyGbe)
+    else
     {
-        uint8_t* gbe = find_pattern(buffer, end, GBE_HEADER, sizeof(GBE_HEADER));
-        hasGbe = 0;
-        if (gbe)
+        /* Output file saved as another file is not changed, so it is kept loaded and cloned by job */
+        if (job.saveas)
         {
-            hasGbe = 1;
-            /* Checking if first GbE is a stub */
-            if (!memcmp(gbe + GBE_MAC_OFFSET, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)))
-            {
-                uint8_t* gbe2;
-                gbe2 = find_pattern(gbe + sizeof(GBE_HEADER), end, GBE_HEADER, sizeof(GBE_HEADER));
-                /* Checking if second GbE is not a stub */
-                if(gbe2 && memcmp(gbe2 + GBE_MAC_OFFSET, GBE_MAC_STUB, sizeof(GBE_MAC_STUB)))
-                    gbe = gbe2;
-            }
-
-            if (!memcpy(gbeMac, gbe + GBE_MAC_OFFSET, GBE_MAC_LENGTH))
-            {
-                printf("Memcpy failed.\nGbE MAC can't be copied.\n");
-                return ERR_MEMORY;
-            }
+            uint64_t time = timer_now();
+            template = acquire_template(server, job.outputfile, &log, &job.result, &hit);
+            loadTime = timer_now() - time;
+            cache = hit ? "hit" : "miss";
+            if (template)
+                job.target = &template->image;
         }
+        if (template || !job.saveas)
+            run_job(server->fd44, &job, &log, NULL);
+        if (template)
+            release_template(server, template);
 
-        if (!defaultOptions && !hasGbe)
-        {
-            printf("GbE region not found in input file, but required by -g option.\n");
-            return ERR_NO_GBE;
-        }
+        /* Output file changed in place may have the same size and times as its template */
+        if (!job.saveas)
+            drop_templates(server, job.outputfile);
     }
 
-    /* Searching for SLIC pubkey and marker and storing them if found*/
-    if (copySLIC)
-    {
-        uint8_t* slic_pubkey = find_pattern(buffer, end, SLIC_PUBKEY_HEADER, sizeof(SLIC_PUBKEY_HEADER));
-        uint8_t* slic_marker = find_pattern(buffer, end, SLIC_MARKER_HEADER, sizeof(SLIC_MARKER_HEADER));
-        hasSLIC = 0;
-        if (slic_pubkey && slic_marker)
-        {
-            slic_pubkey += sizeof(SLIC_PUBKEY_HEADER) + sizeof(SLIC_PUBKEY_PART1);
-            slic_marker += sizeof(SLIC_MARKER_HEADER) + sizeof(SLIC_MARKER_PART1);
-            if (!memcpy(slicPubkey, slic_pubkey, sizeof(slicPubkey)))
-            {
-                printf("Memcpy failed.\nSLIC pubkey can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            if (!memcpy(slicMarker, slic_marker, sizeof(slicMarker)))
-            {
-                printf("Memcpy failed.\nSLIC marker can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            hasSLIC = 1;
-        }
-        else /* If SLIC headers not found, searching for SLIC pubkey and marker in ASUSBKP module */
-        {
-            uint8_t* asusbkp = find_pattern(buffer, end, ASUSBKP_HEADER, sizeof(ASUSBKP_HEADER));
-            if (asusbkp)
-            {
-                slic_pubkey = find_pattern(asusbkp, end, ASUSBKP_PUBKEY_HEADER, sizeof(ASUSBKP_PUBKEY_HEADER));
-                slic_marker = find_pattern(asusbkp, end, ASUSBKP_MARKER_HEADER, sizeof(ASUSBKP_MARKER_HEADER));
-                if (slic_pubkey && slic_marker)
-                {
-                    slic_pubkey += sizeof(ASUSBKP_PUBKEY_HEADER);
-                    slic_marker += sizeof(ASUSBKP_MARKER_HEADER);
-                    if (!memcpy(slicPubkey, slic_pubkey, sizeof(slicPubkey)))
-                    {
-                        printf("Memcpy failed\nSLIC pubkey can't be copied.\n");
-                        return ERR_MEMORY;
-                    }
-                    if (!memcpy(slicMarker, slic_marker, sizeof(slicMarker)))
-                    {
-                        printf("Memcpy failed\nSLIC marker can't be copied.\n");
-                        return ERR_MEMORY;
-                    }
-                    hasSLIC = 1;
-                }
-            }
-        }
+    fprintf(reply, "{\"result\": %d, \"template\": \"%s\", \"load_us\": %llu, \"extract_us\": %llu, \"patch_us\": %llu, \"messages\": ",
+            job.result, cache, (unsigned long long)loadTime, (unsigned long long)job.extractTime, (unsigned long long)job.patchTime);
+    write_json_string(reply, log.length ? log.buffer : "");
+    fputs("}\n", reply);
+    fd44_log_free(&log);
+}
 
-        if (!defaultOptions && !hasSLIC)
-        {
-            printf("SLIC pubkey and marker not found in input file, but required by -s option.\n");
-            return ERR_NO_SLIC;
-        }
+/* Serves all requests of connection, one request per line, until it is closed by client */
+static void serve_connection(SERVER* server, int connection)
+{
+    char line[SERVER_LINE_LENGTH];
+    FILE* input;
+    FILE* reply;
+    int copy;
+
+    input = fdopen(connection, "r");
+    if (!input)
+    {
+        close(connection);
+        return;
+    }
+    copy = dup(connection);
+    reply = copy >= 0 ? fdopen(copy, "w") : NULL;
+    if (!reply)
+    {
+        if (copy >= 0)
+            close(copy);
+        fclose(input);
+        return;
     }
 
-    /* Searching for FD44 module header */
-    if (copyModule)
+    while (fgets(line, sizeof(line), input))
     {
-        uint8_t* module = 0;
-        uint8_t* fd44 = find_pattern(buffer, end, FD44_MODULE_HEADER, sizeof(FD44_MODULE_HEADER));
-        isModuleEmpty = 1;
-        if (!fd44)
+        size_t length = strlen(line);
+        if (length && line[length - 1] == '\n')
+            line[--length] = '\0';
+        else if (!feof(input))
         {
-            printf("FD44 module not found in input file.\n");
-            return ERR_NO_FD44_MODULE;
+            /* Skipping the rest of too long request */
+            int c;
+            while ((c = fgetc(input)) != EOF && c != '\n')
+                ;
+            serve_request(server, NULL, reply);
+            if (fflush(reply))
+                break;
+            continue;
         }
+        if (length && line[length - 1] == '\r')
+            line[--length] = '\0';
+        if (!length)
+            continue;
 
-        /* Looking for non-empty module */
-        while(isModuleEmpty && fd44)
-        {
+        serve_request(server, line, reply);
+        if (fflush(reply))
+            break;
+    }
 
-            /* Getting module size */
-            size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &fd44ModuleSize);
-            
-            /* Checking that module has BSA signature */
-            if (!memcmp(fd44 + FD44_MODULE_HEADER_BSA_OFFSET, FD44_MODULE_HEADER_BSA, sizeof(FD44_MODULE_HEADER_BSA)))
-            {
-                uint32_t pos;
-                /* Looking for non-FF byte starting from the beginning of data */
-                module = fd44 + FD44_MODULE_HEADER_LENGTH;
-                for (pos = 0; pos < fd44ModuleSize - FD44_MODULE_HEADER_LENGTH; pos++)
-                {
-                    /* If found - this module is not empty */
-                    if (module[pos] != 0xFF)
-                    {
-                        isModuleEmpty = 0;
-                        break;
-                    }
-                }
-            }
+    fclose(reply);
+    fclose(input);
+}
 
-            /* Finding next module */
-            fd44 = find_pattern(fd44 + FD44_MODULE_HEADER_LENGTH, end, FD44_MODULE_HEADER, sizeof(FD44_MODULE_HEADER));
-        }
+/* Server thread, accepts connections until listening socket is shut down */
+static void serve_connections(void* context)
+{
+    SERVER_THREAD* thread = (SERVER_THREAD*)context;
+    SERVER* server = thread->server;
 
-        /* Checking if all modules are empty */
-        if (isModuleEmpty)
+    for (;;)
+    {
+        int connection = accept(server->listener, NULL, NULL);
+        if (connection < 0)
         {
-            printf("FD44 modules are empty in input file. Data restoration required.\nUse FD44Editor to restore your data.\n");
+            if (serverStopping)
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("Can't accept connection.\n");
+            return;
         }
-        else /* Storing module contents */       
+
+        /* Connection is registered, so it can be shut down when server is stopped while client is idle */
+        mutex_lock(&server->mutex);
+        if (serverStopping)
         {
-            /* No need to store module header */
-            fd44ModuleSize -= FD44_MODULE_HEADER_LENGTH;
-        
-            /* No need to store FF bytes */
-            while (module[--fd44ModuleSize] == 0xFF)
-                ;
-            fd44ModuleSize++;
+            mutex_unlock(&server->mutex);
+            close(connection);
+            return;
+        }
+        server->connections[thread->index] = connection;
+        mutex_unlock(&server->mutex);
 
-            /* Allocating memory for module storage */
-            fd44Module = (uint8_t*)malloc(fd44ModuleSize);
-            if (!fd44Module)
-            {
-                printf("Can't allocate memory for FD44 module.\nFD44 module can't be copied.\n");
-                return ERR_MEMORY;
-            }
+        serve_connection(server, connection);
 
-            /* Storing module contents */
-            if (!memcpy(fd44Module, module, fd44ModuleSize))
-            {
-                printf("Memcpy failed.\nFD44 module can't be copied.\n");
-                return ERR_MEMORY;
-            }
-        }
+        mutex_lock(&server->mutex);
+        server->connections[thread->index] = -1;
+        mutex_unlock(&server->mutex);
     }
+}
 
-    /* Closing input file */
-    free(buffer);
-    fclose(file);
-    
-    /* Opening output file */
-    file = fopen(outputfile, "r+b");
-    if (!file)
+/* Answers requests written as manifest lines on local socket until termination signal is received.
+ * Output files saved as another files are kept loaded in up to templateCount slots.
+ * Returns ERR_OK when server is stopped by signal or ERR_* code on error */
+static int serve(const FD44* fd44, const char* path, uint32_t imageFlags, int8_t verify, uint32_t templateCount, uint32_t threads)
+{
+    SERVER server;                                                        /* server state */
+    SERVER_THREAD* workers;                                               /* threads serving connections */
+    struct sockaddr_un address;                                           /* socket address */
+    struct stat st;
+    sigset_t signals;                                                     /* termination signals */
+    sigset_t previous;                                                    /* signal mask before server start */
+    uint32_t started;                                                     /* number of started threads */
+    uint32_t i;
+
+    if (strlen(path) >= sizeof(address.sun_path))
     {
-        perror("Can't open output file.\n");
-        return ERR_OUTPUT_FILE;
+        printf("Socket path is too long.\n");
+        return ERR_ARGS;
     }
 
-    /* Determining file size */
-    fseek(file, 0, SEEK_END);
-    filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    /* Allocating memory for buffer */
-    buffer = (uint8_t*)malloc(filesize);
-    if (!buffer)
+    memset(&server, 0, sizeof(SERVER));
+    server.fd44 = fd44;
+    server.imageFlags = imageFlags;
+    server.verify = verify;
+    server.templateCount = templateCount > threads ? templateCount : threads;
+    server.templates = (TEMPLATE*)calloc(server.templateCount, sizeof(TEMPLATE));
+    server.connections = (int*)malloc(threads * sizeof(int));
+    workers = (SERVER_THREAD*)calloc(threads, sizeof(SERVER_THREAD));
+    if (!server.templates || !server.connections || !workers || !mutex_init(&server.mutex))
     {
-        printf("Can't allocate memory for output file.\n");
+        printf("Can't allocate memory for server.\n");
+        free(server.templates);
+        free(server.connections);
+        free(workers);
         return ERR_MEMORY;
     }
-    
-    /* Reading whole file to buffer */
-    read = fread((void*)buffer, sizeof(char), filesize, file);
-    if (read != filesize)
+    for (i = 0; i < threads; i++)
+        server.connections[i] = -1;
+
+    /* Replacing socket left by previous server, other files are never removed */
+    if (!lstat(path, &st) && S_ISSOCK(st.st_mode))
+        unlink(path);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    server.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listener < 0 || bind(server.listener, (struct sockaddr*)&address, sizeof(address)) || listen(server.listener, SOMAXCONN))
     {
-        perror("Can't read output file.\n");
+        perror("Can't listen on socket.\n");
+        if (server.listener >= 0)
+            close(server.listener);
+        mutex_destroy(&server.mutex);
+        free(server.templates);
+        free(server.connections);
+        free(workers);
         return ERR_OUTPUT_FILE;
     }
 
-    /* Searching for capsule file signature, if found - remove capsule file header */
-    hasCapsuleHeader = 0;
-    capsuleHeader = find_pattern(buffer, buffer + sizeof(APTIO_CAPSULE_GUID), APTIO_CAPSULE_GUID, sizeof(APTIO_CAPSULE_GUID));
-    if (capsuleHeader)
+    /* Termination signals are blocked in server threads and received only by current thread waiting for them,
+     * client closing connection before reading reply must not stop the server */
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    for (started = 0; started < threads; started++)
     {
-        APTIO_CAPSULE_HEADER *header = (APTIO_CAPSULE_HEADER*)buffer;
-        hasCapsuleHeader = 1;
-        headerSize = header->RomImageOffset;
-        buffer += headerSize;
-        filesize -= headerSize;
+        workers[started].server = &server;
+        workers[started].index = started;
+        if (!thread_start(&workers[started].thread, serve_connections, &workers[started]))
+            break;
     }
-    end = buffer + filesize;
-
-    /* Searching for bootefi signature */
-    bootefi = find_pattern(buffer, end, BOOTEFI_HEADER, sizeof(BOOTEFI_HEADER));
-    if (!bootefi)
+    if (started)
     {
-        printf("ASUS BIOS file signature not found in output file.\n");
-        return ERR_OUTPUT_FILE;
+        printf("Listening on %s.\n", path);
+        fflush(stdout);
+        while (!serverStopping)
+            sigsuspend(&previous);
     }
+    else
+        printf("Can't start server threads.\n");
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
 
-    /* Checking motherboard name */
-    if (!skipMotherboardNameCheck && memcmp(motherboardName, bootefi + BOOTEFI_MOTHERBOARD_NAME_OFFSET, strlen((const char*)motherboardName)))
-    {
-        printf("Motherboard name in output file differs from motherboard name in input file.\n");
-        return ERR_DIFFERENT_BOARD;
-    }
+    /* Stopping waiting threads and reading from idle clients, requests being served are completed */
+    mutex_lock(&server.mutex);
+    serverStopping = 1;
+    shutdown(server.listener, SHUT_RDWR);
+    for (i = 0; i < threads; i++)
+        if (server.connections[i] >= 0)
+            shutdown(server.connections[i], SHUT_RD);
+    mutex_unlock(&server.mutex);
+    for (i = 0; i < started; i++)
+        thread_join(&workers[i].thread);
 
-    /* If input file had GbE block, searching for it in output file and replacing it */
-    if (copyGbe && hasGbe)
+    close(server.listener);
+    unlink(path);
+    for (i = 0; i < server.templateCount; i++)
     {
-        /* First GbE block */
-        uint8_t* gbe = find_pattern(buffer, end, GBE_HEADER, sizeof(GBE_HEADER));
-        if (!gbe)
+        if (server.templates[i].path)
         {
-            printf("GbE region not found in output file.\n");
-            return ERR_NO_GBE;
-        }
-        if (!memcpy(gbe + GBE_MAC_OFFSET, gbeMac, sizeof(gbeMac)))
-        {
-            printf("Memcpy failed.\nGbE MAC can't be copied.\n");
-            return ERR_MEMORY;
+            fd44_close(&server.templates[i].image);
+            free(server.templates[i].path);
         }
+    }
+    mutex_destroy(&server.mutex);
+    free(server.templates);
+    free(server.connections);
+    free(workers);
+    return started ? ERR_OK : ERR_MEMORY;
+}
+#else
+/* Local sockets are not supported on Windows */
+static int serve(const FD44* fd44, const char* path, uint32_t imageFlags, int8_t verify, uint32_t templateCount, uint32_t threads)
+{
+    (void)fd44;
+    (void)path;
+    (void)imageFlags;
+    (void)verify;
+    (void)templateCount;
+    (void)threads;
+    printf("Server mode is not supported on this platform.\n");
+    return ERR_ARGS;
+}
+#endif
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    FD44 fd44;                                                            /* library state */
+    FD44_DONOR donor;                                                     /* input file data shared by batch jobs */
+    FD44_LOG log = { 0, NULL, 0, 0, NULL };                               /* messages are printed immediately */
+    JOB single;                                                           /* job of single file mode, also template of batch jobs */
+    JOB* jobs = NULL;                                                     /* jobs of batch or manifest mode */
+    uint32_t jobCount = 0;                                                /* number of jobs */
+    char* manifestText = NULL;                                            /* manifest contents, job paths point into it */
+    const char* manifest = NULL;                                          /* path to manifest file */
+    const char* results = NULL;                                           /* path to results file */
+    const char* statsFile = NULL;                                         /* path to statistics file, STDIO_FILE for standard error */
+    STATS setup;                                                          /* statistics of stages ran before jobs and of single job */
+    STATS* jobStats = NULL;                                               /* statistics of batch or manifest jobs */
+    const char* auditFile = NULL;                                         /* path to audit file */
+    AUDIT singleAudit;                                                    /* audit record of single job, or of input file of batch jobs */
+    AUDIT* jobAudits = NULL;                                              /* audit records of batch or manifest jobs */
+    uint64_t started = timer_now();                                       /* start time of program */
+    const char* delta = NULL;                                             /* path to delta file to be written */
+    const char* cacheDir = NULL;                                          /* directory of signature cache files */
+    const char* serverSocket = NULL;                                      /* path to socket of server mode */
+    uint32_t templateSlots = SERVER_TEMPLATES;                            /* number of output files kept loaded in server mode */
+    FD44_IMAGE* templates = NULL;                                         /* output files shared by manifest jobs */
+    uint32_t templateCount = 0;                                           /* number of shared output files */
+    int8_t batchMode = 0;                                                 /* flag that many output files are patched */
+    int8_t extractMode = 0;                                               /* flag that input file data is saved to bundle */
+    int8_t applyDeltaMode = 0;                                            /* flag that delta file is applied to output file */
+    uint32_t imageFlags = 0;                                              /* flags used to load files */
+    int8_t verify = FD44_VERIFY_TOUCHED;                                  /* verification mode of patched output files */
+    uint32_t threads = 0;                                                 /* number of pool threads, 0 - number of CPUs */
+    uint32_t ioDepth = IO_DEPTH;                                          /* number of background I/O threads, 0 - no background I/O */
+    uint64_t ioMemory = (uint64_t)IO_MEMORY << 20;                        /* bytes held by output files waiting to be written */
+    uint32_t i;
+    int result;                                                           /* job result */
+    int arg;                                                              /* current argument */
 
-        /* Second GbE block */
-        gbe = find_pattern(gbe + sizeof(GBE_HEADER), end, GBE_HEADER, sizeof(GBE_HEADER));
-        
-        if (gbe && !memcpy(gbe + GBE_MAC_OFFSET, gbeMac, sizeof(gbeMac)))
+    /* Parsing long options, remaining arguments are shifted so argv[1] is the first short option or file */
+    for (arg = 1; arg < argc && !strncmp(argv[arg], "--", 2); arg++)
+    {
+        if (!strcmp(argv[arg], "--no-mmap"))
+            imageFlags |= IMAGE_NO_MMAP;
+        else if (!strcmp(argv[arg], "--batch"))
+            batchMode = 1;
+        else if (!strcmp(argv[arg], "--extract"))
+            extractMode = 1;
+        else if (!strncmp(argv[arg], "--delta=", 8) && argv[arg][8])
+            delta = argv[arg] + 8;
+        else if (!strcmp(argv[arg], "--apply-delta"))
+            applyDeltaMode = 1;
+        else if (!strncmp(argv[arg], "--threads=", 10) && atoi(argv[arg] + 10) > 0)
+            threads = (uint32_t)atoi(argv[arg] + 10);
+        else if (!strncmp(argv[arg], "--manifest=", 11) && argv[arg][11])
+            manifest = argv[arg] + 11;
+        else if (!strncmp(argv[arg], "--results=", 10) && argv[arg][10])
+            results = argv[arg] + 10;
+        else if (!strcmp(argv[arg], "--stats"))
+            statsFile = STDIO_FILE;
+        else if (!strncmp(argv[arg], "--stats=", 8) && argv[arg][8])
+            statsFile = argv[arg] + 8;
+        else if (!strncmp(argv[arg], "--audit=", 8) && argv[arg][8])
+            auditFile = argv[arg] + 8;
+        else if (!strncmp(argv[arg], "--cache=", 8) && argv[arg][8])
+            cacheDir = argv[arg] + 8;
+        else if (!strncmp(argv[arg], "--serve=", 8) && argv[arg][8])
+            serverSocket = argv[arg] + 8;
+        else if (!strncmp(argv[arg], "--templates=", 12) && atoi(argv[arg] + 12) > 0)
+            templateSlots = (uint32_t)atoi(argv[arg] + 12);
+        else if (!strncmp(argv[arg], "--io-depth=", 11) && argv[arg][11] >= '0' && argv[arg][11] <= '9')
+            ioDepth = (uint32_t)atoi(argv[arg] + 11);
+        else if (!strncmp(argv[arg], "--io-memory=", 12) && atoi(argv[arg] + 12) > 0)
+            ioMemory = (uint64_t)atoi(argv[arg] + 12) << 20;
+        else if (!strcmp(argv[arg], "--verify=none"))
+            verify = FD44_VERIFY_NONE;
+        else if (!strcmp(argv[arg], "--verify=touched"))
+            verify = FD44_VERIFY_TOUCHED;
+        else if (!strcmp(argv[arg], "--verify=all"))
+            verify = FD44_VERIFY_ALL;
+        else
         {
-            printf("Memcpy failed.\nGbE MAC can't be copied.\n");
-            return ERR_MEMORY;
+            printf("Unknown option %s.\n", argv[arg]);
+            return ERR_ARGS;
         }
-        
-        printf("GbE MAC address copied.\n");
     }
+    argc -= arg - 1;
+    argv += arg - 1;
 
-    /* Searching for EFI volume containing MSOA module and add SLIC pubkey and marker modules if found */
-    if (copySLIC && hasSLIC)
+    if (serverSocket ? (argc != 1 || manifest || batchMode || extractMode || delta || applyDeltaMode || statsFile || auditFile)
+        : manifest ? (argc != 1 || batchMode || extractMode || delta || applyDeltaMode)
+        : applyDeltaMode ? (argc != 3 || batchMode || extractMode || delta || statsFile || auditFile)
+        : (argc < 3 || (argv[1][0] == '-' && argv[1][1] && argc < 4) || (batchMode + extractMode + (delta != NULL) > 1)))
     {
-        uint8_t* efi_volume_begin;
-        uint8_t* efi_volume_end;
-        uint8_t* msoa_module;
-        uint8_t* pubkey_module;
-        uint8_t* marker_module;
-        uint8_t  data_checksum;
-        
-        do
-        {
-            /* Searching for existing SLIC modules */
-            pubkey_module = find_pattern(buffer, end, SLIC_PUBKEY_HEADER, sizeof(SLIC_PUBKEY_HEADER));
-            marker_module = find_pattern(buffer, end, SLIC_MARKER_HEADER, sizeof(SLIC_MARKER_HEADER));
-            if (pubkey_module ||  marker_module)
-            {
-                printf("SLIC pubkey or marker found in output file.\nSLIC table copy is not needed.\n");
-                break;
-            }
+        printf("FD44Copier v0.7.0\nThis program copies GbE MAC address, FD44 module data,\n"\
+               "SLIC pubkey and marker from one BIOS image file to another.\n\n"
+               "Usage: FD44Copier <--LONG-OPTIONS> <-OPTIONS> INFILE OUTFILE\n"
+               "       FD44Copier --batch <--LONG-OPTIONS> <-OPTIONS> INFILE OUTFILE...\n"
+               "       FD44Copier --manifest=FILE <--LONG-OPTIONS>\n"
+               "       FD44Copier --extract <--LONG-OPTIONS> <-OPTIONS> INFILE BUNDLE\n"
+               "       FD44Copier --apply-delta <--LONG-OPTIONS> DELTA OUTFILE\n"
+               "       FD44Copier --serve=SOCKET <--LONG-OPTIONS>\n\n"
+               "Options: m - copy module data.\n"
+               "         g - copy GbE MAC address.\n"
+               "         s - copy SLIC pubkey and marker.\n"
+               "         n - do not check that both BIOS files are for same motherboard.\n"
+               "         <none> - copy all available data and check for same motherboard in both BIOS files.\n\n"
+               "Long options: --no-mmap - read files to memory instead of mapping them.\n"
+               "              --batch - copy data from INFILE to every OUTFILE in parallel.\n"
+               "              --extract - save data of INFILE to small BUNDLE file, which can be used as INFILE later.\n"
+               "              --delta=FILE - write only changes of OUTFILE to FILE, OUTFILE itself is not changed.\n"
+               "              --apply-delta - write changes from DELTA file to OUTFILE it is made for.\n"
+               "              --manifest=FILE - run jobs from FILE in parallel, one job per line:\n"
+               "                <-OPTIONS> INFILE OUTFILE <SAVEAS>, patched OUTFILE is saved to SAVEAS if it is given.\n"
+               "                OUTFILE saved to SAVEAS by many jobs is loaded once and shared by them.\n"
+               "              --threads=N - use N threads in batch, manifest and server modes and to scan large files, default is number of CPUs.\n"
+               "              --io-depth=N - read files of next jobs ahead and write patched OUTFILEs with N background threads\n"
+               "                in batch and manifest modes, 0 disables it. Default is 4.\n"
+               "              --io-memory=MB - limit memory held by OUTFILEs waiting to be written in background. Default is 256.\n"
+               "              --results=FILE - write result and timings of every job to FILE as JSON.\n"
+               "              --stats<=FILE> - write time and counters of every stage of all jobs to standard error,\n"
+               "                or to FILE, as JSON with percentiles over jobs.\n"
+               "              --audit=FILE - write SHA-256 of INFILE, of OUTFILE before and after patching, changed ranges\n"
+               "                and result of every job to FILE as JSON. Files are hashed while they are read and written,\n"
+               "                hashes of standard input and output, of bundles and of INFILE lists are null.\n"
+               "              --verify=MODE - check header and data checksums of FFS files and volumes and free space of volumes\n"
+               "                of patched OUTFILE before it is written, failed checks fail the job. MODE is none, touched\n"
+               "                to check only changed files and volumes containing them, or all. Default is touched.\n"
+               "              --cache=DIR - keep signatures found in files in DIR, so unchanged files are not scanned again.\n"
+               "              --serve=SOCKET - answer requests written as manifest lines on local SOCKET until terminated,\n"
+               "                every request gets one line of JSON with its result, timings and messages.\n"
+               "              --templates=N - keep up to N OUTFILEs loaded in server mode while they are unchanged,\n"
+               "                they are used by requests with SAVEAS. Default is 16.\n\n"
+               "INFILE can be a list of backup dumps of one motherboard joined by +, e.g. dump1.bin+dump2.bin, they are read\n"
+               "in parallel and every field is taken from the best of them: the first non-empty FD44 module, the first GbE MAC\n"
+               "address which is not a stub and SLIC pubkey and marker of SLIC modules before ones of ASUSBKP module.\n"
+               "The file every field is taken from is reported, dumps which can't be loaded are skipped.\n"
+               "INFILE or OUTFILE can be - to read it from standard input, patched OUTFILE is written to standard output then\n"
+               "and messages are printed to standard error. Output must be discarded if exit code is not 0.\n\n");
+        return ERR_ARGS;
+    }
 
-            /* Searching for second EFI Volume to instert SLIC */
-            efi_volume_begin = find_pattern(buffer, end, EFI_VOLUME_HEADER, sizeof(EFI_VOLUME_HEADER));
-            if (!efi_volume_begin)
-            {
-                printf("First EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
-                break;
-            }
-            efi_volume_end = efi_volume_begin + *(uint32_t*)(efi_volume_begin + sizeof(EFI_VOLUME_HEADER));
-            efi_volume_begin = find_pattern(efi_volume_end, end, EFI_VOLUME_HEADER, sizeof(EFI_VOLUME_HEADER));
-            if (!efi_volume_begin)
-            {
-                printf("Second EFI volume not found in output file. The file is possibly corrupted. SLIC table can't be inserted.");
-                break;
-            }
-            efi_volume_end = efi_volume_begin + *(uint32_t*)(efi_volume_begin + sizeof(EFI_VOLUME_HEADER)) - 16; 
-            
-            /* Searching for DummyMSOA or MSOA module */
-            msoa_module = find_pattern(efi_volume_begin, efi_volume_end, DUMMY_MSOA_MODULE_HEADER, sizeof(DUMMY_MSOA_MODULE_HEADER));
-            if (!msoa_module)
-            {
-                msoa_module = find_pattern(efi_volume_begin, efi_volume_end, MSOA_MODULE_HEADER, sizeof(MSOA_MODULE_HEADER));
-                if (!msoa_module)
-                {
-                    printf("DummyMSOA and MSOA module not found in first EFI volume.\nSLIC table can't be copied.\n");
-                    break;
-                }
-            }
+    /* Applying delta, no input file is needed for that */
+    if (applyDeltaMode)
+        return fd44_delta_apply(argv[1], argv[2], imageFlags, &log);
 
-            /* Searching for free space at the end of EFI volume with MSOA module to insert pubkey module */
-            pubkey_module = find_free_space(efi_volume_begin, efi_volume_end, SLIC_PUBKEY_LENGTH + SLIC_MARKER_LENGTH);
-            if (!pubkey_module)
-            {
-                printf("Not enough free space to insert SLIC modules.\nSLIC table can't be copied.\n");
-                break;
-            }
-            
-            /* Writing pubkey header */
-            if (!memcpy(pubkey_module, SLIC_PUBKEY_HEADER, sizeof(SLIC_PUBKEY_HEADER)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Writing pubkey first part */
-            if (!memcpy(pubkey_module + sizeof(SLIC_PUBKEY_HEADER), SLIC_PUBKEY_PART1, sizeof(SLIC_PUBKEY_PART1)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Writing pubkey */
-            if (!memcpy(pubkey_module + sizeof(SLIC_PUBKEY_HEADER) + sizeof(SLIC_PUBKEY_PART1), slicPubkey, sizeof(slicPubkey)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Calculating pubkey module data checksum */
-            if (!calculate_checksum(pubkey_module + MODULE_DATA_CHECKSUM_START, SLIC_PUBKEY_LENGTH - MODULE_DATA_CHECKSUM_START, &data_checksum))
-            {
-                printf("Pubkey module checksum calculation failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Writing pubkey module data checksum */
-            pubkey_module[MODULE_DATA_CHECKSUM_OFFSET] = data_checksum;
+    /* Files are hashed while they are loaded */
+    if (auditFile)
+        imageFlags |= IMAGE_HASH;
 
-            /* Searching for free space to insert marker module */
-            marker_module = find_free_space(pubkey_module, efi_volume_end, SLIC_MARKER_LENGTH);
-            if (!marker_module)
-            {
-                printf("Not enough free space to insert marker module.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
+    /* Checking for options presence and setting options */
+    memset(&single, 0, sizeof(JOB));
+    memset(&singleAudit, 0, sizeof(AUDIT));
+    single.imageFlags = imageFlags;
+    if (auditFile)
+        single.audit = &singleAudit;
+    if (!manifest && !serverSocket)
+    {
+        if (argv[1][0] == '-' && argv[1][1])
+        {
+            set_options(&single.options, argv[1]);
+            arg = 2;
+        }
+        else
+        {
+            set_options(&single.options, NULL);
+            arg = 1;
+        }
+        single.options.verify = verify;
+        single.inputfile = argv[arg];
+        single.outputfile = argv[arg + 1];
+        single.extract = extractMode;
+        single.delta = delta;
 
-            /* Writing marker header*/
-            if (!memcpy(marker_module, SLIC_MARKER_HEADER, sizeof(SLIC_MARKER_HEADER)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Writing marker first part*/
-            if (!memcpy(marker_module + sizeof(SLIC_MARKER_HEADER), SLIC_MARKER_PART1, sizeof(SLIC_MARKER_PART1)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Writing marker */
-            if (!memcpy(marker_module + sizeof(SLIC_MARKER_HEADER) + sizeof(SLIC_MARKER_PART1), slicMarker, sizeof(slicMarker)))
-            {
-                printf("Memcpy failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
-            }
-            /* Calculating pubkey module data checksum */
-            if (!calculate_checksum(marker_module + MODULE_DATA_CHECKSUM_START, SLIC_MARKER_LENGTH - MODULE_DATA_CHECKSUM_START, &data_checksum))
+        if (!strcmp(single.inputfile, STDIO_FILE) || !strcmp(single.outputfile, STDIO_FILE))
+        {
+            if (!strcmp(single.inputfile, single.outputfile) || (extractMode && !strcmp(single.outputfile, STDIO_FILE)))
             {
-                printf("Marker module checksum calculation failed.\nSLIC table can't be copied.\n");
-                return ERR_MEMORY;
+                printf("Standard input can be used either for INFILE or for OUTFILE, but not for BUNDLE.\n");
+                return ERR_ARGS;
             }
-            /* Writing marker module data checksum */
-            marker_module[MODULE_DATA_CHECKSUM_OFFSET] = data_checksum;
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            /* Standard output holds patched output file, so messages are printed to standard error after the job */
+            log.buffered = !strcmp(single.outputfile, STDIO_FILE);
+        }
+    }
+    if (!threads)
+        threads = cpu_count();
+
+    /* Selecting search kernel for current CPU and building signature scanner */
+    if (!fd44_init(&fd44))
+    {
+        printf("Signature scanner can't be initialized.\n");
+        return ERR_MEMORY;
+    }
+    fd44.scanThreads = threads;
+    fd44.cacheDir = cacheDir;
 
-            printf("SLIC pubkey and marker copied.\n");
-        } while (0); /* Used for break */
+    /* Collecting statistics of stages ran by current thread, it counts CPU time of all threads it starts */
+    if (statsFile)
+    {
+        stats_init(&setup, 1);
+        stats_start(&setup);
+        log.stats = &setup;
     }
 
-    /* Searching for module header */
-    if (copyModule)
+    if (serverSocket)
     {
-        char isCopied;
-        uint32_t currentModuleSize;
-        uint8_t* module;
-        uint8_t* fd44 = find_pattern(buffer, end, FD44_MODULE_HEADER, sizeof(FD44_MODULE_HEADER));
-        if (!fd44)
+        /* Requests are served in parallel, so each of them scans its files on its own thread */
+        fd44.scanThreads = 1;
+        result = serve(&fd44, serverSocket, imageFlags, verify, templateSlots, threads);
+    }
+    else if (manifest)
+    {
+        /* Running jobs from manifest */
+        jobs = read_manifest(manifest, imageFlags, verify, &jobCount, &manifestText);
+        if (!jobs)
         {
-            printf("FD44 module not found in output file.\n");
-            return ERR_NO_FD44_MODULE;
+            fd44_free(&fd44);
+            return ERR_ARGS;
         }
-
-        if (!isModuleEmpty)
+        if ((statsFile && !(jobStats = alloc_stats(jobs, jobCount))) || (auditFile && !(jobAudits = alloc_audits(jobs, jobCount))))
+        {
+            printf("Can't allocate memory for job records.\n");
+            free(jobStats);
+            free(jobs);
+            free(manifestText);
+            fd44_free(&fd44);
+            return ERR_MEMORY;
+        }
+        /* Output files patched by many jobs are loaded once, scanning them with all threads */
+        templates = load_templates(&fd44, jobs, jobCount, &templateCount, log.stats);
+        fd44.scanThreads = 1;
+        result = run_jobs(&fd44, jobs, jobCount, threads, ioDepth, ioMemory);
+        for (i = 0; i < templateCount; i++)
+            fd44_close(&templates[i]);
+        free(templates);
+    }
+    else if (batchMode)
+    {
+        /* Extracting input file data once and copying it to all output files */
+        result = extract_donor(&fd44, &single, &donor, &log);
+        if (result == ERR_OK)
         {
-            /* Copying data to all BSA_ modules */
-            isCopied = 0;
-            while (fd44)
+            jobCount = (uint32_t)(argc - arg - 1);
+            jobs = (JOB*)calloc(jobCount, sizeof(JOB));
+            if (jobs && statsFile)
+                jobStats = alloc_stats(jobs, jobCount);
+            if (jobs && auditFile)
+                jobAudits = alloc_audits(jobs, jobCount);
+            if (!jobs || (statsFile && !jobStats) || (auditFile && !jobAudits))
             {
-                /* Getting module size */
-                size2int(fd44 + FD44_MODULE_SIZE_OFFSET, &currentModuleSize);
-                if (!memcmp(fd44 + FD44_MODULE_HEADER_BSA_OFFSET, FD44_MODULE_HEADER_BSA, sizeof(FD44_MODULE_HEADER_BSA)))
+                printf("Can't allocate memory for batch jobs.\n");
+                result = ERR_MEMORY;
+            }
+            else
+            {
+                for (i = 0; i < jobCount; i++)
                 {
-                    module = fd44 + FD44_MODULE_HEADER_LENGTH;
-                    /* Checking that there is enough space in module to insert data */
-                    if (currentModuleSize - FD44_MODULE_HEADER_LENGTH < fd44ModuleSize)
-                    {
-                        printf("FD44 module at %08X is too small.\n", module - buffer);
-                        fd44 = find_pattern(fd44 + currentModuleSize, end, FD44_MODULE_HEADER, sizeof(FD44_MODULE_HEADER));
-                        break;
-                    }
-                    /* Copying module data*/
-                    if (!memcpy(module, fd44Module, fd44ModuleSize))
+                    STATS* stats = jobs[i].stats;
+                    AUDIT* audit = jobs[i].audit;
+                    jobs[i] = single;
+                    jobs[i].outputfile = argv[arg + 1 + i];
+                    jobs[i].donor = &donor;
+                    jobs[i].stats = stats;
+                    jobs[i].audit = audit;
+
+                    /* Input file is loaded once, so all jobs have its hash */
+                    if (audit)
                     {
-                        printf("Memcpy failed.\nFD44 module can't be copied.\n");
-                        return ERR_MEMORY;
+                        memcpy(audit->inputHash, singleAudit.inputHash, HASH_SHA256_LENGTH);
+                        audit->hasInputHash = singleAudit.hasInputHash;
                     }
-                    isCopied = 1;
                 }
-            
-                fd44 = find_pattern(fd44 + currentModuleSize, end, FD44_MODULE_HEADER, sizeof(FD44_MODULE_HEADER));
-            }
-                
-            /* Checking if there is at least one non-empty module after copying */
-            if(isCopied)
-                printf("FD44 module copied.\n");
-            else
-            {
-                printf("FD44 module can't be copied.\n");
-                return ERR_NO_FD44_MODULE;
+                /* Jobs are already run in parallel, so each of them scans its file on its own thread */
+                fd44.scanThreads = 1;
+                result = run_jobs(&fd44, jobs, jobCount, threads, ioDepth, ioMemory);
             }
         }
+        fd44_donor_free(&donor);
+    }
+    else
+    {
+        /* Running single job in current thread */
+        single.stats = log.stats;
+        result = run_job(&fd44, &single, &log, NULL);
+        jobs = &single;
+        jobCount = 1;
+        if (log.buffered)
+        {
+            if (log.buffer)
+                fputs(log.buffer, stderr);
+            fd44_log_free(&log);
+        }
     }
 
-    /* Reopening file to resize it */
-    fclose(file);
-    file = fopen(outputfile, "wb");
-
-    /* Writing buffer to output file */
-    read = fwrite(buffer, sizeof(char), filesize, file);
-    if (read != filesize)
+    if (results && jobs && !write_results(results, jobs, jobCount))
     {
-        perror("Can't write output file.\n");
-        return ERR_OUTPUT_FILE;
+        perror("Can't write results file.\n");
+        if (result == ERR_OK)
+            result = ERR_OUTPUT_FILE;
     }
 
-    /* Cleaning */
-    if (hasCapsuleHeader)
+    if (auditFile && jobs && !write_audit(auditFile, jobs, jobCount))
     {
-        printf("Capsule file header removed.\n");
-        buffer -= headerSize;
+        perror("Can't write audit file.\n");
+        if (result == ERR_OK)
+            result = ERR_OUTPUT_FILE;
     }
-    free(buffer);
-    if (copyModule && !isModuleEmpty)
-        free(fd44Module);
-    fclose(file);
 
-    if (isModuleEmpty)
-        return ERR_EMPTY_FD44_MODULE;
+    if (statsFile)
+    {
+        stats_stop(&setup);
+        if (jobs && !save_stats(statsFile, jobs, jobCount, jobs == &single ? NULL : &setup, timer_now() - started))
+        {
+            perror("Can't write statistics file.\n");
+            if (result == ERR_OK)
+                result = ERR_OUTPUT_FILE;
+        }
+    }
 
-    return ERR_OK;
+    free(jobStats);
+    free_audits(jobAudits, jobCount);
+    free(singleAudit.patched);
+    if (jobs != &single)
+        free(jobs);
+    free(manifestText);
+    fd44_free(&fd44);
+    return result;
 }
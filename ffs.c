@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ffs.h"
+#include "bios.h"
+#include "hash.h"
+#include "search.h"
+
+/* Reads 16-bit little-endian value */
+static uint16_t read16(const uint8_t* data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+/* Reads 32-bit little-endian value */
+static uint32_t read32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+/* Reads 64-bit little-endian value */
+static uint64_t read64(const uint8_t* data)
+{
+    return (uint64_t)read32(data) | ((uint64_t)read32(data + 4) << 32);
+}
+
+/* Aligns offset from volume start up to FFS file alignment */
+static uint32_t align_file(uint32_t volume, uint32_t offset)
+{
+    return volume + ((offset - volume + EFI_FFS_ALIGNMENT - 1) & ~(uint32_t)(EFI_FFS_ALIGNMENT - 1));
+}
+
+/* Checks that valid volume header is located at offset and returns its length.
+ * Returns volume length or 0 if there is no volume */
+uint32_t ffs_volume_length(const uint8_t* buffer, uint32_t size, uint32_t offset)
+{
+    const uint8_t* header = buffer + offset;
+    uint64_t length;
+    uint16_t headerLength;
+
+    if (size < sizeof(EFI_FIRMWARE_VOLUME_HEADER) || offset > size - sizeof(EFI_FIRMWARE_VOLUME_HEADER)
+        || memcmp(header + EFI_FVH_SIGNATURE_OFFSET, EFI_FVH_SIGNATURE, sizeof(EFI_FVH_SIGNATURE)))
+        return 0;
+
+    length = read64(header + 32);
+    headerLength = read16(header + 48);
+    if (headerLength < sizeof(EFI_FIRMWARE_VOLUME_HEADER) || length < headerLength || length > size - offset)
+        return 0;
+    return (uint32_t)length;
+}
+
+/* Returns offset of the first file of volume located at offset, aligned to file alignment */
+static uint32_t first_file(const uint8_t* buffer, uint32_t offset, uint32_t length)
+{
+    const uint8_t* header = buffer + offset;
+    uint32_t end = offset + length;
+    uint32_t current;
+
+    /* Files start after header and optional extended header */
+    current = offset + read16(header + 48);
+    if (read16(header + 52))
+    {
+        uint32_t extended = offset + read16(header + 52);
+        if (extended <= end - EFI_FIRMWARE_VOLUME_EXT_HEADER_SIZE_OFFSET - 4)
+        {
+            uint32_t extendedEnd = extended + read32(buffer + extended + EFI_FIRMWARE_VOLUME_EXT_HEADER_SIZE_OFFSET);
+            if (extendedEnd > current && extendedEnd <= end)
+                current = extendedEnd;
+        }
+    }
+    return align_file(offset, current);
+}
+
+/* Results of walk_file */
+#define WALK_FILE   0               /* valid file header */
+#define WALK_FREE   1               /* free space */
+#define WALK_BROKEN 2               /* file header with invalid size */
+
+/* Reads header of file located at current of volume ending at end, erased is the value of erased byte.
+ * Returns WALK_FILE and stores file size and header length if there is a valid file header,
+ * WALK_FREE if free space starts at current or WALK_BROKEN if file header is not valid */
+static int walk_file(const uint8_t* buffer, uint32_t current, uint32_t end, uint8_t erased, uint32_t* size, uint32_t* headerLength)
+{
+    const uint8_t* file = buffer + current;
+    uint32_t i;
+
+    if (current > end || end - current < sizeof(EFI_FFS_FILE_HEADER))
+        return WALK_FREE;
+
+    /* Free space starts with erased header */
+    for (i = 0; i < sizeof(EFI_FFS_FILE_HEADER) && file[i] == erased; i++)
+        ;
+    if (i == sizeof(EFI_FFS_FILE_HEADER))
+        return WALK_FREE;
+
+    *size = file[20] | (file[21] << 8) | (file[22] << 16);
+    *headerLength = sizeof(EFI_FFS_FILE_HEADER);
+    if ((file[19] & EFI_FFS_ATTRIB_LARGE_FILE) && !*size && end - current >= EFI_FFS_FILE_HEADER2_LENGTH)
+    {
+        uint64_t largeSize = read64(file + sizeof(EFI_FFS_FILE_HEADER));
+        *size = largeSize > end - current ? 0 : (uint32_t)largeSize;
+        *headerLength = EFI_FFS_FILE_HEADER2_LENGTH;
+    }
+    if (*size < *headerLength || *size > end - current)
+        return WALK_BROKEN;
+    return WALK_FILE;
+}
+
+/* Checks that volume header has FFSv2 or FFSv3 file system GUID.
+ * Returns 1 if it has and 0 if it hasn't */
+static int is_ffs(const uint8_t* header)
+{
+    return !memcmp(header + 16, EFI_FFS_V2_GUID, sizeof(EFI_FFS_V2_GUID))
+        || !memcmp(header + 16, EFI_FFS_V3_GUID, sizeof(EFI_FFS_V3_GUID));
+}
+
+/* Adds volume and all its files to index.
+ * Returns 1 on success and 0 on failure */
+static int add_volume(FFS_INDEX* index, const uint8_t* buffer, uint32_t offset, uint32_t length)
+{
+    const uint8_t* header = buffer + offset;
+    FFS_VOLUME* volume;
+    uint32_t end = offset + length;
+    uint32_t current;
+    uint32_t fileSize;
+    uint32_t headerLength;
+    uint8_t erased;
+
+    if (index->volumeCount == index->volumeCapacity)
+    {
+        uint32_t capacity = index->volumeCapacity ? index->volumeCapacity * 2 : 16;
+        FFS_VOLUME* volumes = (FFS_VOLUME*)realloc(index->volumes, capacity * sizeof(FFS_VOLUME));
+        if (!volumes)
+            return 0;
+        index->volumes = volumes;
+        index->volumeCapacity = capacity;
+    }
+    volume = &index->volumes[index->volumeCount];
+    volume->offset = offset;
+    volume->length = length;
+    volume->firstFile = index->fileCount;
+    volume->fileCount = 0;
+    volume->isFfs = is_ffs(header);
+    volume->erasePolarity = erased = (read32(header + 44) & EFI_FVB_ERASE_POLARITY) ? 0xFF : 0x00;
+
+    current = first_file(buffer, offset, length);
+    volume->freeOffset = current;
+    index->volumeCount++;
+    if (!volume->isFfs)
+        return 1;
+
+    /* Walking file headers by their size fields until free space or broken header is found */
+    while (walk_file(buffer, current, end, erased, &fileSize, &headerLength) == WALK_FILE)
+    {
+        const uint8_t* file = buffer + current;
+
+        if (index->fileCount == index->fileCapacity)
+        {
+            uint32_t capacity = index->fileCapacity ? index->fileCapacity * 2 : 64;
+            FFS_FILE* files = (FFS_FILE*)realloc(index->files, capacity * sizeof(FFS_FILE));
+            if (!files)
+                return 0;
+            index->files = files;
+            index->fileCapacity = capacity;
+        }
+        index->files[index->fileCount].offset = current;
+        index->files[index->fileCount].size = fileSize;
+        index->files[index->fileCount].volume = index->volumeCount - 1;
+        index->files[index->fileCount].type = file[18];
+        index->files[index->fileCount].state = erased ? (uint8_t)~file[23] : file[23];
+        index->fileCount++;
+        volume->fileCount++;
+
+        current = align_file(offset, current + fileSize);
+        volume->freeOffset = current < end ? current : end;
+    }
+
+    return 1;
+}
+
+/* Builds index of firmware volumes found by scanner in buffer and volumes following them back to back.
+ * Returns 1 on success and 0 on failure */
+int ffs_index_build(FFS_INDEX* index, const uint8_t* buffer, uint32_t size, const SCAN_RESULT* hits)
+{
+    uint32_t i;
+
+    if (!index || !buffer || !hits)
+        return 0;
+    memset(index, 0, sizeof(FFS_INDEX));
+
+    for (i = 0; i < hits->count; i++)
+    {
+        uint32_t offset;
+
+        if (hits->hits[i].signature != SIG_EFI_VOLUME)
+            continue;
+        offset = hits->hits[i].offset;
+
+        /* Skipping signatures inside of already indexed volumes */
+        if (index->volumeCount
+            && offset < index->volumes[index->volumeCount - 1].offset + index->volumes[index->volumeCount - 1].length)
+            continue;
+
+        /* Adding found volume and all volumes following it without gaps */
+        if (!ffs_index_volume(index, buffer, size, offset))
+        {
+            ffs_index_free(index);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Adds volume located at offset and all volumes following it back to back to index.
+ * Returns 1 on success and 0 on failure */
+int ffs_index_volume(FFS_INDEX* index, const uint8_t* buffer, uint32_t size, uint32_t offset)
+{
+    uint32_t length;
+
+    while ((length = ffs_volume_length(buffer, size, offset)) != 0)
+    {
+        if (!add_volume(index, buffer, offset, length))
+            return 0;
+        offset += length;
+    }
+    return 1;
+}
+
+/* Frees memory used by index */
+void ffs_index_free(FFS_INDEX* index)
+{
+    if (!index)
+        return;
+    free(index->volumes);
+    free(index->files);
+    memset(index, 0, sizeof(FFS_INDEX));
+}
+
+/* Looks up next file with given GUID after file previous, or the first one if previous is NULL.
+ * Returns pointer to found file or NULL if not found */
+const FFS_FILE* ffs_find_file(const FFS_INDEX* index, const uint8_t* buffer, const uint8_t* guid, uint32_t volume, const FFS_FILE* previous)
+{
+    uint32_t i, last;
+
+    if (!index || !buffer || !guid)
+        return NULL;
+
+    i = previous ? (uint32_t)(previous - index->files) + 1 : 0;
+    last = index->fileCount;
+    if (volume != FFS_ANY_VOLUME)
+    {
+        if (volume >= index->volumeCount)
+            return NULL;
+        if (i < index->volumes[volume].firstFile)
+            i = index->volumes[volume].firstFile;
+        last = index->volumes[volume].firstFile + index->volumes[volume].fileCount;
+    }
+
+    for (; i < last; i++)
+        if (!memcmp(buffer + index->files[i].offset, guid, 16))
+            return &index->files[i];
+    return NULL;
+}
+
+/* Looks up volume with FFS file system by its number among such volumes, starting from 0.
+ * Returns pointer to found volume or NULL if not found */
+const FFS_VOLUME* ffs_find_volume(const FFS_INDEX* index, uint32_t number)
+{
+    uint32_t i;
+
+    if (!index)
+        return NULL;
+    for (i = 0; i < index->volumeCount; i++)
+        if (index->volumes[i].isFfs && !number--)
+            return &index->volumes[i];
+    return NULL;
+}
+
+/* Starts verification of files overlapping touched ranges and volumes containing them, or of all files if touched is NULL */
+void ffs_verify_init(FFS_VERIFY* verify, const IMAGE_RANGE* touched, uint32_t touchedCount)
+{
+    memset(verify, 0, sizeof(FFS_VERIFY));
+    verify->touched = touched;
+    verify->touchedCount = touchedCount;
+}
+
+/* Records failed check, only the first FFS_VERIFY_FAILURES failures are stored */
+static void add_failure(FFS_VERIFY* verify, uint8_t check, uint32_t offset, uint32_t volume, uint16_t stored, uint16_t expected)
+{
+    if (verify->failureCount < FFS_VERIFY_FAILURES)
+    {
+        FFS_FAILURE* failure = &verify->failures[verify->failureCount];
+        failure->check = check;
+        failure->offset = offset;
+        failure->volume = volume;
+        failure->stored = stored;
+        failure->expected = expected;
+    }
+    verify->failureCount++;
+}
+
+/* Checks that range from offset to offset + length overlaps a touched range, ranges before offset are skipped for good.
+ * Returns 1 if it does and 0 if it doesn't */
+static int is_touched(const FFS_VERIFY* verify, uint32_t* range, uint32_t offset, uint32_t length)
+{
+    if (!verify->touched)
+        return 1;
+    while (*range < verify->touchedCount && verify->touched[*range].offset + verify->touched[*range].length <= offset)
+        (*range)++;
+    return *range < verify->touchedCount && verify->touched[*range].offset < offset + length;
+}
+
+/* Verifies checksums of file at current with given size and header length */
+static void verify_file(FFS_VERIFY* verify, const uint8_t* buffer, uint32_t current, uint32_t size, uint32_t headerLength, uint32_t volume)
+{
+    const uint8_t* file = buffer + current;
+    uint8_t sum;
+
+    /* Header checksum is calculated with file checksum and state taken as zero */
+    sum = (uint8_t)(hash_sum8(file, headerLength) - file[17] - file[23]);
+    if (sum)
+        add_failure(verify, FFS_CHECK_HEADER_CHECKSUM, current, volume, file[16], (uint8_t)(file[16] - sum));
+
+    /* Data checksum makes data sum zero, files without it have fixed value instead */
+    if (file[19] & EFI_FFS_ATTRIB_CHECKSUM)
+    {
+        sum = (uint8_t)(hash_sum8(file + headerLength, size - headerLength) + file[17]);
+        if (sum)
+            add_failure(verify, FFS_CHECK_DATA_CHECKSUM, current, volume, file[17], (uint8_t)(file[17] - sum));
+        verify->bytes += size;
+    }
+    else
+    {
+        if (file[17] != EFI_FFS_FIXED_CHECKSUM && file[17] != EFI_FFS_FIXED_CHECKSUM_V1)
+            add_failure(verify, FFS_CHECK_DATA_CHECKSUM, current, volume, file[17], EFI_FFS_FIXED_CHECKSUM);
+        verify->bytes += headerLength;
+    }
+    verify->fileCount++;
+}
+
+/* Verifies volume located at offset of buffer if it contains touched ranges, or if all files are verified.
+ * Returns 1 if all checks pass or volume is skipped and 0 if any check fails */
+int ffs_verify_volume(FFS_VERIFY* verify, const uint8_t* buffer, uint32_t offset, uint32_t length)
+{
+    const uint8_t* header = buffer + offset;
+    uint32_t failures;
+    uint32_t end = offset + length;
+    uint32_t current;
+    uint32_t fileSize;
+    uint32_t headerLength;
+    uint32_t range = 0;
+    uint16_t sum;
+    uint8_t erased;
+    uint8_t* found;
+    int walk;
+
+    if (!verify || !buffer || length < sizeof(EFI_FIRMWARE_VOLUME_HEADER) || !is_touched(verify, &range, offset, length))
+        return 1;
+    failures = verify->failureCount;
+    verify->volumeCount++;
+
+    /* Header checksum makes 16-bit sum of header zero */
+    headerLength = read16(header + 48);
+    if (headerLength > length)
+        headerLength = length;
+    sum = hash_sum16(header, headerLength);
+    if (sum)
+        add_failure(verify, FFS_CHECK_VOLUME_CHECKSUM, offset, offset, read16(header + 50), (uint16_t)(read16(header + 50) - sum));
+    verify->bytes += headerLength;
+    if (!is_ffs(header))
+        return verify->failureCount == failures;
+
+    /* Walking all files, so inserted files and broken headers are found, only touched files are summed */
+    erased = (read32(header + 44) & EFI_FVB_ERASE_POLARITY) ? 0xFF : 0x00;
+    current = first_file(buffer, offset, length);
+    while ((walk = walk_file(buffer, current, end, erased, &fileSize, &headerLength)) == WALK_FILE)
+    {
+        if (is_touched(verify, &range, current, fileSize))
+            verify_file(verify, buffer, current, fileSize, headerLength, offset);
+        current = align_file(offset, current + fileSize);
+    }
+
+    if (walk == WALK_BROKEN)
+        add_failure(verify, FFS_CHECK_FILE_LAYOUT, current, offset, 0, 0);
+    else if (current < end)
+    {
+        /* Free space must stay erased up to the end of volume */
+        found = find_not_byte((uint8_t*)buffer + current, (uint8_t*)buffer + end, erased);
+        if (found)
+            add_failure(verify, FFS_CHECK_FREE_SPACE, (uint32_t)(found - buffer), offset, *found, erased);
+        verify->bytes += (found ? (uint32_t)(found - buffer) + 1 : end) - current;
+    }
+
+    return verify->failureCount == failures;
+}
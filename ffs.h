@@ -0,0 +1,103 @@
+#ifndef FFS_H
+#define FFS_H
+
+#include <stdint.h>
+#include "scan.h"
+#include "image.h"
+
+/* FFS file found in firmware volume */
+typedef struct _FFS_FILE {
+    uint32_t offset;                /* offset of file header from the beginning of indexed buffer */
+    uint32_t size;                  /* size of file including header */
+    uint32_t volume;                /* index of volume containing the file */
+    uint8_t  type;                  /* EFI_FV_FILETYPE_* value */
+    uint8_t  state;                 /* file state bits with erase polarity already applied */
+} FFS_FILE;
+
+/* Firmware volume */
+typedef struct _FFS_VOLUME {
+    uint32_t offset;                /* offset of volume header from the beginning of indexed buffer */
+    uint32_t length;                /* volume length including header */
+    uint32_t firstFile;             /* index of first file of volume */
+    uint32_t fileCount;             /* number of files in volume */
+    uint32_t freeOffset;            /* offset of aligned free space after the last file */
+    int8_t   isFfs;                 /* flag that volume uses FFSv2 or FFSv3 file system, so its files are indexed */
+    uint8_t  erasePolarity;         /* value of erased byte, 0xFF or 0x00 */
+} FFS_VOLUME;
+
+/* Index of firmware volumes and their files, both sorted by offset */
+typedef struct _FFS_INDEX {
+    FFS_VOLUME* volumes;            /* found volumes */
+    uint32_t    volumeCount;        /* number of found volumes */
+    uint32_t    volumeCapacity;     /* number of allocated volumes */
+    FFS_FILE*   files;              /* files of all volumes */
+    uint32_t    fileCount;          /* number of found files */
+    uint32_t    fileCapacity;       /* number of allocated files */
+} FFS_INDEX;
+
+/* Builds index of firmware volumes found by scanner in buffer and volumes following them back to back.
+ * Files are found by walking FFS file headers by their size fields, so file contents are never searched.
+ * Returns 1 on success and 0 on failure */
+int ffs_index_build(FFS_INDEX* index, const uint8_t* buffer, uint32_t size, const SCAN_RESULT* hits);
+
+/* Adds volume located at offset and all volumes following it back to back to index, index must be empty or built before.
+ * Returns 1 on success and 0 on failure, index must be freed in both cases */
+int ffs_index_volume(FFS_INDEX* index, const uint8_t* buffer, uint32_t size, uint32_t offset);
+
+/* Checks that valid volume header is located at offset and the whole volume fits into buffer of given size.
+ * Returns volume length or 0 if there is no volume */
+uint32_t ffs_volume_length(const uint8_t* buffer, uint32_t size, uint32_t offset);
+
+/* Frees memory used by index */
+void ffs_index_free(FFS_INDEX* index);
+
+/* Looks up next file with given GUID after file previous, or the first one if previous is NULL.
+ * If volume is not FFS_ANY_VOLUME, only files of that volume are looked up.
+ * Returns pointer to found file or NULL if not found */
+#define FFS_ANY_VOLUME 0xFFFFFFFF
+const FFS_FILE* ffs_find_file(const FFS_INDEX* index, const uint8_t* buffer, const uint8_t* guid, uint32_t volume, const FFS_FILE* previous);
+
+/* Looks up volume with FFS file system by its number among such volumes, starting from 0.
+ * Returns pointer to found volume or NULL if not found */
+const FFS_VOLUME* ffs_find_volume(const FFS_INDEX* index, uint32_t number);
+
+/* Integrity checks made by ffs_verify_volume */
+#define FFS_CHECK_VOLUME_CHECKSUM   0       /* 16-bit checksum of volume header */
+#define FFS_CHECK_HEADER_CHECKSUM   1       /* 8-bit checksum of file header */
+#define FFS_CHECK_DATA_CHECKSUM     2       /* 8-bit checksum of file data, or fixed value of files without it */
+#define FFS_CHECK_FILE_LAYOUT       3       /* file size is valid and file fits into its volume */
+#define FFS_CHECK_FREE_SPACE        4       /* free space after the last file is erased */
+
+/* Failed integrity check */
+typedef struct _FFS_FAILURE {
+    uint32_t offset;                /* offset of volume or file header, or of the first non-erased byte of free space */
+    uint32_t volume;                /* offset of volume header */
+    uint16_t stored;                /* checksum stored in header, or found byte of free space */
+    uint16_t expected;              /* checksum header must have, or erased byte */
+    uint8_t  check;                 /* FFS_CHECK_* value */
+} FFS_FAILURE;
+
+/* Number of failures stored by verification, the rest are only counted */
+#define FFS_VERIFY_FAILURES 16
+
+/* Verification of volumes and files, offsets are relative to verified buffer */
+typedef struct _FFS_VERIFY {
+    const IMAGE_RANGE* touched;     /* changed ranges sorted by offset, NULL if all volumes and files are verified */
+    uint32_t    touchedCount;       /* number of changed ranges */
+    FFS_FAILURE failures[FFS_VERIFY_FAILURES]; /* first failed checks */
+    uint32_t    failureCount;       /* number of failed checks */
+    uint32_t    volumeCount;        /* number of verified volumes */
+    uint32_t    fileCount;          /* number of verified files */
+    uint64_t    bytes;              /* number of summed and compared bytes */
+} FFS_VERIFY;
+
+/* Starts verification of files overlapping touched ranges and volumes containing them, or of all files if touched is NULL */
+void ffs_verify_init(FFS_VERIFY* verify, const IMAGE_RANGE* touched, uint32_t touchedCount);
+
+/* Verifies volume located at offset of buffer if it contains touched ranges, or if all files are verified.
+ * Volume header checksum and free space are checked, and all files are walked, so files added to free space are found.
+ * Header and data checksums are checked only for touched files. Failures are added to verify.
+ * Returns 1 if all checks pass or volume is skipped and 0 if any check fails */
+int ffs_verify_volume(FFS_VERIFY* verify, const uint8_t* buffer, uint32_t offset, uint32_t length);
+
+#endif /* FFS_H */
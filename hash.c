@@ -0,0 +1,574 @@
+#include <string.h>
+#include "hash.h"
+
+/* SHA extensions and checksum kernels are built with per-function target attributes as search kernels are,
+ * so they are only reached after CPUID check */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_X86
+#define HASH_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#include <cpuid.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define HASH_X86
+#define HASH_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+/* CRC-32 lookup table for reflected polynomial 0xEDB88320 */
+static const uint32_t CRC32_TABLE[256] = {
+    0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
+    0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988, 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
+    0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
+    0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
+    0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172, 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
+    0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
+    0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
+    0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924, 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
+    0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
+    0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
+    0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E, 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
+    0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
+    0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
+    0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0, 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
+    0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
+    0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
+    0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A, 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
+    0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
+    0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
+    0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC, 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
+    0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
+    0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
+    0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236, 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
+    0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
+    0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
+    0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38, 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
+    0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
+    0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
+    0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2, 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
+    0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
+    0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
+    0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94, 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
+};
+
+/* Updates CRC-32 (IEEE 802.3, same as zlib) of data, start with crc = 0.
+ * Returns updated CRC-32 */
+uint32_t hash_crc32(uint32_t crc, const void* data, uint32_t length)
+{
+    const uint8_t* current = (const uint8_t*)data;
+
+    crc = ~crc;
+    while (length--)
+        crc = CRC32_TABLE[(crc ^ *current++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* XXH64 primes */
+#define XXH64_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH64_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH64_PRIME3 0x165667B19E3779F9ULL
+#define XXH64_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH64_PRIME5 0x27D4EB2F165667C5ULL
+
+/* Rotates 64-bit value left */
+static uint64_t rotl64(uint64_t value, uint32_t count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+/* Reads little-endian 64-bit value from unaligned pointer */
+static uint64_t read64(const uint8_t* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/* Reads little-endian 32-bit value from unaligned pointer */
+static uint32_t read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/* Mixes 8 bytes of input to XXH64 accumulator */
+static uint64_t xxh64_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * XXH64_PRIME2;
+    accumulator = rotl64(accumulator, 31);
+    return accumulator * XXH64_PRIME1;
+}
+
+/* Merges XXH64 accumulator to hash */
+static uint64_t xxh64_merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= xxh64_round(0, accumulator);
+    return hash * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+/* Calculates XXH64 of data, fast non-cryptographic hash used to identify file contents.
+ * Returns calculated hash */
+uint64_t hash_xxh64(const void* data, uint32_t length, uint64_t seed)
+{
+    const uint8_t* current = (const uint8_t*)data;
+    const uint8_t* end = current + length;
+    uint64_t hash;
+
+    if (length >= 32)
+    {
+        uint64_t v1 = seed + XXH64_PRIME1 + XXH64_PRIME2;
+        uint64_t v2 = seed + XXH64_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH64_PRIME1;
+        const uint8_t* limit = end - 32;
+
+        do
+        {
+            v1 = xxh64_round(v1, read64(current));
+            v2 = xxh64_round(v2, read64(current + 8));
+            v3 = xxh64_round(v3, read64(current + 16));
+            v4 = xxh64_round(v4, read64(current + 24));
+            current += 32;
+        } while (current <= limit);
+
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxh64_merge(hash, v1);
+        hash = xxh64_merge(hash, v2);
+        hash = xxh64_merge(hash, v3);
+        hash = xxh64_merge(hash, v4);
+    }
+    else
+        hash = seed + XXH64_PRIME5;
+
+    hash += length;
+
+    /* Processing remaining bytes */
+    while (current + 8 <= end)
+    {
+        hash ^= xxh64_round(0, read64(current));
+        hash = rotl64(hash, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+        current += 8;
+    }
+    if (current + 4 <= end)
+    {
+        hash ^= (uint64_t)read32(current) * XXH64_PRIME1;
+        hash = rotl64(hash, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        current += 4;
+    }
+    while (current < end)
+    {
+        hash ^= (*current++) * XXH64_PRIME5;
+        hash = rotl64(hash, 11) * XXH64_PRIME1;
+    }
+
+    /* Avalanche */
+    hash ^= hash >> 33;
+    hash *= XXH64_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH64_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* Sum functions of EFI checksums, all kernels return exactly the same results */
+typedef uint8_t (*SUM8_FUNC)(const uint8_t* data, uint32_t length);
+typedef uint16_t (*SUM16_FUNC)(const uint8_t* data, uint32_t length);
+
+/* Portable kernel of hash_sum8 */
+static uint8_t sum8_scalar(const uint8_t* data, uint32_t length)
+{
+    uint32_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i < length; i++)
+        sum += data[i];
+    return (uint8_t)sum;
+}
+
+/* Portable kernel of hash_sum16 */
+static uint16_t sum16_scalar(const uint8_t* data, uint32_t length)
+{
+    uint32_t sum = 0;
+    uint32_t i;
+
+    for (i = 0; i + 1 < length; i += 2)
+        sum += data[i] | (data[i + 1] << 8);
+    if (length & 1)
+        sum += data[length - 1];
+    return (uint16_t)sum;
+}
+
+/* SHA-256 round constants */
+static const uint32_t SHA256_K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+/* SHA-256 compression function processing whole 64-byte blocks */
+typedef void (*SHA256_BLOCKS_FUNC)(uint32_t* state, const uint8_t* data, uint32_t blocks);
+
+/* Rotates 32-bit value right */
+static uint32_t rotr32(uint32_t value, uint32_t count)
+{
+    return (value >> count) | (value << (32 - count));
+}
+
+/* Reads big-endian 32-bit value */
+static uint32_t read32be(const uint8_t* data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+/* Portable SHA-256 compression function */
+static void sha256_blocks_scalar(uint32_t* state, const uint8_t* data, uint32_t blocks)
+{
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t i;
+
+    for (; blocks; blocks--, data += 64)
+    {
+        for (i = 0; i < 16; i++)
+            w[i] = read32be(data + i * 4);
+        for (i = 16; i < 64; i++)
+            w[i] = w[i - 16] + (rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3))
+                 + w[i - 7] + (rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+        for (i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef HASH_X86
+/* SHA extensions kernel: two rounds per instruction, message schedule of four words per instruction pair */
+HASH_TARGET("sha,sse4.1,ssse3")
+static void sha256_blocks_shani(uint32_t* state, const uint8_t* data, uint32_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0C0D0E0F08090A0BLL, 0x0405060700010203LL);
+    __m128i state0, state1, saved0, saved1, message, temp;
+    __m128i w[4];
+    uint32_t i;
+
+    /* Kernel keeps state as ABEF and CDGH */
+    temp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1B);
+    state0 = _mm_alignr_epi8(temp, state1, 8);
+    state1 = _mm_blend_epi16(state1, temp, 0xF0);
+
+    for (; blocks; blocks--, data += 64)
+    {
+        saved0 = state0;
+        saved1 = state1;
+        for (i = 0; i < 16; i++)
+        {
+            /* w[i % 4] holds message words 4 * i to 4 * i + 3 */
+            if (i < 4)
+                w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), mask);
+            else
+                w[i & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]),
+                                                              _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4)),
+                                                w[(i + 3) & 3]);
+            message = _mm_add_epi32(w[i & 3], _mm_loadu_si128((const __m128i*)&SHA256_K[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(message, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, saved0);
+        state1 = _mm_add_epi32(state1, saved1);
+    }
+
+    /* Returning state to ABCD and EFGH order */
+    temp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i*)&state[0], _mm_blend_epi16(temp, state1, 0xF0));
+    _mm_storeu_si128((__m128i*)&state[4], _mm_alignr_epi8(state1, temp, 8));
+}
+
+/* Checks that CPU supports SHA extensions and SSE4.1 used by their kernel.
+ * Returns 1 if supported and 0 otherwise */
+static int cpu_has_sha(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return 0;
+    __cpuid(regs, 1);
+    if ((regs[2] & 0x00080200) != 0x00080200)
+        return 0;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & 0x20000000) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    /* SSSE3 and SSE4.1 */
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & 0x00080200) != 0x00080200)
+        return 0;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return 0;
+    return (ebx & 0x20000000) != 0;
+#endif
+}
+
+/* SSE2 kernel of hash_sum8, adds 64 bytes at once.
+ * Bytes are added in 8-bit lanes wrapping around, lane sums modulo 256 add up to the checksum */
+HASH_TARGET("sse2")
+static uint8_t sum8_sse2(const uint8_t* data, uint32_t length)
+{
+    __m128i sum[4];
+    uint32_t i, j;
+
+    for (j = 0; j < 4; j++)
+        sum[j] = _mm_setzero_si128();
+    for (i = 0; length - i >= 64; i += 64)
+        for (j = 0; j < 4; j++)
+            sum[j] = _mm_add_epi8(sum[j], _mm_loadu_si128((const __m128i*)(data + i + j * 16)));
+
+    /* Lanes are added by sum of absolute differences with zero */
+    sum[0] = _mm_sad_epu8(_mm_add_epi8(_mm_add_epi8(sum[0], sum[1]), _mm_add_epi8(sum[2], sum[3])), _mm_setzero_si128());
+    return (uint8_t)(_mm_cvtsi128_si32(sum[0]) + _mm_cvtsi128_si32(_mm_srli_si128(sum[0], 8)) + sum8_scalar(data + i, length - i));
+}
+
+/* SSE2 kernel of hash_sum16, adds 64 bytes at once in 16-bit lanes wrapping around */
+HASH_TARGET("sse2")
+static uint16_t sum16_sse2(const uint8_t* data, uint32_t length)
+{
+    __m128i sum[4];
+    uint16_t lanes[8];
+    uint32_t total;
+    uint32_t i, j;
+
+    for (j = 0; j < 4; j++)
+        sum[j] = _mm_setzero_si128();
+    for (i = 0; length - i >= 64; i += 64)
+        for (j = 0; j < 4; j++)
+            sum[j] = _mm_add_epi16(sum[j], _mm_loadu_si128((const __m128i*)(data + i + j * 16)));
+
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi16(_mm_add_epi16(sum[0], sum[1]), _mm_add_epi16(sum[2], sum[3])));
+    total = sum16_scalar(data + i, length - i);
+    for (j = 0; j < 8; j++)
+        total += lanes[j];
+    return (uint16_t)total;
+}
+
+/* AVX2 kernel of hash_sum8, same as SSE2 kernel, but for 128 bytes at once */
+HASH_TARGET("avx2")
+static uint8_t sum8_avx2(const uint8_t* data, uint32_t length)
+{
+    __m256i sum[4];
+    __m128i half;
+    uint32_t i, j;
+
+    for (j = 0; j < 4; j++)
+        sum[j] = _mm256_setzero_si256();
+    for (i = 0; length - i >= 128; i += 128)
+        for (j = 0; j < 4; j++)
+            sum[j] = _mm256_add_epi8(sum[j], _mm256_loadu_si256((const __m256i*)(data + i + j * 32)));
+
+    sum[0] = _mm256_add_epi8(_mm256_add_epi8(sum[0], sum[1]), _mm256_add_epi8(sum[2], sum[3]));
+    half = _mm_sad_epu8(_mm_add_epi8(_mm256_castsi256_si128(sum[0]), _mm256_extracti128_si256(sum[0], 1)), _mm_setzero_si128());
+    return (uint8_t)(_mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8)) + sum8_scalar(data + i, length - i));
+}
+
+/* AVX2 kernel of hash_sum16, same as SSE2 kernel, but for 128 bytes at once */
+HASH_TARGET("avx2")
+static uint16_t sum16_avx2(const uint8_t* data, uint32_t length)
+{
+    __m256i sum[4];
+    uint16_t lanes[8];
+    uint32_t total;
+    uint32_t i, j;
+
+    for (j = 0; j < 4; j++)
+        sum[j] = _mm256_setzero_si256();
+    for (i = 0; length - i >= 128; i += 128)
+        for (j = 0; j < 4; j++)
+            sum[j] = _mm256_add_epi16(sum[j], _mm256_loadu_si256((const __m256i*)(data + i + j * 32)));
+
+    sum[0] = _mm256_add_epi16(_mm256_add_epi16(sum[0], sum[1]), _mm256_add_epi16(sum[2], sum[3]));
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi16(_mm256_castsi256_si128(sum[0]), _mm256_extracti128_si256(sum[0], 1)));
+    total = sum16_scalar(data + i, length - i);
+    for (j = 0; j < 8; j++)
+        total += lanes[j];
+    return (uint16_t)total;
+}
+
+/* Checks that CPU supports SSE2.
+ * Returns 1 if supported and 0 otherwise */
+static int cpu_has_sse2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    /* SSE2 is a part of x86-64 */
+    return 1;
+#elif defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[3] & 0x04000000) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & 0x04000000) != 0;
+#endif
+}
+
+/* Checks that CPU and OS support AVX2.
+ * Returns 1 if supported and 0 otherwise */
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return 0;
+    __cpuid(regs, 1);
+    /* OSXSAVE and AVX, OS must save YMM registers */
+    if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 0x6) != 0x6)
+        return 0;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & 0x20) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif /* HASH_X86 */
+
+static SHA256_BLOCKS_FUNC selected_sha256_blocks = sha256_blocks_scalar;
+static SUM8_FUNC selected_sum8 = sum8_scalar;
+static SUM16_FUNC selected_sum16 = sum16_scalar;
+
+/* Selects the fastest SHA-256 and checksum implementations supported by current CPU.
+ * Must be called once at startup before any other thread calculates SHA-256 or checksums */
+void hash_init(void)
+{
+#ifdef HASH_X86
+    if (cpu_has_sha())
+        selected_sha256_blocks = sha256_blocks_shani;
+    if (cpu_has_avx2())
+    {
+        selected_sum8 = sum8_avx2;
+        selected_sum16 = sum16_avx2;
+    }
+    else if (cpu_has_sse2())
+    {
+        selected_sum8 = sum8_sse2;
+        selected_sum16 = sum16_sse2;
+    }
+#endif
+}
+
+/* Returns printable name of selected SHA-256 implementation */
+const char* hash_sha256_kernel(void)
+{
+#ifdef HASH_X86
+    if (selected_sha256_blocks == sha256_blocks_shani)
+        return "sha-ni";
+#endif
+    return "scalar";
+}
+
+/* Starts SHA-256 calculation */
+void hash_sha256_init(HASH_SHA256* sha)
+{
+    static const uint32_t SHA256_H[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+
+    memcpy(sha->state, SHA256_H, sizeof(SHA256_H));
+    sha->length = 0;
+}
+
+/* Adds data to SHA-256 calculation, data can be split to any number of calls */
+void hash_sha256_update(HASH_SHA256* sha, const void* data, uint32_t length)
+{
+    const uint8_t* current = (const uint8_t*)data;
+    uint32_t used = (uint32_t)(sha->length & 63);
+
+    sha->length += length;
+
+    /* Completing buffered block */
+    if (used)
+    {
+        uint32_t fill = 64 - used;
+        if (length < fill)
+        {
+            memcpy(sha->block + used, current, length);
+            return;
+        }
+        memcpy(sha->block + used, current, fill);
+        selected_sha256_blocks(sha->state, sha->block, 1);
+        current += fill;
+        length -= fill;
+    }
+
+    /* Whole blocks are hashed in place */
+    if (length >= 64)
+    {
+        selected_sha256_blocks(sha->state, current, length / 64);
+        current += length & ~63U;
+        length &= 63;
+    }
+    memcpy(sha->block, current, length);
+}
+
+/* Finishes SHA-256 calculation and stores HASH_SHA256_LENGTH bytes of digest */
+void hash_sha256_final(HASH_SHA256* sha, uint8_t* digest)
+{
+    uint32_t used = (uint32_t)(sha->length & 63);
+    uint64_t bits = sha->length * 8;
+    uint32_t i;
+
+    /* Padding with 0x80 byte, zeros and big-endian bit length */
+    sha->block[used++] = 0x80;
+    if (used > 56)
+    {
+        memset(sha->block + used, 0, 64 - used);
+        selected_sha256_blocks(sha->state, sha->block, 1);
+        used = 0;
+    }
+    memset(sha->block + used, 0, 56 - used);
+    for (i = 0; i < 8; i++)
+        sha->block[56 + i] = (uint8_t)(bits >> (56 - i * 8));
+    selected_sha256_blocks(sha->state, sha->block, 1);
+
+    for (i = 0; i < 32; i++)
+        digest[i] = (uint8_t)(sha->state[i / 4] >> (24 - (i % 4) * 8));
+}
+
+/* Calculates SHA-256 of data and stores HASH_SHA256_LENGTH bytes of digest */
+void hash_sha256(const void* data, uint32_t length, uint8_t* digest)
+{
+    HASH_SHA256 sha;
+
+    hash_sha256_init(&sha);
+    hash_sha256_update(&sha, data, length);
+    hash_sha256_final(&sha, digest);
+}
+
+/* Calculates 8-bit sum of bytes of data, EFI file checksums make it zero.
+ * Returns calculated sum */
+uint8_t hash_sum8(const void* data, uint32_t length)
+{
+    return selected_sum8((const uint8_t*)data, length);
+}
+
+/* Calculates 16-bit sum of little-endian words of data, EFI volume header checksum makes it zero.
+ * The last byte of data of odd length is added as a word with zero high byte.
+ * Returns calculated sum */
+uint16_t hash_sum16(const void* data, uint32_t length)
+{
+    return selected_sum16((const uint8_t*)data, length);
+}
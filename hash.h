@@ -0,0 +1,52 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/* Updates CRC-32 (IEEE 802.3, same as zlib) of data, start with crc = 0.
+ * Returns updated CRC-32 */
+uint32_t hash_crc32(uint32_t crc, const void* data, uint32_t length);
+
+/* Calculates XXH64 of data, fast non-cryptographic hash used to identify file contents.
+ * Returns calculated hash */
+uint64_t hash_xxh64(const void* data, uint32_t length, uint64_t seed);
+
+/* SHA-256 digest length */
+#define HASH_SHA256_LENGTH 32
+
+/* SHA-256 calculation state */
+typedef struct _HASH_SHA256 {
+    uint32_t state[8];              /* intermediate hash value */
+    uint64_t length;                /* number of hashed bytes */
+    uint8_t  block[64];             /* bytes of incomplete block */
+} HASH_SHA256;
+
+/* Selects the fastest SHA-256 and checksum implementations supported by current CPU, portable ones are used until it is called.
+ * Must be called once at startup before any other thread calculates SHA-256 or checksums */
+void hash_init(void);
+
+/* Returns printable name of selected SHA-256 implementation */
+const char* hash_sha256_kernel(void);
+
+/* Starts SHA-256 calculation */
+void hash_sha256_init(HASH_SHA256* sha);
+
+/* Adds data to SHA-256 calculation, data can be split to any number of calls */
+void hash_sha256_update(HASH_SHA256* sha, const void* data, uint32_t length);
+
+/* Finishes SHA-256 calculation and stores HASH_SHA256_LENGTH bytes of digest */
+void hash_sha256_final(HASH_SHA256* sha, uint8_t* digest);
+
+/* Calculates SHA-256 of data and stores HASH_SHA256_LENGTH bytes of digest */
+void hash_sha256(const void* data, uint32_t length, uint8_t* digest);
+
+/* Calculates 8-bit sum of bytes of data, EFI file checksums make it zero.
+ * Returns calculated sum */
+uint8_t hash_sum8(const void* data, uint32_t length);
+
+/* Calculates 16-bit sum of little-endian words of data, EFI volume header checksum makes it zero.
+ * The last byte of data of odd length is added as a word with zero high byte.
+ * Returns calculated sum */
+uint16_t hash_sum16(const void* data, uint32_t length);
+
+#endif /* HASH_H */
@@ -0,0 +1,580 @@
+#define  _CRT_SECURE_NO_WARNINGS
+#ifdef __linux__
+#define  _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "image.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#define IMAGE_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Size of blocks read or written while file is hashed, so every block is hashed while it is in CPU cache */
+#define IMAGE_HASH_BLOCK            0x100000
+
+/* Reads whole file to heap buffer, hashing it block by block if image has IMAGE_HASH flag.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error */
+static int image_read(IMAGE* image, FILE* file)
+{
+    HASH_SHA256 sha;
+    uint32_t read;
+    uint32_t block;
+
+    /* Determining file size */
+    fseek(file, 0, SEEK_END);
+    image->size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    /* Allocating memory for buffer */
+    image->data = (uint8_t*)malloc(image->size);
+    if (!image->data)
+        return IMAGE_ERR_MEMORY;
+
+    /* Reading whole file to buffer */
+    if (image->flags & IMAGE_HASH)
+    {
+        hash_sha256_init(&sha);
+        for (read = 0; read < image->size; read += block)
+        {
+            block = image->size - read < IMAGE_HASH_BLOCK ? image->size - read : IMAGE_HASH_BLOCK;
+            if (fread(image->data + read, sizeof(char), block, file) != block)
+                break;
+            hash_sha256_update(&sha, image->data + read, block);
+        }
+        hash_sha256_final(&sha, image->sha256);
+    }
+    else
+        read = fread((void*)image->data, sizeof(char), image->size, file);
+    if (read != image->size)
+    {
+        int error = errno;
+        free(image->data);
+        image->data = NULL;
+        errno = error;
+        return IMAGE_ERR_READ;
+    }
+
+    return IMAGE_OK;
+}
+
+#ifdef IMAGE_POSIX
+/* Maps whole file to memory.
+ * Returns IMAGE_OK on success, IMAGE_ERR_MEMORY if file can't be mapped or IMAGE_ERR_READ on error */
+static int image_map(IMAGE* image, int fd)
+{
+    struct stat st;
+    void* data;
+
+    if (fstat(fd, &st))
+        return IMAGE_ERR_READ;
+
+    /* Empty files and files that are not regular can't be mapped */
+    if (!S_ISREG(st.st_mode) || st.st_size == 0 || (uint64_t)st.st_size > 0xFFFFFFFFULL)
+        return IMAGE_ERR_MEMORY;
+
+    data = mmap(NULL, (size_t)st.st_size, (image->flags & IMAGE_WRITABLE) ? PROT_READ | PROT_WRITE : PROT_READ,
+                MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return IMAGE_ERR_MEMORY;
+
+    image->data = (uint8_t*)data;
+    image->size = (uint32_t)st.st_size;
+    image->mapped = 1;
+
+    /* Hashing reads the file through its mapping, so it is read from the disk only once */
+    if (image->flags & IMAGE_HASH)
+        hash_sha256(image->data, image->size, image->sha256);
+    return IMAGE_OK;
+}
+#endif
+
+#ifdef IMAGE_POSIX
+/* Moves image data to shared memory object mapped read-only, so copies can map it privately.
+ * Returns IMAGE_OK on success or IMAGE_ERR_MEMORY if shared memory can't be used, image is not changed in that case */
+static int image_share(IMAGE* image)
+{
+#ifdef MFD_CLOEXEC
+    void* data;
+    int fd;
+
+    fd = memfd_create("fd44-template", MFD_CLOEXEC);
+    if (fd < 0)
+        return IMAGE_ERR_MEMORY;
+    if (ftruncate(fd, (off_t)image->size))
+    {
+        close(fd);
+        return IMAGE_ERR_MEMORY;
+    }
+    data = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return IMAGE_ERR_MEMORY;
+    }
+    memcpy(data, image->data, image->size);
+    mprotect(data, image->size, PROT_READ);
+
+    if (image->mapped)
+        munmap(image->data, image->size);
+    else
+        free(image->data);
+    image->data = (uint8_t*)data;
+    image->mapped = 1;
+    image->shared = 1;
+    image->memory = fd;
+    return IMAGE_OK;
+#else
+    (void)image;
+    return IMAGE_ERR_MEMORY;
+#endif
+}
+#endif
+
+/* Loads image file to memory.
+ * Read-only images are mapped shared with page cache, writable images are mapped copy-on-write,
+ * so the file itself is not changed until image_write is called.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_open(IMAGE* image, const char* path, uint32_t flags)
+{
+    FILE* file;
+    int result;
+    int error;
+
+    if (!image || !path)
+        return IMAGE_ERR_OPEN;
+
+    image->data = NULL;
+    image->size = 0;
+    image->flags = flags;
+    image->mapped = 0;
+    image->shared = 0;
+    image->memory = -1;
+    image->dirty = NULL;
+    image->dirtyCount = 0;
+    image->dirtyCapacity = 0;
+
+    /* Writable image is opened for writing too, so read-only output file is rejected before any work is done */
+    file = fopen(path, ((flags & IMAGE_WRITABLE) && !(flags & IMAGE_SAVE_AS)) ? "r+b" : "rb");
+    if (!file)
+        return IMAGE_ERR_OPEN;
+
+#ifdef IMAGE_POSIX
+    /* Falling back to reading if file can't be mapped */
+    if (!(flags & IMAGE_NO_MMAP) && image_map(image, fileno(file)) == IMAGE_OK)
+        result = IMAGE_OK;
+    else
+#endif
+        result = image_read(image, file);
+    error = errno;
+    fclose(file);
+
+#ifdef IMAGE_POSIX
+    /* Template stays in heap or file mapping if shared memory can't be used, its copies are full copies then */
+    if (result == IMAGE_OK && (flags & IMAGE_TEMPLATE))
+        image_share(image);
+#endif
+    errno = error;
+    return result;
+}
+
+/* Copies length bytes from source to destination inside of image data and marks them as modified.
+ * Returns 1 on success and 0 on failure */
+int image_patch(IMAGE* image, uint8_t* destination, const void* source, uint32_t length)
+{
+    uint32_t begin, end;
+    uint32_t first, last;
+
+    if (!image || !image->data || !destination || !source
+        || destination < image->data || length > image->size || destination - image->data > image->size - length)
+        return 0;
+    if (!length)
+        return 1;
+
+    begin = (uint32_t)(destination - image->data);
+    end = begin + length;
+
+    /* Finding ranges that overlap or touch the new one, they are merged into it */
+    for (first = 0; first < image->dirtyCount && image->dirty[first].offset + image->dirty[first].length < begin; first++)
+        ;
+    for (last = first; last < image->dirtyCount && image->dirty[last].offset <= end; last++)
+    {
+        if (image->dirty[last].offset < begin)
+            begin = image->dirty[last].offset;
+        if (image->dirty[last].offset + image->dirty[last].length > end)
+            end = image->dirty[last].offset + image->dirty[last].length;
+    }
+
+    if (first == last)
+    {
+        /* Inserting new range */
+        if (image->dirtyCount == image->dirtyCapacity)
+        {
+            uint32_t capacity = image->dirtyCapacity ? image->dirtyCapacity * 2 : 16;
+            IMAGE_RANGE* dirty = (IMAGE_RANGE*)realloc(image->dirty, capacity * sizeof(IMAGE_RANGE));
+            if (!dirty)
+                return 0;
+            image->dirty = dirty;
+            image->dirtyCapacity = capacity;
+        }
+        memmove(image->dirty + first + 1, image->dirty + first, (image->dirtyCount - first) * sizeof(IMAGE_RANGE));
+        image->dirtyCount++;
+    }
+    else
+    {
+        /* Replacing merged ranges with one */
+        memmove(image->dirty + first + 1, image->dirty + last, (image->dirtyCount - last) * sizeof(IMAGE_RANGE));
+        image->dirtyCount -= last - first - 1;
+    }
+    image->dirty[first].offset = begin;
+    image->dirty[first].length = end - begin;
+
+    memcpy(destination, source, length);
+    return 1;
+}
+
+/* Writes modified ranges of image in place and syncs them to disk.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error */
+static int image_write_dirty(const IMAGE* image, const char* path, uint8_t* digest)
+{
+    FILE* file;
+    uint32_t i;
+    int error;
+
+    /* Unchanged ranges aren't written, so the file is hashed from memory, it holds the same data */
+    if (digest)
+        hash_sha256(image->data, image->size, digest);
+    if (!image->dirtyCount)
+        return IMAGE_OK;
+
+    file = fopen(path, "r+b");
+    if (!file)
+        return IMAGE_ERR_WRITE;
+
+    for (i = 0; i < image->dirtyCount; i++)
+    {
+        const IMAGE_RANGE* range = &image->dirty[i];
+        if (fseek(file, (long)range->offset, SEEK_SET)
+            || fwrite(image->data + range->offset, sizeof(char), range->length, file) != range->length)
+            break;
+    }
+
+    /* Dirty ranges must reach the disk before the job is reported as done */
+    if (i != image->dirtyCount || fflush(file)
+#ifdef IMAGE_POSIX
+        || fsync(fileno(file))
+#else
+        || _commit(_fileno(file))
+#endif
+        )
+    {
+        error = errno;
+        fclose(file);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+
+    if (fclose(file))
+        return IMAGE_ERR_WRITE;
+    return IMAGE_OK;
+}
+
+/* Writes image data starting from offset to file, hashing it block by block if digest is not NULL.
+ * Returns number of written bytes */
+static uint32_t image_put(const IMAGE* image, FILE* file, uint32_t offset, uint8_t* digest)
+{
+    HASH_SHA256 sha;
+    uint32_t written;
+    uint32_t block;
+
+    if (!digest)
+        return (uint32_t)fwrite(image->data + offset, sizeof(char), image->size - offset, file);
+
+    hash_sha256_init(&sha);
+    for (written = 0; offset + written < image->size; written += block)
+    {
+        block = image->size - offset - written < IMAGE_HASH_BLOCK ? image->size - offset - written : IMAGE_HASH_BLOCK;
+        if (fwrite(image->data + offset + written, sizeof(char), block, file) != block)
+            break;
+        hash_sha256_update(&sha, image->data + offset + written, block);
+    }
+    hash_sha256_final(&sha, digest);
+    return written;
+}
+
+#ifdef IMAGE_POSIX
+/* Number of names tried for temporary file before giving up */
+#define IMAGE_TEMP_ATTEMPTS         100
+
+/* Creates new temporary file next to path, name of created file is stored to temporary, which has room for the suffix.
+ * File is created with mode 0666 reduced by umask, as a new output file would be, without changing the umask of the process.
+ * Returns descriptor of created file or -1 on error */
+static int image_create_temporary(const char* path, char* temporary)
+{
+    uint32_t attempt;
+    int fd;
+
+    /* Stack address differs between threads, so threads writing to the same directory try different names */
+    for (attempt = 0; attempt < IMAGE_TEMP_ATTEMPTS; attempt++)
+    {
+        sprintf(temporary, "%s.%lx.%lx.%u", path, (unsigned long)getpid(), (unsigned long)(size_t)&fd, attempt);
+        fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+    }
+    return -1;
+}
+
+/* Syncs directory containing path to disk, so renaming a file in it survives a crash.
+ * Returns 1 on success and 0 on failure */
+static int image_sync_directory(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    char* directory;
+    int result = 1;
+    int fd;
+
+    if (!slash)
+        fd = open(".", O_RDONLY);
+    else
+    {
+        directory = (char*)malloc(slash - path + 2);
+        if (!directory)
+            return 0;
+        memcpy(directory, path, slash - path + 1);
+        directory[slash - path + 1] = '\0';
+        fd = open(directory, O_RDONLY);
+        free(directory);
+    }
+    if (fd < 0)
+        return 0;
+
+    /* Some file systems can't sync directories, renaming is as durable as they make it then */
+    if (fsync(fd) && errno != EINVAL)
+        result = 0;
+    close(fd);
+    return result;
+}
+#endif
+
+/* Replaces the whole file with image data starting from offset.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error */
+static int image_replace(const IMAGE* image, const char* path, uint32_t offset, uint8_t* digest)
+{
+    FILE* file;
+    uint32_t written;
+    int error;
+#ifdef IMAGE_POSIX
+    struct stat st;
+    char* temporary;
+    int fd;
+
+    /* New contents are written to temporary file in the same directory, renamed over the old file
+     * and the directory is synced, so the file is either old or new after a crash, never partially written */
+    temporary = (char*)malloc(strlen(path) + 64);
+    if (!temporary)
+        return IMAGE_ERR_MEMORY;
+
+    fd = image_create_temporary(path, temporary);
+    if (fd < 0)
+    {
+        error = errno;
+        free(temporary);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+
+    /* Replaced file keeps its permissions, new file has default ones the temporary file is created with */
+    if (!stat(path, &st))
+        fchmod(fd, st.st_mode & 07777);
+
+    file = fdopen(fd, "wb");
+    if (!file)
+    {
+        error = errno;
+        close(fd);
+        unlink(temporary);
+        free(temporary);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+
+    written = image_put(image, file, offset, digest);
+    if (written != image->size - offset || fflush(file) || fsync(fileno(file)))
+    {
+        error = errno;
+        fclose(file);
+        unlink(temporary);
+        free(temporary);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+    if (fclose(file) || rename(temporary, path))
+    {
+        error = errno;
+        unlink(temporary);
+        free(temporary);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+    free(temporary);
+
+    if (!image_sync_directory(path))
+        return IMAGE_ERR_WRITE;
+    return IMAGE_OK;
+#else
+    /* Rewriting the whole file */
+    file = fopen(path, "wb");
+    if (!file)
+        return IMAGE_ERR_WRITE;
+    written = image_put(image, file, offset, digest);
+    if (written != image->size - offset)
+    {
+        error = errno;
+        fclose(file);
+        errno = error;
+        return IMAGE_ERR_WRITE;
+    }
+    if (fclose(file))
+        return IMAGE_ERR_WRITE;
+    return IMAGE_OK;
+#endif
+}
+
+/* Writes image data starting from offset back to the file it was loaded from.
+ * If offset is zero, only modified ranges are written in place and synced to disk,
+ * otherwise the whole file is replaced atomically by writing new contents to temporary file and renaming it.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_write(const IMAGE* image, const char* path, uint32_t offset, uint8_t* digest)
+{
+    if (!image || !image->data || !path || offset > image->size)
+        return IMAGE_ERR_WRITE;
+
+    if (offset)
+        return image_replace(image, path, offset, digest);
+    return image_write_dirty(image, path, digest);
+}
+
+/* Writes image data starting from offset to another file, replacing it atomically if it exists.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_save(const IMAGE* image, const char* path, uint32_t offset, uint8_t* digest)
+{
+    if (!image || !image->data || !path || offset > image->size)
+        return IMAGE_ERR_WRITE;
+
+    return image_replace(image, path, offset, digest);
+}
+
+/* Makes independent copy of image data with the same flags, modified ranges of image are not copied.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error */
+int image_copy(IMAGE* copy, const IMAGE* image)
+{
+    if (!copy || !image || !image->data)
+        return IMAGE_ERR_READ;
+
+    memset(copy, 0, sizeof(IMAGE));
+    copy->size = image->size;
+    copy->flags = image->flags & ~IMAGE_TEMPLATE;
+    copy->memory = -1;
+    memcpy(copy->sha256, image->sha256, sizeof(copy->sha256));
+
+#ifdef IMAGE_POSIX
+    /* Mapping shared memory privately, pages are copied by kernel when they are changed */
+    if (image->shared)
+    {
+        void* data = mmap(NULL, image->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, image->memory, 0);
+        if (data != MAP_FAILED)
+        {
+            copy->data = (uint8_t*)data;
+            copy->mapped = 1;
+            return IMAGE_OK;
+        }
+    }
+#endif
+
+    copy->data = (uint8_t*)malloc(image->size);
+    if (!copy->data)
+        return IMAGE_ERR_MEMORY;
+    memcpy(copy->data, image->data, image->size);
+    return IMAGE_OK;
+}
+
+/* Size of buffer used to read file to system cache */
+#define IMAGE_PREFETCH_BUFFER       0x100000
+
+/* Starts reading file to system cache.
+ * Returns 1 on success and 0 on failure */
+int image_prefetch(const char* path)
+{
+#if defined(IMAGE_POSIX) && defined(POSIX_FADV_WILLNEED)
+    int fd;
+    int result;
+
+    if (!path)
+        return 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    /* Kernel queues reads of the whole file and returns without waiting for them */
+    result = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0;
+    close(fd);
+    return result;
+#else
+    FILE* file;
+    uint8_t* buffer;
+    int result;
+
+    if (!path)
+        return 0;
+    file = fopen(path, "rb");
+    if (!file)
+        return 0;
+    buffer = (uint8_t*)malloc(IMAGE_PREFETCH_BUFFER);
+    if (!buffer)
+    {
+        fclose(file);
+        return 0;
+    }
+    while (fread(buffer, sizeof(char), IMAGE_PREFETCH_BUFFER, file) == IMAGE_PREFETCH_BUFFER)
+        ;
+    result = !ferror(file);
+    free(buffer);
+    fclose(file);
+    return result;
+#endif
+}
+
+/* Unmaps or frees image data */
+void image_close(IMAGE* image)
+{
+    if (!image || !image->data)
+        return;
+
+#ifdef IMAGE_POSIX
+    if (image->shared)
+        close(image->memory);
+    if (image->mapped)
+        munmap(image->data, image->size);
+    else
+#endif
+        free(image->data);
+    free(image->dirty);
+
+    image->data = NULL;
+    image->dirty = NULL;
+    image->dirtyCount = 0;
+    image->dirtyCapacity = 0;
+    image->size = 0;
+    image->mapped = 0;
+    image->shared = 0;
+    image->memory = -1;
+}
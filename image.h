@@ -0,0 +1,79 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include "hash.h"
+
+/* Image operation results */
+#define IMAGE_OK                    0
+#define IMAGE_ERR_OPEN              1
+#define IMAGE_ERR_MEMORY            2
+#define IMAGE_ERR_READ              3
+#define IMAGE_ERR_WRITE             4
+
+/* Image loading flags */
+#define IMAGE_WRITABLE              0x01    /* image will be modified in memory and written back */
+#define IMAGE_NO_MMAP               0x02    /* image is read to heap buffer instead of being memory mapped */
+#define IMAGE_SAVE_AS               0x04    /* writable image is saved to another file, its own file is only read */
+#define IMAGE_TEMPLATE              0x08    /* image is only read and copied by image_copy, copies share unchanged pages with it */
+#define IMAGE_HASH                  0x10    /* SHA-256 of file is calculated while it is loaded */
+
+/* Byte range of image */
+typedef struct _IMAGE_RANGE {
+    uint32_t offset;                /* offset of range from the beginning of image */
+    uint32_t length;                /* length of range */
+} IMAGE_RANGE;
+
+/* BIOS image file loaded to memory */
+typedef struct _IMAGE {
+    uint8_t*     data;              /* image contents */
+    uint32_t     size;              /* image size */
+    uint32_t     flags;             /* loading flags */
+    int8_t       mapped;            /* flag that data is memory mapped, not allocated */
+    int8_t       shared;            /* flag that data is mapped from shared memory object, template images only */
+    int          memory;            /* descriptor of shared memory object */
+    IMAGE_RANGE* dirty;             /* modified ranges, sorted by offset, never overlapping or adjacent */
+    uint32_t     dirtyCount;        /* number of modified ranges */
+    uint32_t     dirtyCapacity;     /* number of allocated ranges */
+    uint8_t      sha256[HASH_SHA256_LENGTH]; /* SHA-256 of loaded file, images loaded with IMAGE_HASH flag only */
+} IMAGE;
+
+/* Loads image file to memory.
+ * Read-only images are mapped shared with page cache, writable images are mapped copy-on-write,
+ * so the file itself is not changed until image_write is called.
+ * Template images are moved to shared memory where it is supported and can't be changed.
+ * SHA-256 of images loaded with IMAGE_HASH flag is calculated as they are read, block by block.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_open(IMAGE* image, const char* path, uint32_t flags);
+
+/* Copies length bytes from source to destination inside of image data and marks them as modified.
+ * Returns 1 on success and 0 on failure */
+int image_patch(IMAGE* image, uint8_t* destination, const void* source, uint32_t length);
+
+/* Writes image data starting from offset back to the file it was loaded from.
+ * If offset is zero, only modified ranges are written in place and synced to disk,
+ * otherwise the whole file is replaced atomically by writing new contents to temporary file and renaming it.
+ * If digest is not NULL, SHA-256 of the written file is stored there, data written in blocks is hashed block by block.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_write(const IMAGE* image, const char* path, uint32_t offset, uint8_t* digest);
+
+/* Writes image data starting from offset to another file, replacing it atomically if it exists.
+ * If digest is not NULL, SHA-256 of the written file is stored there.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error, errno is preserved for perror */
+int image_save(const IMAGE* image, const char* path, uint32_t offset, uint8_t* digest);
+
+/* Makes independent copy of image data with the same flags except IMAGE_TEMPLATE and the same SHA-256, modified ranges of image are not copied.
+ * Copies of template images in shared memory are its private mappings, so only pages changed in copy are allocated.
+ * Image itself is only read, so it can be copied by many threads at the same time.
+ * Returns IMAGE_OK on success or IMAGE_ERR_* code on error */
+int image_copy(IMAGE* copy, const IMAGE* image);
+
+/* Starts reading file to system cache, so image_open doesn't wait for the disk later.
+ * Systems that read ahead on request do it in background, the file is read by current thread on others.
+ * Returns 1 on success and 0 on failure */
+int image_prefetch(const char* path);
+
+/* Unmaps or frees image data */
+void image_close(IMAGE* image);
+
+#endif /* IMAGE_H */
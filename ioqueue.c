@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include "ioqueue.h"
+
+/* Checks that task holding given number of bytes fits to queue, queue must be locked */
+static int ioqueue_fits(const IOQUEUE* queue, uint64_t memory)
+{
+    if (queue->queued + queue->running >= queue->depth)
+        return 0;
+    return !memory || !queue->used || queue->used + memory <= queue->memory;
+}
+
+/* I/O thread function, runs queued tasks until queue is stopped and empty */
+static void ioqueue_worker(void* context)
+{
+    IOQUEUE* queue = (IOQUEUE*)context;
+    IOQUEUE_TASK task;
+
+    mutex_lock(&queue->mutex);
+    for (;;)
+    {
+        while (!queue->queued && !queue->stopping)
+            condition_wait(&queue->changed, &queue->mutex);
+        if (!queue->queued)
+            break;
+
+        task = queue->tasks[queue->first];
+        queue->first = (queue->first + 1) % queue->depth;
+        queue->queued--;
+        queue->running++;
+        mutex_unlock(&queue->mutex);
+
+        task.func(task.context);
+
+        mutex_lock(&queue->mutex);
+        queue->running--;
+        queue->used -= task.memory;
+        condition_broadcast(&queue->changed);
+    }
+    mutex_unlock(&queue->mutex);
+}
+
+/* Starts depth I/O threads.
+ * Returns 1 on success and 0 on failure */
+int ioqueue_start(IOQUEUE* queue, uint32_t depth, uint64_t memory)
+{
+    if (!queue || !depth)
+        return 0;
+
+    queue->tasks = (IOQUEUE_TASK*)malloc(depth * sizeof(IOQUEUE_TASK));
+    queue->threads = (THREAD*)malloc(depth * sizeof(THREAD));
+    if (!queue->tasks || !queue->threads)
+    {
+        free(queue->tasks);
+        free(queue->threads);
+        return 0;
+    }
+    if (!mutex_init(&queue->mutex))
+    {
+        free(queue->tasks);
+        free(queue->threads);
+        return 0;
+    }
+    if (!condition_init(&queue->changed))
+    {
+        mutex_destroy(&queue->mutex);
+        free(queue->tasks);
+        free(queue->threads);
+        return 0;
+    }
+    queue->depth = depth;
+    queue->first = 0;
+    queue->queued = 0;
+    queue->running = 0;
+    queue->memory = memory;
+    queue->used = 0;
+    queue->stopping = 0;
+
+    /* Queue works with fewer threads if some of them can't be started, tasks are ran by caller if none is started */
+    for (queue->threadCount = 0; queue->threadCount < depth; queue->threadCount++)
+        if (!thread_start(&queue->threads[queue->threadCount], ioqueue_worker, queue))
+            break;
+    if (!queue->threadCount)
+    {
+        condition_destroy(&queue->changed);
+        mutex_destroy(&queue->mutex);
+        free(queue->tasks);
+        free(queue->threads);
+        return 0;
+    }
+    return 1;
+}
+
+/* Queues task holding given number of bytes until it is done.
+ * Returns 1 if task is queued and 0 if it isn't */
+int ioqueue_push(IOQUEUE* queue, IOQUEUE_FUNC func, void* context, uint64_t memory, int8_t wait)
+{
+    IOQUEUE_TASK* task;
+
+    if (!queue || !func)
+        return 0;
+
+    mutex_lock(&queue->mutex);
+    while (wait && !queue->stopping && !ioqueue_fits(queue, memory))
+        condition_wait(&queue->changed, &queue->mutex);
+    if (queue->stopping || !ioqueue_fits(queue, memory))
+    {
+        mutex_unlock(&queue->mutex);
+        return 0;
+    }
+
+    task = &queue->tasks[(queue->first + queue->queued) % queue->depth];
+    task->func = func;
+    task->context = context;
+    task->memory = memory;
+    queue->queued++;
+    queue->used += memory;
+    condition_broadcast(&queue->changed);
+    mutex_unlock(&queue->mutex);
+    return 1;
+}
+
+/* Runs all queued tasks, waits for them and stops I/O threads */
+void ioqueue_stop(IOQUEUE* queue)
+{
+    uint32_t i;
+
+    if (!queue || !queue->threadCount)
+        return;
+
+    mutex_lock(&queue->mutex);
+    queue->stopping = 1;
+    condition_broadcast(&queue->changed);
+    mutex_unlock(&queue->mutex);
+    for (i = 0; i < queue->threadCount; i++)
+        thread_join(&queue->threads[i]);
+
+    condition_destroy(&queue->changed);
+    mutex_destroy(&queue->mutex);
+    free(queue->tasks);
+    free(queue->threads);
+    queue->tasks = NULL;
+    queue->threads = NULL;
+    queue->threadCount = 0;
+}
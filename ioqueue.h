@@ -0,0 +1,47 @@
+#ifndef IOQUEUE_H
+#define IOQUEUE_H
+
+#include <stdint.h>
+#include "thread.h"
+
+/* I/O task function */
+typedef void (*IOQUEUE_FUNC)(void* context);
+
+/* Queued I/O task */
+typedef struct _IOQUEUE_TASK {
+    IOQUEUE_FUNC func;              /* task function */
+    void*        context;           /* argument of task function */
+    uint64_t     memory;            /* bytes of memory held by task until it is done */
+} IOQUEUE_TASK;
+
+/* Background I/O threads running tasks in order they are queued,
+ * so file reads and writes wait for the disk while other threads keep CPUs busy */
+typedef struct _IOQUEUE {
+    MUTEX         mutex;            /* lock for all fields below */
+    CONDITION     changed;          /* signaled when task is queued or done and when queue is stopped */
+    IOQUEUE_TASK* tasks;            /* ring of queued tasks */
+    uint32_t      depth;            /* maximal number of queued and running tasks */
+    uint32_t      first;            /* index of the first queued task in ring */
+    uint32_t      queued;           /* number of queued tasks */
+    uint32_t      running;          /* number of running tasks */
+    uint64_t      memory;           /* maximal number of bytes held by queued and running tasks */
+    uint64_t      used;             /* number of bytes held by queued and running tasks */
+    THREAD*       threads;          /* I/O threads */
+    uint32_t      threadCount;      /* number of started I/O threads */
+    int8_t        stopping;         /* flag that threads exit when queue is empty */
+} IOQUEUE;
+
+/* Starts depth I/O threads, so up to depth tasks run at the same time, and no more than depth tasks are queued or running.
+ * Tasks holding memory are queued only while queued and running tasks hold no more than memory bytes in total.
+ * Returns 1 on success and 0 on failure */
+int ioqueue_start(IOQUEUE* queue, uint32_t depth, uint64_t memory);
+
+/* Queues task holding given number of bytes until it is done. If wait is set, waits for free place and memory,
+ * a task holding more than memory bytes waits until queue is empty.
+ * Returns 1 if task is queued and 0 if it isn't, task must be ran by caller then */
+int ioqueue_push(IOQUEUE* queue, IOQUEUE_FUNC func, void* context, uint64_t memory, int8_t wait);
+
+/* Runs all queued tasks, waits for them and stops I/O threads */
+void ioqueue_stop(IOQUEUE* queue);
+
+#endif /* IOQUEUE_H */
@@ -0,0 +1,28 @@
+#ifndef MATCHERS_H
+#define MATCHERS_H
+
+#include <stdint.h>
+#include "bios.h"
+
+/* Checks that data starts with the signature, data must have at least signature length bytes.
+ * Returns 1 if it does and 0 if it doesn't */
+typedef int (*MATCH_FUNC)(const uint8_t* data);
+
+/* Finds the first occurrence of the signature between begin and end.
+ * Returns pointer to the beginning of found signature or NULL if not found */
+typedef uint8_t* (*FIND_SIGNATURE_FUNC)(uint8_t* begin, uint8_t* end);
+
+/* Matcher specialized for one bios.h signature */
+typedef struct _MATCHER {
+    const char*         name;       /* name of signature used in reports */
+    uint32_t            length;     /* signature length */
+    const uint8_t*      skip;       /* bad character skip table of signature */
+    MATCH_FUNC          match;      /* compares data with signature */
+    FIND_SIGNATURE_FUNC find;       /* Boyer-Moore-Horspool search of signature */
+} MATCHER;
+
+/* Matchers of all signatures in order of SIG_* identifiers, generated by gen_matchers from SIGNATURES table
+ * at build time, so skip tables are constant and compare loops are unrolled for every signature length */
+extern const MATCHER MATCHERS[SIG_COUNT];
+
+#endif /* MATCHERS_H */
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include "pool.h"
+#include "thread.h"
+
+/* Range of task indexes owned by one thread */
+typedef struct _POOL_QUEUE {
+    MUTEX    mutex;                 /* lock for range bounds */
+    uint32_t begin;                 /* first task not taken yet */
+    uint32_t end;                   /* end of range */
+} POOL_QUEUE;
+
+/* Pool state shared by all threads */
+typedef struct _POOL {
+    POOL_QUEUE* queues;             /* task range of every thread */
+    uint32_t    threads;            /* number of threads */
+    POOL_FUNC   func;               /* task function */
+    void*       context;            /* argument of task function */
+} POOL;
+
+/* Pool thread */
+typedef struct _POOL_WORKER {
+    POOL*    pool;                  /* shared pool state */
+    uint32_t id;                    /* index of own queue */
+    THREAD   thread;                /* thread handle */
+} POOL_WORKER;
+
+/* Takes next task from the beginning of queue.
+ * Returns 1 on success and 0 if queue is empty */
+static int pool_take(POOL_QUEUE* queue, uint32_t* index)
+{
+    int result = 0;
+
+    mutex_lock(&queue->mutex);
+    if (queue->begin < queue->end)
+    {
+        *index = queue->begin++;
+        result = 1;
+    }
+    mutex_unlock(&queue->mutex);
+    return result;
+}
+
+/* Moves the upper half of remaining tasks from another queue to own queue.
+ * Returns 1 on success and 0 if all other queues are empty */
+static int pool_steal(POOL* pool, uint32_t id)
+{
+    uint32_t i;
+
+    for (i = 1; i < pool->threads; i++)
+    {
+        POOL_QUEUE* victim = &pool->queues[(id + i) % pool->threads];
+        uint32_t begin, end;
+
+        mutex_lock(&victim->mutex);
+        end = victim->end;
+        begin = end - (end - victim->begin) / 2;
+        if (victim->begin < end && begin == end)
+            begin--;
+        victim->end = begin;
+        mutex_unlock(&victim->mutex);
+
+        if (begin < end)
+        {
+            POOL_QUEUE* own = &pool->queues[id];
+            mutex_lock(&own->mutex);
+            own->begin = begin;
+            own->end = end;
+            mutex_unlock(&own->mutex);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Pool thread function, runs tasks until there are none left to take or steal */
+static void pool_worker(void* context)
+{
+    POOL_WORKER* worker = (POOL_WORKER*)context;
+    POOL* pool = worker->pool;
+    uint32_t index;
+
+    for (;;)
+    {
+        if (pool_take(&pool->queues[worker->id], &index))
+            pool->func(pool->context, index);
+        else if (!pool_steal(pool, worker->id))
+            break;
+    }
+}
+
+/* Runs tasks 0..count-1 on a pool of threads, current thread included.
+ * Returns 1 when all tasks are done and 0 on failure, no task is run in that case */
+int pool_run(uint32_t count, uint32_t threads, POOL_FUNC func, void* context)
+{
+    POOL pool;
+    POOL_WORKER* workers;
+    uint32_t initialized;
+    uint32_t started;
+    uint32_t i;
+
+    if (!func)
+        return 0;
+    if (threads > count)
+        threads = count;
+    if (!threads)
+        return 1;
+
+    pool.threads = threads;
+    pool.func = func;
+    pool.context = context;
+    pool.queues = (POOL_QUEUE*)calloc(threads, sizeof(POOL_QUEUE));
+    workers = (POOL_WORKER*)calloc(threads, sizeof(POOL_WORKER));
+    if (!pool.queues || !workers)
+    {
+        free(pool.queues);
+        free(workers);
+        return 0;
+    }
+
+    /* Splitting tasks to equal contiguous ranges */
+    for (initialized = 0; initialized < threads; initialized++)
+    {
+        POOL_QUEUE* queue = &pool.queues[initialized];
+        if (!mutex_init(&queue->mutex))
+            break;
+        queue->begin = (uint32_t)((uint64_t)count * initialized / threads);
+        queue->end = (uint32_t)((uint64_t)count * (initialized + 1) / threads);
+        workers[initialized].pool = &pool;
+        workers[initialized].id = initialized;
+    }
+    if (initialized != threads)
+    {
+        for (i = 0; i < initialized; i++)
+            mutex_destroy(&pool.queues[i].mutex);
+        free(pool.queues);
+        free(workers);
+        return 0;
+    }
+
+    /* Current thread works as worker 0, tasks of threads that can't be started are stolen by others */
+    for (started = 1; started < threads; started++)
+        if (!thread_start(&workers[started].thread, pool_worker, &workers[started]))
+            break;
+    pool_worker(&workers[0]);
+    for (i = 1; i < started; i++)
+        thread_join(&workers[i].thread);
+
+    for (i = 0; i < threads; i++)
+        mutex_destroy(&pool.queues[i].mutex);
+    free(pool.queues);
+    free(workers);
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+/* Task function, called once for every task index */
+typedef void (*POOL_FUNC)(void* context, uint32_t index);
+
+/* Runs tasks 0..count-1 on a pool of threads, current thread included.
+ * Every thread starts with its own contiguous range of tasks and steals half
+ * of the remaining range of another thread when its own range is exhausted,
+ * so long tasks don't keep other threads idle.
+ * Returns 1 when all tasks are done and 0 on failure, no task is run in that case */
+int pool_run(uint32_t count, uint32_t threads, POOL_FUNC func, void* context);
+
+#endif /* POOL_H */
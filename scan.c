@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bios.h"
+#include "scan.h"
+#include "matchers.h"
+#include "pool.h"
+
+/* Checks that byte is typical for empty or padding areas of BIOS image */
+#define IS_FILLER(byte) ((byte) == 0x00 || (byte) == 0xFF)
+
+/* Builds scanner for all signatures from SIGNATURES table.
+ * Returns 1 on success and 0 on failure */
+int scanner_init(SCANNER* scanner)
+{
+    uint32_t sig, pos, c;
+
+    if (!scanner || SIG_COUNT > 32)
+        return 0;
+
+    /* Anchor window can't be longer than the shortest signature */
+    scanner->window = SIGNATURES[0].length;
+    scanner->longest = SIGNATURES[0].length;
+    for (sig = 1; sig < SIG_COUNT; sig++)
+    {
+        if (SIGNATURES[sig].length < scanner->window)
+            scanner->window = SIGNATURES[sig].length;
+        if (SIGNATURES[sig].length > scanner->longest)
+            scanner->longest = SIGNATURES[sig].length;
+    }
+
+    for (c = 0; c < 256; c++)
+    {
+        scanner->skip[c] = scanner->window;
+        scanner->candidates[c] = 0;
+    }
+
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        const uint8_t* pattern = SIGNATURES[sig].pattern;
+        uint32_t best_score = 0xFFFFFFFF;
+
+        /* Choosing anchor with the least filler bytes, and never ending with filler byte if possible,
+         * so long 0x00 and 0xFF runs are skipped by full window length */
+        for (pos = 0; pos + scanner->window <= SIGNATURES[sig].length; pos++)
+        {
+            uint32_t score = 0;
+            uint32_t i;
+            for (i = 0; i < scanner->window; i++)
+                if (IS_FILLER(pattern[pos + i]))
+                    score++;
+            if (IS_FILLER(pattern[pos + scanner->window - 1]))
+                score += scanner->window;
+            if (score < best_score)
+            {
+                best_score = score;
+                scanner->anchor[sig] = pos;
+            }
+        }
+
+        pattern += scanner->anchor[sig];
+        for (pos = 0; pos < scanner->window - 1; pos++)
+            if (scanner->skip[pattern[pos]] > scanner->window - 1 - pos)
+                scanner->skip[pattern[pos]] = scanner->window - 1 - pos;
+        scanner->candidates[pattern[scanner->window - 1]] |= 1U << sig;
+    }
+
+    return 1;
+}
+
+/* Frees resources used by scanner */
+void scanner_free(SCANNER* scanner)
+{
+    if (!scanner)
+        return;
+    scanner->window = 0;
+    scanner->longest = 0;
+}
+
+/* Adds new hit to result keeping hits sorted by offset.
+ * Returns 1 on success and 0 on failure */
+static int add_hit(SCAN_RESULT* result, uint32_t offset, uint32_t signature)
+{
+    uint32_t pos;
+
+    if (result->count == result->capacity)
+    {
+        uint32_t capacity = result->capacity ? result->capacity * 2 : 64;
+        SCAN_HIT* hits = (SCAN_HIT*)realloc(result->hits, capacity * sizeof(SCAN_HIT));
+        if (!hits)
+            return 0;
+        result->hits = hits;
+        result->capacity = capacity;
+    }
+
+    /* Hits are found by their last byte, so longer signature can be found after shorter one that starts later */
+    pos = result->count++;
+    while (pos && result->hits[pos - 1].offset > offset)
+    {
+        result->hits[pos] = result->hits[pos - 1];
+        pos--;
+    }
+    result->hits[pos].offset = offset;
+    result->hits[pos].signature = signature;
+    return 1;
+}
+
+/* Scans data from begin to end in one pass and appends all found signatures to result.
+ * Returns 1 on success and 0 on failure */
+int scanner_scan(const SCANNER* scanner, const uint8_t* begin, const uint8_t* end, SCAN_RESULT* result)
+{
+    const uint8_t* current;
+
+    if (!scanner || !scanner->window || !begin || !end || !result || end < begin)
+        return 0;
+    if ((uint32_t)(end - begin) < scanner->window)
+        return 1;
+
+    /* Current points to the last byte of anchor window */
+    for (current = begin + scanner->window - 1; current < end; current += scanner->skip[*current])
+    {
+        uint32_t mask = scanner->candidates[*current];
+        uint32_t sig;
+        for (sig = 0; mask; sig++, mask >>= 1)
+        {
+            const uint8_t* found;
+            if (!(mask & 1))
+                continue;
+
+            /* Checking the whole signature around its anchor by its generated matcher */
+            found = current + 1 - scanner->window - scanner->anchor[sig];
+            if (found < begin || (uint32_t)(end - found) < SIGNATURES[sig].length
+                || !MATCHERS[sig].match(found))
+                continue;
+
+            if (!add_hit(result, (uint32_t)(found - begin), sig))
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Chunk of data scanned by one pool task */
+typedef struct _SCAN_CHUNK {
+    uint32_t    begin;              /* offset of chunk from the beginning of scanned data */
+    uint32_t    end;                /* end of chunk, signatures must start before it */
+    SCAN_RESULT hits;               /* signatures starting in chunk, offsets are relative to chunk begin */
+    int         failed;             /* flag that chunk scan failed */
+} SCAN_CHUNK;
+
+/* State of parallel scan shared by pool tasks */
+typedef struct _SCAN_JOB {
+    const SCANNER* scanner;         /* scanner used by all tasks */
+    const uint8_t* begin;           /* beginning of scanned data */
+    const uint8_t* end;             /* end of scanned data */
+    SCAN_CHUNK*    chunks;          /* chunk of every task */
+} SCAN_JOB;
+
+/* Pool task, scans one chunk with overlap to the next one and drops hits starting in the overlap */
+static void scan_chunk(void* context, uint32_t index)
+{
+    SCAN_JOB* job = (SCAN_JOB*)context;
+    SCAN_CHUNK* chunk = &job->chunks[index];
+    const uint8_t* end = job->begin + chunk->end;
+
+    if ((uint32_t)(job->end - end) > job->scanner->longest - 1)
+        end += job->scanner->longest - 1;
+    else
+        end = job->end;
+
+    if (!scanner_scan(job->scanner, job->begin + chunk->begin, end, &chunk->hits))
+    {
+        chunk->failed = 1;
+        return;
+    }
+    while (chunk->hits.count && chunk->hits.hits[chunk->hits.count - 1].offset >= chunk->end - chunk->begin)
+        chunk->hits.count--;
+}
+
+/* Scans data from begin to end as scanner_scan does, but splits it to chunks scanned on up to threads threads.
+ * Returns 1 on success and 0 on failure */
+int scanner_scan_parallel(const SCANNER* scanner, const uint8_t* begin, const uint8_t* end, SCAN_RESULT* result, uint32_t threads)
+{
+    SCAN_JOB job;
+    uint32_t size;
+    uint32_t count;
+    uint32_t i, j;
+    int ok = 1;
+
+    if (!scanner || !scanner->window || !begin || !end || !result || end < begin)
+        return 0;
+    size = (uint32_t)(end - begin);
+    if (threads < 2 || size / SCAN_CHUNK_SIZE < 2)
+        return scanner_scan(scanner, begin, end, result);
+
+    /* Using a few chunks per thread, so threads that finish early can steal the rest */
+    count = size / SCAN_CHUNK_SIZE;
+    if (count > threads * 4)
+        count = threads * 4;
+
+    job.scanner = scanner;
+    job.begin = begin;
+    job.end = end;
+    job.chunks = (SCAN_CHUNK*)calloc(count, sizeof(SCAN_CHUNK));
+    if (!job.chunks)
+        return 0;
+    for (i = 0; i < count; i++)
+    {
+        job.chunks[i].begin = (uint32_t)((uint64_t)size * i / count);
+        job.chunks[i].end = (uint32_t)((uint64_t)size * (i + 1) / count);
+    }
+
+    if (!pool_run(count, threads, scan_chunk, &job))
+    {
+        free(job.chunks);
+        return scanner_scan(scanner, begin, end, result);
+    }
+
+    /* Chunks are ordered and their hits are sorted, so merging is concatenation */
+    for (i = 0; i < count; i++)
+    {
+        SCAN_CHUNK* chunk = &job.chunks[i];
+        if (chunk->failed)
+            ok = 0;
+        for (j = 0; ok && j < chunk->hits.count; j++)
+            if (!add_hit(result, chunk->begin + chunk->hits.hits[j].offset, chunk->hits.hits[j].signature))
+                ok = 0;
+        scan_result_free(&chunk->hits);
+    }
+
+    free(job.chunks);
+    return ok;
+}
+
+/* Frees memory used by scan result */
+void scan_result_free(SCAN_RESULT* result)
+{
+    if (!result)
+        return;
+    free(result->hits);
+    result->hits = NULL;
+    result->count = 0;
+    result->capacity = 0;
+}
+
+/* Looks up first occurrence of signature located between begin and end in scan result of buffer base.
+ * Works as find_pattern over the same range, but without touching the data.
+ * Returns pointer to the beginning of found signature or NULL if not found */
+uint8_t* find_hit(const SCAN_RESULT* result, uint8_t* base, uint32_t signature, uint8_t* begin, uint8_t* end)
+{
+    uint32_t first, last, from, to;
+
+    if (!result || !base || !begin || !end || end <= begin || begin < base || signature >= SIG_COUNT)
+        return NULL;
+    if ((uint32_t)(end - begin) < SIGNATURES[signature].length)
+        return NULL;
+
+    from = (uint32_t)(begin - base);
+    to = (uint32_t)(end - base) - SIGNATURES[signature].length;
+
+    /* Binary search for first hit at or after begin */
+    first = 0;
+    last = result->count;
+    while (first < last)
+    {
+        uint32_t middle = first + (last - first) / 2;
+        if (result->hits[middle].offset < from)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    for (; first < result->count && result->hits[first].offset <= to; first++)
+    {
+        if (result->hits[first].signature == signature)
+            return base + result->hits[first].offset;
+    }
+
+    return NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include "bios.h"
+
+/* Single signature occurrence found by scanner */
+typedef struct _SCAN_HIT {
+    uint32_t offset;                /* offset of signature from the beginning of scanned buffer */
+    uint32_t signature;             /* SIG_* identifier of found signature */
+} SCAN_HIT;
+
+/* Ordered list of signature occurrences */
+typedef struct _SCAN_RESULT {
+    SCAN_HIT* hits;                 /* hits sorted by offset */
+    uint32_t  count;                /* number of stored hits */
+    uint32_t  capacity;             /* number of allocated hits */
+} SCAN_RESULT;
+
+/* Multi-pattern Horspool scanner built from bios.h signature table.
+ * Every signature is anchored by its most distinctive window of equal length,
+ * so the whole set is searched in one pass with a single bad character skip table */
+typedef struct _SCANNER {
+    uint32_t window;                /* anchor window length, equal to the shortest signature length */
+    uint32_t longest;               /* length of the longest signature */
+    uint32_t anchor[SIG_COUNT];       /* offset of anchor window in each signature */
+    uint32_t candidates[256];       /* bit mask of signatures which anchor ends with given byte */
+    uint32_t skip[256];             /* bad character skip table for all anchors */
+} SCANNER;
+
+/* Builds scanner for all signatures from SIGNATURES table.
+ * Returns 1 on success and 0 on failure */
+int scanner_init(SCANNER* scanner);
+
+/* Frees resources used by scanner */
+void scanner_free(SCANNER* scanner);
+
+/* Scans data from begin to end in one pass and appends all found signatures to result.
+ * Returns 1 on success and 0 on failure */
+int scanner_scan(const SCANNER* scanner, const uint8_t* begin, const uint8_t* end, SCAN_RESULT* result);
+
+/* Minimal size of data scanned by one thread */
+#define SCAN_CHUNK_SIZE 0x400000
+
+/* Scans data from begin to end as scanner_scan does, but splits it to chunks scanned on up to threads threads.
+ * Chunks overlap by the longest signature length minus one and hits are merged by offset,
+ * so result is the same as of scanner_scan. Data smaller than two chunks is scanned by current thread.
+ * Returns 1 on success and 0 on failure */
+int scanner_scan_parallel(const SCANNER* scanner, const uint8_t* begin, const uint8_t* end, SCAN_RESULT* result, uint32_t threads);
+
+/* Frees memory used by scan result */
+void scan_result_free(SCAN_RESULT* result);
+
+/* Looks up first occurrence of signature located between begin and end in scan result of buffer base.
+ * Works as find_pattern over the same range, but without touching the data.
+ * Returns pointer to the beginning of found signature or NULL if not found */
+uint8_t* find_hit(const SCAN_RESULT* result, uint8_t* base, uint32_t signature, uint8_t* begin, uint8_t* end);
+
+#endif /* SCAN_H */
@@ -0,0 +1,430 @@
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+#include "matchers.h"
+
+/* x86 SIMD kernels are built with per-function target attributes, so the rest of the program
+ * stays compatible with any x86 CPU and AVX2 code is only reached after CPUID check */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_X86
+#define SEARCH_TARGET(isa) __attribute__((target(isa)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define SEARCH_X86
+#define SEARCH_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+static FIND_PATTERN_FUNC selected_kernel = find_pattern_scalar;
+static FIND_NOT_BYTE_FUNC selected_find_not_byte = find_not_byte_scalar;
+static FIND_NOT_BYTE_FUNC selected_rfind_not_byte = rfind_not_byte_scalar;
+
+/* Implementation of GNU memmem function using Boyer-Moore-Horspool algorithm
+*  Returns pointer to the beginning of found pattern of NULL if not found */
+uint8_t* find_pattern_scalar(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen)
+{
+    uint32_t scan = 0;
+    uint32_t bad_char_skip[256];
+    uint32_t last;
+    uint32_t slen;
+
+    if (plen == 0 || !begin || !pattern || !end || end <= begin)
+        return NULL;
+
+    slen = end - begin;
+
+    for (scan = 0; scan <= 255; scan++)
+        bad_char_skip[scan] = plen;
+
+    last = plen - 1;
+
+    for (scan = 0; scan < last; scan++)
+        bad_char_skip[pattern[scan]] = last - scan;
+
+    while (slen >= plen)
+    {
+        for (scan = last; begin[scan] == pattern[scan]; scan--)
+            if (scan == 0)
+                return begin;
+
+        slen     -= bad_char_skip[begin[last]];
+        begin   += bad_char_skip[begin[last]];
+    }
+
+    return NULL;
+}
+
+/* Finds first byte not equal to value between begin and end checking 8 bytes at once.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* find_not_byte_scalar(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    uint64_t pattern;
+    uint64_t word;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = 0x0101010101010101ULL * value;
+    while (end - begin >= 8)
+    {
+        memcpy(&word, begin, sizeof(word));
+        if (word != pattern)
+            break;
+        begin += 8;
+    }
+
+    /* Locating the byte inside of different word or checking the tail */
+    for (; begin < end; begin++)
+        if (*begin != value)
+            return begin;
+
+    return NULL;
+}
+
+/* Finds last byte not equal to value between begin and end checking 8 bytes at once.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* rfind_not_byte_scalar(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    uint64_t pattern;
+    uint64_t word;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = 0x0101010101010101ULL * value;
+    while (end - begin >= 8)
+    {
+        memcpy(&word, end - 8, sizeof(word));
+        if (word != pattern)
+            break;
+        end -= 8;
+    }
+
+    /* Locating the byte inside of different word or checking the head */
+    while (end-- > begin)
+        if (*end != value)
+            return end;
+
+    return NULL;
+}
+
+#ifdef SEARCH_X86
+/* Returns index of the lowest set bit of non-zero value */
+static uint32_t ctz32(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(value);
+#endif
+}
+
+/* Returns index of the highest set bit of non-zero value */
+static uint32_t bsr32(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, value);
+    return (uint32_t)index;
+#else
+    return 31 - (uint32_t)__builtin_clz(value);
+#endif
+}
+
+/* SSE2 kernel: tests first and last pattern bytes for 16 positions at once
+ * and compares the middle of pattern only for positions where both of them match */
+SEARCH_TARGET("sse2")
+static uint8_t* find_pattern_sse2(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen)
+{
+    __m128i first, last;
+    uint32_t slen;
+    uint32_t pos;
+
+    if (plen == 0 || !begin || !pattern || !end || end <= begin)
+        return NULL;
+    if (plen == 1)
+        return (uint8_t*)memchr(begin, pattern[0], end - begin);
+
+    slen = end - begin;
+    first = _mm_set1_epi8((char)pattern[0]);
+    last = _mm_set1_epi8((char)pattern[plen - 1]);
+
+    for (pos = 0; slen >= plen - 1 && pos + 16 <= slen - (plen - 1); pos += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(begin + pos));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(begin + pos + plen - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                                                  _mm_cmpeq_epi8(block_last, last)));
+        while (mask)
+        {
+            uint32_t bit = ctz32(mask);
+            if (!memcmp(begin + pos + bit + 1, pattern + 1, plen - 2))
+                return begin + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    /* Checking the tail that is shorter than one vector */
+    return find_pattern_scalar(begin + pos, end, pattern, plen);
+}
+
+/* AVX2 kernel: same as SSE2 kernel, but for 32 positions at once */
+SEARCH_TARGET("avx2")
+static uint8_t* find_pattern_avx2(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen)
+{
+    __m256i first, last;
+    uint32_t slen;
+    uint32_t pos;
+
+    if (plen == 0 || !begin || !pattern || !end || end <= begin)
+        return NULL;
+    if (plen == 1)
+        return (uint8_t*)memchr(begin, pattern[0], end - begin);
+
+    slen = end - begin;
+    first = _mm256_set1_epi8((char)pattern[0]);
+    last = _mm256_set1_epi8((char)pattern[plen - 1]);
+
+    for (pos = 0; slen >= plen - 1 && pos + 32 <= slen - (plen - 1); pos += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(begin + pos));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(begin + pos + plen - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                                        _mm256_cmpeq_epi8(block_last, last)));
+        while (mask)
+        {
+            uint32_t bit = ctz32(mask);
+            if (!memcmp(begin + pos + bit + 1, pattern + 1, plen - 2))
+                return begin + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    /* Checking the tail that is shorter than one vector */
+    return find_pattern_scalar(begin + pos, end, pattern, plen);
+}
+
+/* SSE2 kernel of find_not_byte, compares 16 bytes at once */
+SEARCH_TARGET("sse2")
+static uint8_t* find_not_byte_sse2(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    __m128i pattern;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = _mm_set1_epi8((char)value);
+    while (end - begin >= 16)
+    {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)begin), pattern)) ^ 0xFFFF;
+        if (mask)
+            return begin + ctz32(mask);
+        begin += 16;
+    }
+
+    return find_not_byte_scalar(begin, end, value);
+}
+
+/* SSE2 kernel of rfind_not_byte, compares 16 bytes at once */
+SEARCH_TARGET("sse2")
+static uint8_t* rfind_not_byte_sse2(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    __m128i pattern;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = _mm_set1_epi8((char)value);
+    while (end - begin >= 16)
+    {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(end - 16)), pattern)) ^ 0xFFFF;
+        if (mask)
+            return end - 16 + bsr32(mask);
+        end -= 16;
+    }
+
+    return rfind_not_byte_scalar(begin, end, value);
+}
+
+/* AVX2 kernel of find_not_byte, compares 32 bytes at once */
+SEARCH_TARGET("avx2")
+static uint8_t* find_not_byte_avx2(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    __m256i pattern;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = _mm256_set1_epi8((char)value);
+    while (end - begin >= 32)
+    {
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)begin), pattern));
+        if (mask)
+            return begin + ctz32(mask);
+        begin += 32;
+    }
+
+    return find_not_byte_scalar(begin, end, value);
+}
+
+/* AVX2 kernel of rfind_not_byte, compares 32 bytes at once */
+SEARCH_TARGET("avx2")
+static uint8_t* rfind_not_byte_avx2(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    __m256i pattern;
+
+    if (!begin || !end || end <= begin)
+        return NULL;
+
+    pattern = _mm256_set1_epi8((char)value);
+    while (end - begin >= 32)
+    {
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(end - 32)), pattern));
+        if (mask)
+            return end - 32 + bsr32(mask);
+        end -= 32;
+    }
+
+    return rfind_not_byte_scalar(begin, end, value);
+}
+
+/* Checks that CPU supports SSE2.
+ * Returns 1 if supported and 0 otherwise */
+static int cpu_has_sse2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    /* SSE2 is a part of x86-64 */
+    return 1;
+#elif defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 1);
+    return (regs[3] & 0x04000000) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+/* Checks that CPU and OS support AVX2.
+ * Returns 1 if supported and 0 otherwise */
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return 0;
+    __cpuid(regs, 1);
+    /* OSXSAVE and AVX, OS must save YMM registers */
+    if ((regs[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 0x6) != 0x6)
+        return 0;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & 0x20) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif /* SEARCH_X86 */
+
+/* Selects the fastest search kernel supported by current CPU.
+ * Must be called once at startup before any other thread uses find_pattern */
+void search_init(void)
+{
+    uint32_t kernel;
+
+    for (kernel = SEARCH_KERNEL_COUNT; kernel-- > 0;)
+    {
+        FIND_PATTERN_FUNC func = search_kernel(kernel);
+        if (func)
+        {
+            selected_kernel = func;
+            break;
+        }
+    }
+
+#ifdef SEARCH_X86
+    /* Byte run kernels use the same instruction set as selected pattern search kernel */
+    if (kernel == SEARCH_KERNEL_AVX2)
+    {
+        selected_find_not_byte = find_not_byte_avx2;
+        selected_rfind_not_byte = rfind_not_byte_avx2;
+    }
+    else if (kernel == SEARCH_KERNEL_SSE2)
+    {
+        selected_find_not_byte = find_not_byte_sse2;
+        selected_rfind_not_byte = rfind_not_byte_sse2;
+    }
+#endif
+}
+
+/* Returns search kernel function or NULL if kernel is not supported by compiler or current CPU */
+FIND_PATTERN_FUNC search_kernel(uint32_t kernel)
+{
+    switch (kernel)
+    {
+    case SEARCH_KERNEL_SCALAR:
+        return find_pattern_scalar;
+#ifdef SEARCH_X86
+    case SEARCH_KERNEL_SSE2:
+        return cpu_has_sse2() ? find_pattern_sse2 : NULL;
+    case SEARCH_KERNEL_AVX2:
+        return cpu_has_avx2() ? find_pattern_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+/* Returns printable name of search kernel */
+const char* search_kernel_name(uint32_t kernel)
+{
+    switch (kernel)
+    {
+    case SEARCH_KERNEL_SCALAR:
+        return "scalar";
+    case SEARCH_KERNEL_SSE2:
+        return "sse2";
+    case SEARCH_KERNEL_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+/* Implementation of GNU memmem function using the kernel selected by search_init.
+*  Returns pointer to the beginning of found pattern of NULL if not found */
+uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen)
+{
+    return selected_kernel(begin, end, pattern, plen);
+}
+
+/* Finds the first occurrence of bios.h signature between begin and end using the SIMD kernel selected by search_init,
+*  or the matcher generated for this signature if CPU has no SIMD kernel.
+*  Returns pointer to the beginning of found signature of NULL if not found */
+uint8_t* find_signature(uint8_t* begin, uint8_t* end, uint32_t signature)
+{
+    if (signature >= SIG_COUNT)
+        return NULL;
+    /* Generated matcher has constant skip table, scalar kernel builds it on every call */
+    if (selected_kernel == find_pattern_scalar)
+        return MATCHERS[signature].find(begin, end);
+    return selected_kernel(begin, end, SIGNATURES[signature].pattern, SIGNATURES[signature].length);
+}
+
+/* Finds first byte not equal to value between begin and end using the kernel selected by search_init.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* find_not_byte(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    return selected_find_not_byte(begin, end, value);
+}
+
+/* Finds last byte not equal to value between begin and end using the kernel selected by search_init.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* rfind_not_byte(uint8_t* begin, uint8_t* end, uint8_t value)
+{
+    return selected_rfind_not_byte(begin, end, value);
+}
@@ -0,0 +1,53 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+
+/* Search kernels */
+#define SEARCH_KERNEL_SCALAR        0
+#define SEARCH_KERNEL_SSE2          1
+#define SEARCH_KERNEL_AVX2          2
+#define SEARCH_KERNEL_COUNT         3
+
+/* Pattern search function, all kernels return exactly the same results */
+typedef uint8_t* (*FIND_PATTERN_FUNC)(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen);
+
+/* Byte run search function, all kernels return exactly the same results */
+typedef uint8_t* (*FIND_NOT_BYTE_FUNC)(uint8_t* begin, uint8_t* end, uint8_t value);
+
+/* Selects the fastest search kernel supported by current CPU.
+ * Must be called once at startup before any other thread uses find_pattern */
+void search_init(void);
+
+/* Returns search kernel function or NULL if kernel is not supported by compiler or current CPU */
+FIND_PATTERN_FUNC search_kernel(uint32_t kernel);
+
+/* Returns printable name of search kernel */
+const char* search_kernel_name(uint32_t kernel);
+
+/* Implementation of GNU memmem function using the kernel selected by search_init.
+*  Returns pointer to the beginning of found pattern of NULL if not found */
+uint8_t* find_pattern(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen);
+
+/* Finds the first occurrence of bios.h signature between begin and end using the SIMD kernel selected by search_init,
+*  or the matcher generated for this signature if CPU has no SIMD kernel.
+*  Returns pointer to the beginning of found signature of NULL if not found */
+uint8_t* find_signature(uint8_t* begin, uint8_t* end, uint32_t signature);
+
+/* Implementation of GNU memmem function using Boyer-Moore-Horspool algorithm
+*  Returns pointer to the beginning of found pattern of NULL if not found */
+uint8_t* find_pattern_scalar(uint8_t* begin, uint8_t* end, const uint8_t* pattern, uint32_t plen);
+
+/* Finds first byte not equal to value between begin and end.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* find_not_byte(uint8_t* begin, uint8_t* end, uint8_t value);
+
+/* Finds last byte not equal to value between begin and end.
+ * Returns pointer to found byte or NULL if all bytes are equal to value */
+uint8_t* rfind_not_byte(uint8_t* begin, uint8_t* end, uint8_t value);
+
+/* Word-at-a-time implementations of find_not_byte and rfind_not_byte for CPUs without SIMD kernels */
+uint8_t* find_not_byte_scalar(uint8_t* begin, uint8_t* end, uint8_t value);
+uint8_t* rfind_not_byte_scalar(uint8_t* begin, uint8_t* end, uint8_t value);
+
+#endif /* SEARCH_H */
@@ -0,0 +1,185 @@
+#define  _CRT_SECURE_NO_WARNINGS
+#ifdef __linux__
+#define  _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include "stats.h"
+#include "thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#define STATS_PERF
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/* Names of stages in order of STATS_STAGE values */
+static const char* STAGE_NAMES[STATS_STAGE_COUNT] = {
+    "probe",
+    "load_input", "scan_input", "index_input",
+    "load_output", "scan_output", "index_output",
+    "clone", "extract", "empty_check",
+    "patch", "free_space", "checksum",
+    "verify", "write"
+};
+
+/* Returns CPU time of current thread or of the whole process in microseconds */
+static uint64_t cpu_time(int8_t wholeProcess)
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    BOOL result = wholeProcess ? GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)
+                               : GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+    if (!result)
+        return 0;
+    /* FILETIME counts 100-nanosecond intervals */
+    return ((((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime)
+            + (((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime)) / 10;
+#else
+    struct timespec ts;
+    if (clock_gettime(wholeProcess ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+#ifdef STATS_PERF
+/* Opens hardware counter of user space events of current thread, or of the process and threads started by it if inherit is set.
+ * Returns descriptor of counter or -1 on failure */
+static int open_counter(uint64_t config, int8_t inherit)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.inherit = inherit ? 1 : 0;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Returns current value of hardware counter, 0 if it can't be read */
+static uint64_t read_counter(int counter)
+{
+    uint64_t value;
+    if (counter < 0 || read(counter, &value, sizeof(value)) != sizeof(value))
+        return 0;
+    return value;
+}
+#endif
+
+/* Clears all counters */
+void stats_init(STATS* stats, int8_t wholeProcess)
+{
+    memset(stats, 0, sizeof(STATS));
+    stats->wholeProcess = wholeProcess;
+    stats->cycles = -1;
+    stats->instructions = -1;
+}
+
+/* Opens hardware counters of current thread or process.
+ * Returns 1 if they are opened and 0 if they aren't */
+int stats_start(STATS* stats)
+{
+    if (!stats)
+        return 0;
+#ifdef STATS_PERF
+    stats->cycles = open_counter(PERF_COUNT_HW_CPU_CYCLES, stats->wholeProcess);
+    stats->instructions = open_counter(PERF_COUNT_HW_INSTRUCTIONS, stats->wholeProcess);
+    if (stats->cycles < 0 || stats->instructions < 0)
+    {
+        stats_stop(stats);
+        return 0;
+    }
+    stats->hardware = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Closes hardware counters opened by stats_start */
+void stats_stop(STATS* stats)
+{
+    if (!stats)
+        return;
+#ifdef STATS_PERF
+    if (stats->cycles >= 0)
+        close(stats->cycles);
+    if (stats->instructions >= 0)
+        close(stats->instructions);
+#endif
+    stats->cycles = -1;
+    stats->instructions = -1;
+}
+
+/* Takes values at the start of a stage, nothing is done if stats is NULL */
+void stats_begin(const STATS* stats, STATS_MARK* mark)
+{
+    if (!stats)
+        return;
+    mark->wallTime = timer_now();
+    mark->cpuTime = cpu_time(stats->wholeProcess);
+#ifdef STATS_PERF
+    mark->cycles = read_counter(stats->cycles);
+    mark->instructions = read_counter(stats->instructions);
+#else
+    mark->cycles = 0;
+    mark->instructions = 0;
+#endif
+}
+
+/* Adds time and counters elapsed since stats_begin, bytes and items to stage counters, nothing is done if stats is NULL */
+void stats_end(STATS* stats, STATS_STAGE stage, const STATS_MARK* mark, uint64_t bytes, uint64_t items)
+{
+    STATS_COUNTERS* counters;
+
+    if (!stats || stage >= STATS_STAGE_COUNT)
+        return;
+    counters = &stats->stages[stage];
+    counters->calls++;
+    counters->bytes += bytes;
+    counters->items += items;
+    counters->wallTime += timer_now() - mark->wallTime;
+    counters->cpuTime += cpu_time(stats->wholeProcess) - mark->cpuTime;
+#ifdef STATS_PERF
+    if (stats->cycles >= 0)
+        counters->cycles += read_counter(stats->cycles) - mark->cycles;
+    if (stats->instructions >= 0)
+        counters->instructions += read_counter(stats->instructions) - mark->instructions;
+#endif
+}
+
+/* Adds all stage counters of source to stats */
+void stats_add(STATS* stats, const STATS* source)
+{
+    uint32_t i;
+
+    if (!stats || !source)
+        return;
+    for (i = 0; i < STATS_STAGE_COUNT; i++)
+    {
+        stats->stages[i].calls += source->stages[i].calls;
+        stats->stages[i].bytes += source->stages[i].bytes;
+        stats->stages[i].items += source->stages[i].items;
+        stats->stages[i].wallTime += source->stages[i].wallTime;
+        stats->stages[i].cpuTime += source->stages[i].cpuTime;
+        stats->stages[i].cycles += source->stages[i].cycles;
+        stats->stages[i].instructions += source->stages[i].instructions;
+    }
+}
+
+/* Returns name of stage used in reports */
+const char* stats_stage_name(STATS_STAGE stage)
+{
+    return stage < STATS_STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
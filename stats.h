@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* Stages of library calls measured by statistics, a stage can contain other stages */
+typedef enum _STATS_STAGE {
+    STATS_PROBE = 0,                /* reading files only until their motherboard names are found */
+    STATS_LOAD_INPUT,               /* input file or bundle loading */
+    STATS_SCAN_INPUT,               /* locating signatures in input file, by scan or from signature cache */
+    STATS_INDEX_INPUT,              /* indexing firmware volumes of input file */
+    STATS_LOAD_OUTPUT,              /* output file loading */
+    STATS_SCAN_OUTPUT,              /* locating signatures in output file, by scan or from signature cache */
+    STATS_INDEX_OUTPUT,             /* indexing firmware volumes of output file */
+    STATS_CLONE,                    /* cloning of output file loaded beforehand */
+    STATS_EXTRACT,                  /* extraction of input file data */
+    STATS_EMPTY_CHECK,              /* checking that FD44 module data is not empty */
+    STATS_PATCH,                    /* copying of input file data to output file in memory */
+    STATS_FREE_SPACE,               /* checking free space for SLIC modules */
+    STATS_CHECKSUM,                 /* calculation of SLIC module checksums */
+    STATS_VERIFY,                   /* integrity verification of patched volumes and files */
+    STATS_WRITE,                    /* writing of output file, bundle or delta file */
+    STATS_STAGE_COUNT
+} STATS_STAGE;
+
+/* Counters of one stage */
+typedef struct _STATS_COUNTERS {
+    uint64_t calls;                 /* number of times stage was ran */
+    uint64_t bytes;                 /* number of bytes processed */
+    uint64_t items;                 /* number of signatures, volumes or ranges processed */
+    uint64_t wallTime;              /* elapsed time in microseconds */
+    uint64_t cpuTime;               /* CPU time in microseconds */
+    uint64_t cycles;                /* CPU cycles, 0 if hardware counters are not available */
+    uint64_t instructions;          /* retired instructions, 0 if hardware counters are not available */
+} STATS_COUNTERS;
+
+/* Statistics of library calls made by one thread, or by the whole process */
+typedef struct _STATS {
+    STATS_COUNTERS stages[STATS_STAGE_COUNT];   /* counters of every stage */
+    int8_t         wholeProcess;                /* flag that CPU time and hardware counters include all threads of the process */
+    int8_t         hardware;                    /* flag that hardware counters are collected */
+    int            cycles;                      /* descriptor of CPU cycles counter, -1 if it isn't open */
+    int            instructions;                /* descriptor of instructions counter, -1 if it isn't open */
+} STATS;
+
+/* Values taken at the start of a stage */
+typedef struct _STATS_MARK {
+    uint64_t wallTime;              /* monotonic time in microseconds */
+    uint64_t cpuTime;               /* CPU time in microseconds */
+    uint64_t cycles;                /* CPU cycles counter value */
+    uint64_t instructions;          /* instructions counter value */
+} STATS_MARK;
+
+/* Clears all counters. If wholeProcess is set, CPU time and hardware counters include threads started later,
+ * otherwise only the thread calling stats_start is measured */
+void stats_init(STATS* stats, int8_t wholeProcess);
+
+/* Opens hardware counters of current thread or process, they are available only on Linux with perf events allowed.
+ * Statistics work without them, so returns 1 if they are opened and 0 if they aren't */
+int stats_start(STATS* stats);
+
+/* Closes hardware counters opened by stats_start */
+void stats_stop(STATS* stats);
+
+/* Takes values at the start of a stage, nothing is done if stats is NULL */
+void stats_begin(const STATS* stats, STATS_MARK* mark);
+
+/* Adds time and counters elapsed since stats_begin, bytes and items to stage counters, nothing is done if stats is NULL */
+void stats_end(STATS* stats, STATS_STAGE stage, const STATS_MARK* mark, uint64_t bytes, uint64_t items);
+
+/* Adds all stage counters of source to stats */
+void stats_add(STATS* stats, const STATS* source);
+
+/* Returns name of stage used in reports */
+const char* stats_stage_name(STATS_STAGE stage);
+
+#endif /* STATS_H */
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+
+/* Prepares window of given capacity for reading from input and writing to output, output can be NULL.
+ * Returns 1 on success and 0 on failure */
+int stream_init(STREAM* stream, FILE* input, FILE* output, uint32_t capacity)
+{
+    if (!stream || !input || !capacity)
+        return 0;
+
+    memset(stream, 0, sizeof(STREAM));
+    stream->input = input;
+    stream->output = output;
+    stream->window.flags = IMAGE_WRITABLE;
+    stream->window.data = (uint8_t*)malloc(capacity);
+    if (!stream->window.data)
+        return 0;
+    stream->capacity = capacity;
+    return 1;
+}
+
+/* Reads input until window is full or input ends.
+ * Returns 1 on success and 0 on read error, errno is preserved for perror */
+int stream_fill(STREAM* stream)
+{
+    while (!stream->eof && stream->window.size < stream->capacity)
+    {
+        size_t read = fread(stream->window.data + stream->window.size, 1, stream->capacity - stream->window.size, stream->input);
+        stream->window.size += (uint32_t)read;
+        if (!read)
+        {
+            if (ferror(stream->input))
+                return 0;
+            stream->eof = 1;
+        }
+    }
+    return 1;
+}
+
+/* Grows window capacity so it can hold at least length bytes.
+ * Returns 1 on success and 0 on failure */
+int stream_reserve(STREAM* stream, uint32_t length)
+{
+    uint8_t* data;
+
+    if (length <= stream->capacity)
+        return 1;
+    data = (uint8_t*)realloc(stream->window.data, length);
+    if (!data)
+        return 0;
+    stream->window.data = data;
+    stream->capacity = length;
+    return 1;
+}
+
+/* Removes length first bytes from window, writing them to output if write is set.
+ * Returns 1 on success and 0 on write error, errno is preserved for perror */
+int stream_drop(STREAM* stream, uint32_t length, int8_t write)
+{
+    if (length > stream->window.size)
+        length = stream->window.size;
+    if (write && stream->output && length && fwrite(stream->window.data, 1, length, stream->output) != length)
+        return 0;
+
+    memmove(stream->window.data, stream->window.data + length, stream->window.size - length);
+    stream->window.size -= length;
+    stream->offset += length;
+
+    /* Changes are already written, so their ranges are not needed anymore */
+    stream->window.dirtyCount = 0;
+    return 1;
+}
+
+/* Frees window */
+void stream_free(STREAM* stream)
+{
+    if (!stream)
+        return;
+    free(stream->window.data);
+    free(stream->window.dirty);
+    memset(stream, 0, sizeof(STREAM));
+}
@@ -0,0 +1,37 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "image.h"
+
+/* Window of data read from sequential input, optionally written to sequential output after being changed */
+typedef struct _STREAM {
+    FILE*    input;                 /* input stream */
+    FILE*    output;                /* output stream, NULL if data is only read */
+    IMAGE    window;                /* window data, changed by image_patch before it is written */
+    uint32_t capacity;              /* number of bytes window can hold */
+    uint32_t offset;                /* offset of the first window byte from the beginning of data */
+    int8_t   eof;                   /* flag that the whole input is read */
+} STREAM;
+
+/* Prepares window of given capacity for reading from input and writing to output, output can be NULL.
+ * Returns 1 on success and 0 on failure */
+int stream_init(STREAM* stream, FILE* input, FILE* output, uint32_t capacity);
+
+/* Reads input until window is full or input ends.
+ * Returns 1 on success and 0 on read error, errno is preserved for perror */
+int stream_fill(STREAM* stream);
+
+/* Grows window capacity so it can hold at least length bytes.
+ * Returns 1 on success and 0 on failure */
+int stream_reserve(STREAM* stream, uint32_t length);
+
+/* Removes length first bytes from window, writing them to output if write is set.
+ * Returns 1 on success and 0 on write error, errno is preserved for perror */
+int stream_drop(STREAM* stream, uint32_t length, int8_t write);
+
+/* Frees window */
+void stream_free(STREAM* stream);
+
+#endif /* STREAM_H */
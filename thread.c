@@ -0,0 +1,171 @@
+#include "thread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+/* Adapts thread function to Win32 thread procedure */
+static DWORD WINAPI thread_entry(LPVOID parameter)
+{
+    THREAD* thread = (THREAD*)parameter;
+    thread->func(thread->context);
+    return 0;
+}
+#else
+/* Adapts thread function to POSIX thread start routine */
+static void* thread_entry(void* parameter)
+{
+    THREAD* thread = (THREAD*)parameter;
+    thread->func(thread->context);
+    return NULL;
+}
+#endif
+
+/* Starts new thread running func(context). Thread structure must stay valid until thread_join.
+ * Returns 1 on success and 0 on failure */
+int thread_start(THREAD* thread, THREAD_FUNC func, void* context)
+{
+    if (!thread || !func)
+        return 0;
+
+    thread->func = func;
+    thread->context = context;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    return thread->handle != NULL;
+#else
+    return pthread_create(&thread->handle, NULL, thread_entry, thread) == 0;
+#endif
+}
+
+/* Waits for thread to finish */
+void thread_join(THREAD* thread)
+{
+    if (!thread)
+        return;
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+/* Initializes mutex.
+ * Returns 1 on success and 0 on failure */
+int mutex_init(MUTEX* mutex)
+{
+    if (!mutex)
+        return 0;
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->lock);
+    return 1;
+#else
+    return pthread_mutex_init(&mutex->lock, NULL) == 0;
+#endif
+}
+
+/* Locks mutex */
+void mutex_lock(MUTEX* mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+/* Unlocks mutex */
+void mutex_unlock(MUTEX* mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+/* Destroys mutex */
+void mutex_destroy(MUTEX* mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+/* Initializes condition variable.
+ * Returns 1 on success and 0 on failure */
+int condition_init(CONDITION* condition)
+{
+    if (!condition)
+        return 0;
+#ifdef _WIN32
+    InitializeConditionVariable(&condition->variable);
+    return 1;
+#else
+    return pthread_cond_init(&condition->variable, NULL) == 0;
+#endif
+}
+
+/* Unlocks mutex, waits until condition is signaled and locks mutex again, waiting can end without signal */
+void condition_wait(CONDITION* condition, MUTEX* mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(&condition->variable, &mutex->lock, INFINITE);
+#else
+    pthread_cond_wait(&condition->variable, &mutex->lock);
+#endif
+}
+
+/* Wakes all threads waiting for condition */
+void condition_broadcast(CONDITION* condition)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&condition->variable);
+#else
+    pthread_cond_broadcast(&condition->variable);
+#endif
+}
+
+/* Destroys condition variable */
+void condition_destroy(CONDITION* condition)
+{
+#ifdef _WIN32
+    (void)condition;
+#else
+    pthread_cond_destroy(&condition->variable);
+#endif
+}
+
+/* Returns number of CPUs available to the process */
+uint32_t cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+/* Returns monotonic time in microseconds, used to measure durations */
+uint64_t timer_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart * 1000000
+                      + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
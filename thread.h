@@ -0,0 +1,83 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/* Thread function */
+typedef void (*THREAD_FUNC)(void* context);
+
+/* Thread handle */
+typedef struct _THREAD {
+#ifdef _WIN32
+    HANDLE          handle;
+#else
+    pthread_t       handle;
+#endif
+    THREAD_FUNC     func;           /* function ran by thread */
+    void*           context;        /* argument of thread function */
+} THREAD;
+
+/* Mutual exclusion lock */
+typedef struct _MUTEX {
+#ifdef _WIN32
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t  lock;
+#endif
+} MUTEX;
+
+/* Condition variable, waited on with locked mutex */
+typedef struct _CONDITION {
+#ifdef _WIN32
+    CONDITION_VARIABLE variable;
+#else
+    pthread_cond_t     variable;
+#endif
+} CONDITION;
+
+/* Starts new thread running func(context). Thread structure must stay valid until thread_join.
+ * Returns 1 on success and 0 on failure */
+int thread_start(THREAD* thread, THREAD_FUNC func, void* context);
+
+/* Waits for thread to finish */
+void thread_join(THREAD* thread);
+
+/* Initializes mutex.
+ * Returns 1 on success and 0 on failure */
+int mutex_init(MUTEX* mutex);
+
+/* Locks mutex */
+void mutex_lock(MUTEX* mutex);
+
+/* Unlocks mutex */
+void mutex_unlock(MUTEX* mutex);
+
+/* Destroys mutex */
+void mutex_destroy(MUTEX* mutex);
+
+/* Initializes condition variable.
+ * Returns 1 on success and 0 on failure */
+int condition_init(CONDITION* condition);
+
+/* Unlocks mutex, waits until condition is signaled and locks mutex again, waiting can end without signal */
+void condition_wait(CONDITION* condition, MUTEX* mutex);
+
+/* Wakes all threads waiting for condition */
+void condition_broadcast(CONDITION* condition);
+
+/* Destroys condition variable */
+void condition_destroy(CONDITION* condition);
+
+/* Returns number of CPUs available to the process */
+uint32_t cpu_count(void);
+
+/* Returns monotonic time in microseconds, used to measure durations */
+uint64_t timer_now(void);
+
+#endif /* THREAD_H */
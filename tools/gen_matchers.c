@@ -0,0 +1,170 @@
+#define  _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bios.h"
+
+/* Names of signatures in order of SIG_* identifiers, used for generated function names */
+static const char* NAMES[] = {
+    "bootefi", "gbe", "efi_volume", "dummy_msoa_module", "msoa_module",
+    "slic_pubkey", "slic_marker", "fd44_module",
+    "asusbkp", "asusbkp_pubkey", "asusbkp_marker"
+};
+
+/* Build fails if a signature is added to bios.h without a name */
+typedef char NAMES_MATCH_SIGNATURES[(sizeof(NAMES) / sizeof(NAMES[0]) == SIG_COUNT) ? 1 : -1];
+
+/* Writes value of width bytes of pattern read in little-endian and big-endian order as arguments of NATIVE macro */
+static void write_word(FILE* file, const uint8_t* pattern, uint32_t width)
+{
+    uint64_t little = 0, big = 0;
+    uint32_t i;
+
+    for (i = 0; i < width; i++)
+    {
+        little |= (uint64_t)pattern[i] << (8 * i);
+        big = (big << 8) | pattern[i];
+    }
+    fprintf(file, "NATIVE(0x%0*llXULL, 0x%0*llXULL)", (int)width * 2, (unsigned long long)little, (int)width * 2, (unsigned long long)big);
+}
+
+/* Returns width in bytes of the next word compared at given number of remaining signature bytes */
+static uint32_t word_width(uint32_t remaining)
+{
+    return remaining >= 8 ? 8 : remaining >= 4 ? 4 : remaining >= 2 ? 2 : 1;
+}
+
+/* Checks that signature of given length is compared by words of given width.
+ * Returns 1 if it is and 0 if it isn't */
+static int uses_width(uint32_t length, uint32_t width)
+{
+    uint32_t offset;
+
+    for (offset = 0; offset < length; offset += word_width(length - offset))
+        if (word_width(length - offset) == width)
+            return 1;
+    return 0;
+}
+
+/* Writes skip table, match and find functions of one signature.
+ * Returns 1 on success and 0 on failure */
+static int write_signature(FILE* file, uint32_t sig)
+{
+    const uint8_t* pattern = SIGNATURES[sig].pattern;
+    uint32_t length = SIGNATURES[sig].length;
+    uint32_t skip[256];
+    uint32_t offset;
+    uint32_t i;
+
+    /* Skip table is stored in bytes */
+    if (length == 0 || length > 255)
+        return 0;
+
+    for (i = 0; i < 256; i++)
+        skip[i] = length;
+    for (i = 0; i < length - 1; i++)
+        skip[pattern[i]] = length - 1 - i;
+
+    fprintf(file, "/* %s, %u bytes */\nstatic const uint8_t SKIP_%u[256] = {", NAMES[sig], length, sig);
+    for (i = 0; i < 256; i++)
+        fprintf(file, "%s%u%s", i % 16 ? " " : "\n    ", skip[i], i < 255 ? "," : "\n};\n\n");
+
+    /* Signature is compared by the widest words that fit, so no loop is left */
+    fprintf(file, "static int match_%s(const uint8_t* data)\n{\n    return ", NAMES[sig]);
+    for (offset = 0; offset < length;)
+    {
+        uint32_t width = word_width(length - offset);
+        if (offset)
+            fprintf(file, "\n        && ");
+        if (width == 1)
+            fprintf(file, "data[%u] == 0x%02X", offset, pattern[offset]);
+        else
+        {
+            fprintf(file, "load%u(data + %u) == ", width * 8, offset);
+            write_word(file, pattern + offset, width);
+        }
+        offset += width;
+    }
+    fprintf(file, ";\n}\n\n");
+
+    /* Last byte is tested before the whole signature, as Horspool search does */
+    fprintf(file, "static uint8_t* find_%s(uint8_t* begin, uint8_t* end)\n{\n"
+                  "    if (!begin || !end || end - begin < %u)\n"
+                  "        return NULL;\n\n"
+                  "    for (end -= %u; begin <= end; begin += SKIP_%u[begin[%u]])\n"
+                  "        if (begin[%u] == 0x%02X && match_%s(begin))\n"
+                  "            return begin;\n\n"
+                  "    return NULL;\n}\n\n",
+            NAMES[sig], length, length, sig, length - 1, length - 1, pattern[length - 1], NAMES[sig]);
+    return 1;
+}
+
+/* Entry point */
+int main(int argc, char* argv[])
+{
+    FILE* file;
+    uint32_t sig;
+    uint32_t width;
+
+    if (argc != 2)
+    {
+        printf("Usage: gen_matchers OUTFILE\n\n"
+               "Writes C source of matchers specialized for every bios.h signature to OUTFILE.\n");
+        return 2;
+    }
+
+    file = fopen(argv[1], "w");
+    if (!file)
+    {
+        perror("Can't create output file");
+        return 1;
+    }
+
+    fprintf(file, "/* Generated by gen_matchers from bios.h signatures, do not edit */\n\n"
+                  "#include <stddef.h>\n"
+                  "#include <string.h>\n"
+                  "#include \"matchers.h\"\n\n"
+                  "/* Selects constant of native byte order, words are read in it */\n"
+                  "#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__\n"
+                  "#define NATIVE(little, big) (big)\n"
+                  "#else\n"
+                  "#define NATIVE(little, big) (little)\n"
+                  "#endif\n\n");
+
+    /* Only word loads used by some signature are written, so generated code has no unused functions */
+    for (width = 8; width >= 2; width /= 2)
+    {
+        for (sig = 0; sig < SIG_COUNT; sig++)
+            if (uses_width(SIGNATURES[sig].length, width))
+                break;
+        if (sig < SIG_COUNT)
+            fprintf(file, "static uint%u_t load%u(const uint8_t* data) { uint%u_t value; memcpy(&value, data, sizeof(value)); return value; }\n",
+                    width * 8, width * 8, width * 8);
+    }
+    fprintf(file, "\n");
+
+    for (sig = 0; sig < SIG_COUNT; sig++)
+    {
+        if (!write_signature(file, sig))
+        {
+            printf("Signature %s can't be matched by generated code.\n", NAMES[sig]);
+            fclose(file);
+            remove(argv[1]);
+            return 1;
+        }
+    }
+
+    fprintf(file, "const MATCHER MATCHERS[SIG_COUNT] = {\n");
+    for (sig = 0; sig < SIG_COUNT; sig++)
+        fprintf(file, "    { \"%s\", %u, SKIP_%u, match_%s, find_%s }%s\n", NAMES[sig], SIGNATURES[sig].length, sig,
+                NAMES[sig], NAMES[sig], sig + 1 < SIG_COUNT ? "," : "");
+    fprintf(file, "};\n");
+
+    if (fclose(file))
+    {
+        perror("Can't write output file");
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}